@@ -0,0 +1,60 @@
+// Replaces the global allocation functions of the benchmarks with ones that
+// count the allocations of every thread, see `thread_allocations()`
+
+#include <cstdlib>
+#include <new>
+
+#include "bench_utils.h"
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+void* allocate(size_t size, size_t alignment) {
+  ++allocations;
+  size = size == 0 ? 1 : size;
+  // `aligned_alloc` wants a multiple of the alignment
+  void* block =
+      alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+          ? std::malloc(size)
+          : std::aligned_alloc(
+                alignment, (size + alignment - 1) / alignment * alignment);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+}  // namespace
+
+size_t thread_allocations() { return allocations; }
+
+void* operator new(size_t size) {
+  return allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new[](size_t size) {
+  return allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+void operator delete[](void* block, size_t) noexcept { std::free(block); }
+void operator delete(void* block, std::align_val_t) noexcept {
+  std::free(block);
+}
+void operator delete[](void* block, std::align_val_t) noexcept {
+  std::free(block);
+}
+void operator delete(void* block, size_t, std::align_val_t) noexcept {
+  std::free(block);
+}
+void operator delete[](void* block, size_t, std::align_val_t) noexcept {
+  std::free(block);
+}
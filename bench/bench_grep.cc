@@ -0,0 +1,110 @@
+#include <benchmark/benchmark.h>
+#include <liblogovo/mapped_file.h>
+#include <liblogovo/scan_pool.h>
+#include <liblogovo/tail.h>
+
+#include <sstream>
+
+#include "bench_utils.h"
+
+namespace {
+
+constexpr size_t LINES = 200000;
+
+const std::string& log_text() {
+  static const std::string result = make_log_text(LINES);
+  return result;
+}
+
+// Patterns of decreasing selectivity: every tenth line, ~0.5% of lines, none
+const char* PATTERNS[] = {"7 of", "1234", "no such line"};
+
+// What `tail()` used to do: split every line and look for the pattern in it
+void BM_GrepPerLine(benchmark::State& state) {
+  std::string pattern = PATTERNS[state.range(0)];
+  state.SetLabel(pattern);
+  for (auto _ : state) {
+    std::stringstream input(log_text());
+    size_t matches = 0;
+    for (auto line : tail(input, LINES)) {
+      if (line.contains(pattern)) {
+        ++matches;
+      }
+    }
+    benchmark::DoNotOptimize(matches);
+  }
+  state.SetBytesProcessed(state.iterations() * log_text().size());
+}
+
+void BM_GrepBlock(benchmark::State& state) {
+  std::string pattern = PATTERNS[state.range(0)];
+  state.SetLabel(pattern);
+  for (auto _ : state) {
+    std::stringstream input(log_text());
+    size_t matches = 0;
+    for (auto line : tail(input, LINES, Grep(pattern))) {
+      benchmark::DoNotOptimize(line);
+      ++matches;
+    }
+    benchmark::DoNotOptimize(matches);
+  }
+  state.SetBytesProcessed(state.iterations() * log_text().size());
+}
+
+// Filters other than a single substring: alternatives, a case-insensitive
+// substring, a regex with literals to look for, and one without
+void BM_GrepFilter(benchmark::State& state) {
+  static const std::vector<std::pair<const char*, GrepQuery>> FILTERS = {
+      {"any", {.any = {"1234", "7 of"}}},
+      {"icase", {.all = {"1234"}, .ignore_case = true}},
+      {"regex", {.regexes = {R"(7 of \d+)"}}},
+      {"regex without literals", {.regexes = {R"(\d{4}\D)"}}},
+  };
+  auto& [label, query] = FILTERS[state.range(0)];
+  state.SetLabel(label);
+  auto grep = Grep::create(query);
+  for (auto _ : state) {
+    std::stringstream input(log_text());
+    size_t matches = 0;
+    for (auto line : tail(input, LINES, grep)) {
+      benchmark::DoNotOptimize(line);
+      ++matches;
+    }
+    benchmark::DoNotOptimize(matches);
+  }
+  state.SetBytesProcessed(state.iterations() * log_text().size());
+}
+
+// A rare pattern through a large mapped file, searched on the given amount of
+// threads (0 means the sequential scan)
+void BM_GrepMappedFile(benchmark::State& state) {
+  constexpr size_t FILE_LINES = 2000000;
+  static const TempLogDir dir({{"large_log.txt", make_log_text(FILE_LINES)}});
+  auto file = MappedFile::open(dir.path() / "large_log.txt");
+  if (!file) {
+    state.SkipWithError("failed to map the file");
+    return;
+  }
+  std::unique_ptr<ScanPool> pool;
+  if (state.range(0) > 0) {
+    pool = std::make_unique<ScanPool>(state.range(0));
+  }
+
+  for (auto _ : state) {
+    size_t matches = 0;
+    auto lines = tail(*file, FILE_LINES, Grep("1234567"), {}, pool.get());
+    for (auto line : lines) {
+      benchmark::DoNotOptimize(line);
+      ++matches;
+    }
+    benchmark::DoNotOptimize(matches);
+  }
+  state.SetBytesProcessed(state.iterations() * file->size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_GrepPerLine)->DenseRange(0, 2);
+BENCHMARK(BM_GrepBlock)->DenseRange(0, 2);
+BENCHMARK(BM_GrepFilter)->DenseRange(0, 3);
+BENCHMARK(BM_GrepMappedFile)->Arg(0)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
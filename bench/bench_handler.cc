@@ -0,0 +1,159 @@
+#include <benchmark/benchmark.h>
+#include <liblogovo/handler.h>
+
+#include <boost/beast/http.hpp>
+
+#include "bench_utils.h"
+
+namespace http = boost::beast::http;
+
+namespace {
+
+constexpr size_t LINES = 100000;
+
+const TempLogDir& log_dir() {
+  static const TempLogDir result({{"log.txt", make_log_text(LINES)}});
+  return result;
+}
+
+// Drains a response the same way `beast::async_write` does, minus the socket.
+// Returns the amount of bytes and writes, or nullopt on error.
+std::optional<std::pair<size_t, size_t>> serve(
+    Handler& handler, const std::string& target) {
+  http::request<http::string_body> req{http::verb::get, target, 11};
+  auto msg = std::get<http::message_generator>(
+      handler.handle_request(std::move(req)));
+  boost::beast::error_code ec;
+  size_t bytes = 0;
+  size_t writes = 0;
+  while (!msg.is_done()) {
+    auto buffers = msg.prepare(ec);
+    if (ec) {
+      return std::nullopt;
+    }
+    auto size = boost::asio::buffer_size(buffers);
+    msg.consume(size);
+    bytes += size;
+    ++writes;
+  }
+  return std::make_pair(bytes, writes);
+}
+
+// Serves `n` lines with the given write buffer size. Reports requests/s, MB/s
+// and the amount of writes each response takes.
+void BM_ServeLog(benchmark::State& state) {
+  HandlerOptions options;
+  options.write_buffer_size = state.range(0);
+  // Every iteration is the same request, which is not what this is about
+  options.result_cache_size = 0;
+  Handler handler(log_dir().path(), options);
+  auto target = fmt::format("/log.txt?n={}", state.range(1));
+
+  size_t bytes = 0;
+  size_t writes = 0;
+  for (auto _ : state) {
+    auto result = serve(handler, target);
+    if (!result) {
+      state.SkipWithError("Failed to serve the request");
+      return;
+    }
+    bytes += result->first;
+    writes += result->second;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+  state.counters["writes_per_request"] =
+      benchmark::Counter(writes, benchmark::Counter::kAvgIterations);
+}
+
+// The same filtering request over and over, like a dashboard polling a file,
+// with and without the result cache
+void BM_ServeRepeatedGrep(benchmark::State& state) {
+  HandlerOptions options;
+  options.result_cache_size = state.range(0);
+  Handler handler(log_dir().path(), options);
+  auto target = std::string("/log.txt?n=1000&grep=number%209");
+
+  size_t bytes = 0;
+  for (auto _ : state) {
+    auto result = serve(handler, target);
+    if (!result) {
+      state.SkipWithError("Failed to serve the request");
+      return;
+    }
+    bytes += result->first;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+
+// Lots of requests for the last 10 lines of a file from several threads at
+// once, where opening and mapping the file is a good part of the work. With
+// and without the file cache, and with the result cache, as a server would
+// run.
+void BM_ServeSmallRequests(benchmark::State& state) {
+  static std::unique_ptr<Handler> handler;
+  if (state.thread_index() == 0) {
+    HandlerOptions options;
+    options.file_cache_size = state.range(0);
+    handler = std::make_unique<Handler>(log_dir().path(), options);
+  }
+
+  for (auto _ : state) {
+    if (!serve(*handler, "/log.txt?n=10")) {
+      state.SkipWithError("Failed to serve the request");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    handler.reset();
+  }
+}
+
+// Heap allocations a small request takes once the server is warmed up, which
+// are what's left after the memory pool (see `memory_pool.h`) and the caches.
+// The request is served right on the benchmark thread, so its allocations are
+// the thread's.
+void BM_RequestAllocations(benchmark::State& state) {
+  Handler handler(log_dir().path(), HandlerOptions());
+  auto target = state.range(0) ? std::string("/log.txt?n=10&grep=number%209")
+                               : std::string("/log.txt?n=10");
+  if (!serve(handler, target)) {
+    state.SkipWithError("Failed to serve the request");
+    return;
+  }
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    auto before = thread_allocations();
+    if (!serve(handler, target)) {
+      state.SkipWithError("Failed to serve the request");
+      return;
+    }
+    allocations += thread_allocations() - before;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["allocations_per_request"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+}  // namespace
+
+BENCHMARK(BM_ServeLog)
+    ->ArgNames({"write_buffer_size", "n"})
+    ->ArgsProduct({{0, 64 * 1024, 128 * 1024, 256 * 1024}, {10, 100000}});
+
+BENCHMARK(BM_ServeRepeatedGrep)
+    ->ArgNames({"result_cache_size"})
+    ->Arg(0)
+    ->Arg(64 * 1024 * 1024);
+
+BENCHMARK(BM_ServeSmallRequests)
+    ->ArgNames({"file_cache_size"})
+    ->Arg(0)
+    ->Arg(1024)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK(BM_RequestAllocations)->ArgNames({"grep"})->Arg(0)->Arg(1);
@@ -0,0 +1,107 @@
+#include <benchmark/benchmark.h>
+#include <liblogovo/newline_scan.h>
+
+#include <bit>
+#include <string>
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+// A block of lines shaped like the ones `loggen` produces
+std::string make_block(size_t line_length) {
+  std::string result;
+  while (result.size() < BLOCK_SIZE) {
+    result += std::string(line_length - 1, 'x') + '\n';
+  }
+  result.resize(BLOCK_SIZE);
+  return result;
+}
+
+// The loop `tail()` used to run: walk the block backwards one byte at a time
+// looking for the start of each line.
+void BM_BytewiseBackwardLoop(benchmark::State& state) {
+  auto block = make_block(state.range(0));
+  for (auto _ : state) {
+    size_t lines = 0;
+    const char* line_start = block.data() + block.size() - 1;
+    const char* line_end = block.data() + block.size();
+    for (;;) {
+      while (line_start != block.data() &&
+             (*line_start != '\n' || line_start + 1 == line_end)) {
+        line_start--;
+      }
+      if (line_start == block.data()) {
+        break;
+      }
+      ++lines;
+      line_end = line_start + 1;
+      line_start--;
+    }
+    benchmark::DoNotOptimize(lines);
+  }
+  state.SetBytesProcessed(state.iterations() * block.size());
+}
+
+template <auto Implementation>
+void BM_BitmapBackwardWalk(benchmark::State& state) {
+  auto block = make_block(state.range(0));
+  std::vector<uint64_t> words(BLOCK_SIZE / 64);
+  for (auto _ : state) {
+    Implementation(block.data(), block.size(), words.data());
+    // Same walk as NewlineBitmap::find_last_before does, newest line first,
+    // inlined to measure just the given implementation
+    size_t lines = 0;
+    size_t line_end = block.size();
+    size_t line_bytes = 0;
+    for (size_t i = words.size(); i-- > 0;) {
+      for (uint64_t word = words[i]; word != 0;) {
+        size_t bit = 63 - std::countl_zero(word);
+        word &= ~(uint64_t(1) << bit);
+        size_t pos = i * 64 + bit;
+        ++lines;
+        line_bytes += line_end - pos;
+        line_end = pos;
+      }
+    }
+    benchmark::DoNotOptimize(lines);
+    benchmark::DoNotOptimize(line_bytes);
+  }
+  state.SetBytesProcessed(state.iterations() * block.size());
+}
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+void BM_BitmapBackwardWalkAvx2(benchmark::State& state) {
+  if (!cpu_supports_avx2()) {
+    state.SkipWithError("AVX2 is not supported by this CPU");
+    return;
+  }
+  BM_BitmapBackwardWalk<find_newlines_avx2>(state);
+}
+#endif
+
+void BM_NewlineBitmapWalk(benchmark::State& state) {
+  auto block = make_block(state.range(0));
+  NewlineBitmap bitmap(BLOCK_SIZE);
+  state.SetLabel(std::string(find_newlines_implementation()));
+  for (auto _ : state) {
+    bitmap.scan(block);
+    size_t lines = 0;
+    for (auto pos = bitmap.find_last_before(block.size() - 1); pos;
+         pos = bitmap.find_last_before(*pos)) {
+      ++lines;
+    }
+    benchmark::DoNotOptimize(lines);
+  }
+  state.SetBytesProcessed(state.iterations() * block.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_BytewiseBackwardLoop)->Arg(16)->Arg(80)->Arg(1024);
+BENCHMARK(BM_NewlineBitmapWalk)->Arg(16)->Arg(80)->Arg(1024);
+BENCHMARK(BM_BitmapBackwardWalk<find_newlines_scalar>)->Arg(80);
+#if defined(NEWLINE_SCAN_HAS_X86)
+BENCHMARK(BM_BitmapBackwardWalk<find_newlines_sse2>)->Arg(80);
+BENCHMARK(BM_BitmapBackwardWalkAvx2)->Arg(80);
+#endif
@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+#include <liblogovo/mapped_file.h>
+#include <liblogovo/tail.h>
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "bench_utils.h"
+
+namespace {
+
+constexpr size_t TEXT_SIZE = 16 * 1024 * 1024;
+
+// About `TEXT_SIZE` bytes of lines of `line_length` bytes each (newline
+// included)
+std::string make_text(size_t line_length) {
+  std::string text;
+  text.reserve(TEXT_SIZE + line_length);
+  for (size_t i = 0; text.size() < TEXT_SIZE; ++i) {
+    auto line = fmt::format("line {} ", i);
+    line.resize(line_length - 1, 'x');
+    text += line;
+    text += '\n';
+  }
+  return text;
+}
+
+const std::string& default_text() {
+  static const std::string result = make_text(64);
+  return result;
+}
+
+template <typename Input, TailParameters Parameters = TailParameters()>
+void drain(benchmark::State& state, Input& input) {
+  size_t lines = 0;
+  auto all_lines = std::numeric_limits<size_t>::max();
+  for (auto line : tail<Input, Parameters>(input, all_lines)) {
+    benchmark::DoNotOptimize(line);
+    ++lines;
+  }
+  state.counters["lines"] = lines;
+}
+
+// All the lines of the text read through a stringstream, with different
+// block sizes
+template <size_t BLOCK_SIZE>
+void BM_TailBlockSize(benchmark::State& state) {
+  for (auto _ : state) {
+    std::stringstream input(default_text());
+    drain<std::stringstream, TailParameters{BLOCK_SIZE}>(state, input);
+  }
+  state.SetBytesProcessed(state.iterations() * default_text().size());
+}
+
+// All the lines of a mapped file, with different line lengths
+void BM_TailLineLength(benchmark::State& state) {
+  TempLogDir dir({{"lines.txt", make_text(state.range(0))}});
+  auto file = MappedFile::open(dir.path() / "lines.txt");
+  if (!file) {
+    state.SkipWithError("failed to map the file");
+    return;
+  }
+  for (auto _ : state) {
+    drain(state, *file);
+  }
+  state.SetBytesProcessed(state.iterations() * file->size());
+}
+
+// All the lines of the same text read from different sources
+void BM_TailSource(benchmark::State& state) {
+  TempLogDir dir({{"source.txt", default_text()}});
+  auto path = dir.path() / "source.txt";
+  switch (state.range(0)) {
+    case 0:
+      state.SetLabel("stringstream");
+      for (auto _ : state) {
+        std::stringstream input(default_text());
+        drain(state, input);
+      }
+      break;
+    case 1:
+      state.SetLabel("ifstream");
+      for (auto _ : state) {
+        std::ifstream input(path);
+        drain(state, input);
+      }
+      break;
+    case 2:
+      state.SetLabel("mmap");
+      for (auto _ : state) {
+        auto file = MappedFile::open(path);
+        drain(state, *file);
+      }
+      break;
+  }
+  state.SetBytesProcessed(state.iterations() * default_text().size());
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_TailBlockSize, 4 * 1024);
+BENCHMARK_TEMPLATE(BM_TailBlockSize, 16 * 1024);
+BENCHMARK_TEMPLATE(BM_TailBlockSize, 64 * 1024);
+BENCHMARK_TEMPLATE(BM_TailBlockSize, 256 * 1024);
+BENCHMARK_TEMPLATE(BM_TailBlockSize, 1024 * 1024);
+BENCHMARK(BM_TailLineLength)->Arg(16)->Arg(128)->Arg(1024)->Arg(8192);
+BENCHMARK(BM_TailSource)->DenseRange(0, 2);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+
+// Heap allocations the calling thread has made so far, counted by the global
+// `operator new` of the benchmarks (see `allocation_counter.cc`)
+size_t thread_allocations();
+
+// Log lines shaped like the ones `loggen` produces
+inline std::string make_log_text(size_t lines) {
+  std::string text;
+  for (size_t i = 0; i < lines; ++i) {
+    text += fmt::format("I'm line number {} of {}\n", i, lines);
+  }
+  return text;
+}
+
+// Temporary log root directory, removed with everything in it once the
+// benchmark is done with it
+class TempLogDir {
+ public:
+  // Files are given as (name, content) pairs
+  explicit TempLogDir(
+      std::initializer_list<std::pair<std::string, std::string>> files)
+      : path_(std::filesystem::temp_directory_path() /
+              fmt::format("logovo_bench_{}_{}", getpid(), counter_++)) {
+    std::filesystem::create_directories(path_);
+    for (const auto& [name, content] : files) {
+      std::ofstream(path_ / name) << content;
+    }
+  }
+  ~TempLogDir() { std::filesystem::remove_all(path_); }
+
+  TempLogDir(const TempLogDir&) = delete;
+  TempLogDir& operator=(const TempLogDir&) = delete;
+
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  static inline int counter_ = 0;
+  std::filesystem::path path_;
+};
@@ -0,0 +1,292 @@
+#include <fmt/format.h>
+#include <liblogovo/handler.h>
+#include <liblogovo/server.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include "bench_utils.h"
+
+// HTTP load driver: runs a number of clients, each sending requests for the
+// same target one after another over a keep-alive connection (or a new
+// connection for every request), and reports the latency percentiles and the
+// throughput. By default a `Server` is started right here, serving a generated
+// log; `--host` points the driver at a running server instead. With `--scale`,
+// the local server is run with 1, 2, 4, ... threads in turn, to show how
+// throughput scales with cores.
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace po = boost::program_options;
+using tcp = asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct ClientResult {
+  std::vector<double> latencies_ms;
+  size_t bytes = 0;
+  size_t errors = 0;
+};
+
+// With `connection_per_request`, every request is sent over a new connection,
+// which measures how fast connections are accepted as well
+ClientResult run_client(const std::string& host, ushort port,
+    const std::string& target, size_t requests, bool connection_per_request) {
+  ClientResult result;
+  try {
+    asio::io_context ioc;
+    tcp::resolver resolver(ioc);
+    auto endpoints = resolver.resolve(host, std::to_string(port));
+    beast::tcp_stream stream(ioc);
+    stream.connect(endpoints);
+
+    beast::flat_buffer buffer;
+    for (size_t i = 0; i < requests; ++i) {
+      http::request<http::empty_body> req{http::verb::get, target, 11};
+      req.set(http::field::host, host);
+      auto start = Clock::now();
+      if (connection_per_request && i != 0) {
+        beast::error_code ec;
+        stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+        stream.close();
+        stream.connect(endpoints);
+        buffer.clear();
+      }
+      http::write(stream, req);
+      http::response_parser<http::string_body> parser;
+      parser.body_limit(boost::none);
+      http::read(stream, buffer, parser);
+      result.latencies_ms.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+      if (parser.get().result() != http::status::ok) {
+        ++result.errors;
+      }
+      result.bytes += parser.get().body().size();
+    }
+
+    beast::error_code ec;
+    stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+  } catch (const std::exception& e) {
+    spdlog::error("Client failed: {}", e.what());
+    ++result.errors;
+  }
+  return result;
+}
+
+// Waits until the server accepts connections
+bool wait_for_server(const std::string& host, ushort port) {
+  asio::io_context ioc;
+  tcp::resolver resolver(ioc);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    beast::error_code ec;
+    tcp::socket socket(ioc);
+    asio::connect(socket, resolver.resolve(host, std::to_string(port)), ec);
+    if (!ec) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return false;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min(
+      sorted.size() - 1, static_cast<size_t>(sorted.size() * fraction));
+  return sorted[index];
+}
+
+struct LoadResult {
+  // Sorted
+  std::vector<double> latencies_ms;
+  double seconds = 0;
+  size_t bytes = 0;
+  size_t errors = 0;
+};
+
+LoadResult run_load(const std::string& host, ushort port, size_t connections,
+    size_t requests, const std::string& target, bool connection_per_request) {
+  std::vector<ClientResult> results(connections);
+  auto start = Clock::now();
+  {
+    std::vector<std::jthread> clients;
+    for (auto& result : results) {
+      clients.emplace_back([&] {
+        result = run_client(
+            host, port, target, requests, connection_per_request);
+      });
+    }
+  }
+  LoadResult load;
+  load.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  for (const auto& result : results) {
+    load.latencies_ms.insert(load.latencies_ms.end(),
+        result.latencies_ms.begin(), result.latencies_ms.end());
+    load.bytes += result.bytes;
+    load.errors += result.errors;
+  }
+  std::ranges::sort(load.latencies_ms);
+  return load;
+}
+
+// Server started right here, stopped (with SIGINT, like a real one) when
+// destroyed
+class LocalServer {
+ public:
+  LocalServer(const std::filesystem::path& root,
+      const HandlerOptions& handler_options, const std::string& host,
+      ushort port, const ServerOptions& server_options)
+      : handler_(root, handler_options),
+        server_(handler_, host, port, server_options),
+        thread_([this] { server_.serve(); }) {}
+  ~LocalServer() {
+    std::raise(SIGINT);
+    thread_.join();
+  }
+
+ private:
+  Handler handler_;
+  Server server_;
+  std::thread thread_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string host;
+  ushort port;
+  size_t connections;
+  size_t requests;
+  std::string target;
+  size_t lines;
+  bool connection_per_request;
+  bool scale;
+  HandlerOptions handler_options;
+  ServerOptions server_options;
+
+  po::options_description desc("Allowed options");
+  // clang-format off
+  desc.add_options()
+    ("help", "produce help message")
+    ("host", po::value<std::string>(&host),
+      "host of a running server to load, a server is started here if not set")
+    ("port", po::value<ushort>(&port)->default_value(18080),
+      "network port of the server")
+    ("connections", po::value<size_t>(&connections)->default_value(8),
+      "number of concurrent clients")
+    ("requests", po::value<size_t>(&requests)->default_value(100),
+      "number of requests each client sends")
+    ("target",
+      po::value<std::string>(&target)->default_value("/log.txt?n=1000"),
+      "request target")
+    ("connection-per-request",
+      po::bool_switch(&connection_per_request)->default_value(false),
+      "send every request over a new connection")
+    ("lines", po::value<size_t>(&lines)->default_value(1000000),
+      "lines in the log generated for the server started here")
+    ("write-buffer-size",
+      po::value<size_t>(&handler_options.write_buffer_size)
+        ->default_value(handler_options.write_buffer_size),
+      "write buffer size of the server started here")
+    ("file-cache-size",
+      po::value<size_t>(&handler_options.file_cache_size)
+        ->default_value(handler_options.file_cache_size),
+      "log files the server started here keeps open, 0 disables its file "
+      "cache")
+    ("server-threads",
+      po::value<size_t>(&server_options.threads)
+        ->default_value(server_options.threads),
+      "threads of the server started here, 0 means one per CPU")
+    ("per-core",
+      po::bool_switch(&server_options.per_core)->default_value(false),
+      "run the server started here with an io_context per core")
+    ("scale", po::bool_switch(&scale)->default_value(false),
+      "load the server started here with 1, 2, 4, ... up to --server-threads "
+      "threads in turn");
+  // clang-format on
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  if (vm.count("help")) {
+    std::cout << desc << "\n";
+    return 1;
+  }
+  if (scale && !host.empty()) {
+    std::cerr << "--scale needs the server to be started here\n";
+    return 1;
+  }
+  // Logging every request would be measured along with the rest
+  spdlog::set_level(spdlog::level::warn);
+
+  std::optional<TempLogDir> log_dir;
+  if (host.empty()) {
+    host = "127.0.0.1";
+    log_dir.emplace(std::initializer_list<std::pair<std::string, std::string>>{
+        {"log.txt", make_log_text(lines)}});
+  }
+
+  std::vector<size_t> thread_counts{server_options.threads};
+  if (scale) {
+    size_t max_threads = server_options.threads != 0
+                             ? server_options.threads
+                             : std::thread::hardware_concurrency();
+    thread_counts.clear();
+    for (size_t threads = 1; threads < max_threads; threads *= 2) {
+      thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+  }
+
+  size_t errors = 0;
+  for (size_t threads : thread_counts) {
+    std::optional<LocalServer> server;
+    if (log_dir) {
+      server_options.threads = threads;
+      server.emplace(
+          log_dir->path(), handler_options, host, port, server_options);
+    }
+    if (!wait_for_server(host, port)) {
+      spdlog::error("Server at {}:{} doesn't accept connections", host, port);
+      return 1;
+    }
+
+    auto load = run_load(
+        host, port, connections, requests, target, connection_per_request);
+    server.reset();
+
+    if (scale) {
+      fmt::print("{} server threads:\n", threads);
+    }
+    const auto& latencies = load.latencies_ms;
+    fmt::print("{} requests over {} connections in {:.2f} s\n",
+        latencies.size(), connections, load.seconds);
+    fmt::print("throughput: {:.1f} requests/s, {:.1f} MB/s\n",
+        latencies.size() / load.seconds, load.bytes / load.seconds / 1e6);
+    fmt::print("latency: p50 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms\n",
+        percentile(latencies, 0.5), percentile(latencies, 0.99),
+        latencies.empty() ? 0 : latencies.back());
+    fmt::print("errors: {}\n", load.errors);
+    errors += load.errors;
+  }
+  return errors == 0 ? 0 : 1;
+}
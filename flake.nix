@@ -14,8 +14,8 @@
       logovo = stdenv.mkDerivation {
         name = "logovo";
         src = ./.;
-        nativeBuildInputs = with pkgs; [ cmake ];
-        buildInputs = with pkgs; [ boost186 spdlog gtest ];
+        nativeBuildInputs = with pkgs; [ cmake pkg-config ];
+        buildInputs = with pkgs; [ boost186 spdlog gtest gbenchmark zlib zstd re2 ];
       };
     in
     rec {
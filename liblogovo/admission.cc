@@ -0,0 +1,80 @@
+#include "admission.h"
+
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include "metrics.h"
+
+namespace asio = boost::asio;
+
+// A scan in the queue. The timer goes off once `max_wait` is over, or is
+// cancelled early once the scan gets a slot.
+struct Admission::Waiter {
+  explicit Waiter(asio::any_io_executor executor) : timer(executor) {}
+
+  asio::steady_timer timer;
+  // Set (under the mutex) once a slot is handed over to this waiter
+  bool admitted = false;
+};
+
+Admission::Admission(size_t max_running, size_t max_queued,
+    std::chrono::steady_clock::duration max_wait)
+    : max_running_(max_running), max_queued_(max_queued), max_wait_(max_wait) {}
+
+Admission::Ticket::~Ticket() {
+  if (admission_) {
+    admission_->release();
+  }
+}
+
+asio::awaitable<std::optional<Admission::Ticket>> Admission::acquire(
+    Rejection* rejection) {
+  auto waiter =
+      std::make_shared<Waiter>(co_await asio::this_coro::executor);
+  {
+    std::lock_guard lock(mutex_);
+    if (running_ < max_running_ && queue_.empty()) {
+      ++running_;
+      co_return Ticket(this);
+    }
+    if (queue_.size() >= max_queued_) {
+      *rejection = Rejection::QUEUE_FULL;
+      co_return std::nullopt;
+    }
+    waiter->timer.expires_after(max_wait_);
+    queue_.push_back(waiter);
+  }
+
+  auto wait_start = std::chrono::steady_clock::now();
+  boost::system::error_code ec;
+  co_await waiter->timer.async_wait(
+      asio::redirect_error(asio::use_awaitable, ec));
+  metrics().scan_queue_wait.observe(
+      std::chrono::steady_clock::now() - wait_start);
+
+  std::lock_guard lock(mutex_);
+  if (waiter->admitted) {
+    co_return Ticket(this);
+  }
+  queue_.erase(std::find(queue_.begin(), queue_.end(), waiter));
+  *rejection = Rejection::TIMED_OUT;
+  co_return std::nullopt;
+}
+
+void Admission::release() {
+  std::lock_guard lock(mutex_);
+  if (queue_.empty()) {
+    --running_;
+    return;
+  }
+  // The slot goes right to the first waiter, so that scans arriving meanwhile
+  // can't take it first
+  auto waiter = std::move(queue_.front());
+  queue_.pop_front();
+  waiter->admitted = true;
+  asio::post(
+      waiter->timer.get_executor(), [waiter] { waiter->timer.cancel(); });
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+// Caps the amount of scans of log files running at once. Scans over the cap
+// wait in a queue, first come first served, for up to `max_wait`; once
+// `max_queued` of them wait, more are rejected right away.
+//
+// Waiting is asynchronous, so scans in the queue don't hold any threads.
+class Admission {
+ public:
+  Admission(size_t max_running, size_t max_queued,
+      std::chrono::steady_clock::duration max_wait);
+
+  // A slot of a running scan, given back once destroyed
+  class Ticket {
+   public:
+    Ticket(Ticket&& other) : admission_(std::exchange(other.admission_, {})) {}
+    Ticket& operator=(Ticket&& other) {
+      std::swap(admission_, other.admission_);
+      return *this;
+    }
+    ~Ticket();
+
+   private:
+    friend class Admission;
+    explicit Ticket(Admission* admission) : admission_(admission) {}
+
+    Admission* admission_;
+  };
+
+  enum class Rejection {
+    // Too many scans are waiting already
+    QUEUE_FULL,
+    // Waited for `max_wait` without getting a slot
+    TIMED_OUT,
+  };
+
+  // Waits for a slot. Returns nullopt (and tells why in `rejection`) if the
+  // scan is rejected.
+  boost::asio::awaitable<std::optional<Ticket>> acquire(Rejection* rejection);
+
+ private:
+  struct Waiter;
+
+  void release();
+
+  size_t max_running_;
+  size_t max_queued_;
+  std::chrono::steady_clock::duration max_wait_;
+
+  std::mutex mutex_;
+  size_t running_ = 0;
+  std::deque<std::shared_ptr<Waiter>> queue_;
+};
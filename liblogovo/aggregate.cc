@@ -0,0 +1,215 @@
+#include "aggregate.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Start of the bucket of `bucket` length the timestamp falls into
+Timestamp bucket_start(Timestamp timestamp, std::chrono::seconds bucket) {
+  auto since_epoch = timestamp.time_since_epoch();
+  auto buckets = since_epoch / bucket;
+  if (since_epoch < buckets * bucket) {
+    // Timestamps before the epoch round down as well
+    --buckets;
+  }
+  return Timestamp(buckets * bucket);
+}
+
+void append_json_string(std::string& out, std::string_view value) {
+  auto it = std::back_inserter(out);
+  out += '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fmt::format_to(it, "\\u{:04x}", static_cast<unsigned>(c));
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// "YYYY-MM-DDTHH:MM:SS", the way timestamps are given in requests
+void append_timestamp(std::string& out, Timestamp timestamp) {
+  auto seconds = std::chrono::floor<std::chrono::seconds>(timestamp);
+  auto days = std::chrono::floor<std::chrono::days>(seconds);
+  std::chrono::year_month_day date(days);
+  std::chrono::hh_mm_ss time(seconds - days);
+  fmt::format_to(std::back_inserter(out),
+      "\"{:04}-{:02}-{:02}T{:02}:{:02}:{:02}\"", static_cast<int>(date.year()),
+      static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+      time.hours().count(), time.minutes().count(), time.seconds().count());
+}
+
+}  // namespace
+
+std::optional<std::chrono::seconds> parse_bucket(std::string_view value) {
+  int64_t amount;
+  const char* end = value.data() + value.size();
+  auto [unit, error] = std::from_chars(value.data(), end, amount);
+  if (error != std::errc() || amount <= 0 || end - unit > 1) {
+    return std::nullopt;
+  }
+  int64_t unit_seconds = 1;
+  if (unit != end) {
+    switch (*unit) {
+      case 's':
+        break;
+      case 'm':
+        unit_seconds = 60;
+        break;
+      case 'h':
+        unit_seconds = 60 * 60;
+        break;
+      case 'd':
+        unit_seconds = 24 * 60 * 60;
+        break;
+      default:
+        return std::nullopt;
+    }
+  }
+  // Way longer than any log, and short enough to count in nanoseconds
+  constexpr int64_t MAX_SECONDS = 100ll * 365 * 24 * 60 * 60;
+  if (amount > MAX_SECONDS / unit_seconds) {
+    return std::nullopt;
+  }
+  return std::chrono::seconds(amount * unit_seconds);
+}
+
+std::optional<std::string_view> field_value(
+    std::string_view line, std::string_view field) {
+  size_t index = 0;
+  auto [index_end, error] =
+      std::from_chars(field.data(), field.data() + field.size(), index);
+  bool numbered = error == std::errc() &&
+                  index_end == field.data() + field.size() && index > 0;
+
+  size_t position = 0;
+  for (size_t word_number = 1;; ++word_number) {
+    while (position < line.size() && is_space(line[position])) {
+      ++position;
+    }
+    if (position == line.size()) {
+      return std::nullopt;
+    }
+    size_t word_end = position;
+    while (word_end < line.size() && !is_space(line[word_end])) {
+      ++word_end;
+    }
+    auto word = line.substr(position, word_end - position);
+    if (numbered) {
+      if (word_number == index) {
+        return word;
+      }
+    } else if (word.size() > field.size() && word.starts_with(field) &&
+               word[field.size()] == '=') {
+      return word.substr(field.size() + 1);
+    }
+    position = word_end;
+  }
+}
+
+Aggregator::Aggregator(AggregationQuery query, const TimestampParser* parser)
+    : query_(std::move(query)), parser_(parser) {}
+
+void Aggregator::add(std::string_view line) {
+  ++count_;
+
+  if (query_.histogram_bucket) {
+    if (auto timestamp = parser_->parse(line)) {
+      auto start = bucket_start(*timestamp, *query_.histogram_bucket);
+      if (last_bucket_ == buckets_.end() || last_bucket_->first != start) {
+        last_bucket_ = buckets_.try_emplace(start, 0).first;
+      }
+      last_bucket_->second += 1 + untimestamped_;
+      untimestamped_ = 0;
+    } else {
+      ++untimestamped_;
+    }
+  }
+
+  if (query_.topk_field) {
+    auto value = field_value(line, *query_.topk_field);
+    if (!value) {
+      ++missing_;
+    } else if (auto it = values_.find(*value); it != values_.end()) {
+      ++it->second;
+    } else if (values_.size() < max_values(query_.k)) {
+      values_.emplace(*value, 1);
+    } else {
+      // Takes as many passes as values added, so it's O(1) per line overall
+      approximate_ = true;
+      for (auto it = values_.begin(); it != values_.end();) {
+        it = --it->second == 0 ? values_.erase(it) : std::next(it);
+      }
+    }
+  }
+}
+
+std::string Aggregator::json() const {
+  std::string result;
+  auto out = std::back_inserter(result);
+  fmt::format_to(out, "{{\"count\": {}", count_);
+
+  if (query_.histogram_bucket) {
+    fmt::format_to(out, ", \"bucket_seconds\": {}, \"histogram\": [",
+        query_.histogram_bucket->count());
+    bool first = true;
+    for (const auto& [start, count] : buckets_) {
+      result += first ? "" : ", ";
+      first = false;
+      result += "{\"start\": ";
+      append_timestamp(result, start);
+      fmt::format_to(out, ", \"count\": {}}}", count);
+    }
+    // Lines at the start of the range that have no timestamp line before
+    // them to go with
+    fmt::format_to(out, "], \"untimestamped\": {}", untimestamped_);
+  }
+
+  if (query_.topk_field) {
+    std::vector<const std::pair<const std::string, size_t>*> top;
+    top.reserve(values_.size());
+    for (const auto& value : values_) {
+      top.push_back(&value);
+    }
+    // Ties go in the order of values, so that results don't depend on hashing
+    auto more_common = [](auto* a, auto* b) {
+      return a->second != b->second ? a->second > b->second
+                                    : a->first < b->first;
+    };
+    size_t k = std::min(query_.k, top.size());
+    std::partial_sort(top.begin(), top.begin() + k, top.end(), more_common);
+    result += ", \"field\": ";
+    append_json_string(result, *query_.topk_field);
+    result += ", \"top\": [";
+    for (size_t i = 0; i < k; ++i) {
+      result += i == 0 ? "{\"value\": " : ", {\"value\": ";
+      append_json_string(result, top[i]->first);
+      fmt::format_to(out, ", \"count\": {}}}", top[i]->second);
+    }
+    fmt::format_to(out, "], \"missing\": {}", missing_);
+    if (approximate_) {
+      result += ", \"approximate\": true";
+    }
+  }
+
+  if (truncated_) {
+    result += ", \"truncated\": ";
+    append_json_string(result, truncated_);
+  }
+
+  result += '}';
+  return result;
+}
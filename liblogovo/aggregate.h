@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "timestamp.h"
+
+// What to summarize the lines of a request into, instead of sending them. The
+// amount of lines is always counted.
+struct AggregationQuery {
+  // Length of the time buckets to count lines in, by their timestamps
+  std::optional<std::chrono::seconds> histogram_bucket;
+  // Field to count the most common values of (see `field_value`), and how many
+  // of them to report
+  std::optional<std::string> topk_field;
+  size_t k = 10;
+};
+
+// Parses a histogram bucket length: a positive number followed by `s`, `m`,
+// `h` or `d` (seconds if there is no unit)
+std::optional<std::chrono::seconds> parse_bucket(std::string_view value);
+
+// Value of a field of a line: for a number N, the N-th (from 1)
+// whitespace-separated word of the line, otherwise the value of a
+// `<field>=<value>` word. Returns nullopt if the line doesn't have it.
+std::optional<std::string_view> field_value(
+    std::string_view line, std::string_view field);
+
+// Accumulates lines (newest first, as `tail()` yields them) into the summary
+// asked for by an `AggregationQuery`. Counting a line only takes a lookup
+// unless it starts a new bucket or has a value not seen yet, so lines are
+// never copied.
+//
+// Values of a field are counted in at most `max_values(k)` counters, however
+// many distinct values there are (Misra-Gries): once they are all taken, a
+// value not counted yet takes one off every counter instead, and the counters
+// that get to zero are freed. Any value with more than `count / max_values`
+// occurrences keeps its counter, but counts may come out lower than they are,
+// so such summaries are marked as approximate.
+class Aggregator {
+ public:
+  static size_t max_values(size_t k) { return std::max<size_t>(10 * k, 100); }
+
+  // `parser` is only needed for histograms, and must outlive the aggregator
+  Aggregator(AggregationQuery query, const TimestampParser* parser);
+
+  void add(std::string_view line);
+
+  // Marks the summary as covering only part of the lines, because the scan
+  // ran out of its budget (`reason` being what ran out)
+  void set_truncated(const char* reason) { truncated_ = reason; }
+
+  // Summary of the lines added so far, as a JSON object like
+  // {"count": 3, "bucket_seconds": 60, "histogram": [{"start":
+  // "2024-05-01T14:02:00", "count": 2}, ...], "untimestamped": 1, "field":
+  // "method", "top": [{"value": "GET", "count": 2}, ...], "missing": 0}.
+  // Histogram buckets go oldest first, top values most common first. Top
+  // values that ran out of counters also have "approximate": true, truncated
+  // summaries have "truncated": "<reason>".
+  std::string json() const;
+
+ private:
+  // Hashes of std::string that can be looked up by std::string_view
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view value) const {
+      return std::hash<std::string_view>{}(value);
+    }
+  };
+
+  AggregationQuery query_;
+  const TimestampParser* parser_;
+  size_t count_ = 0;
+  const char* truncated_ = nullptr;
+
+  std::map<Timestamp, size_t> buckets_;
+  // Bucket the previous timestamped line went into. Lines are mostly in
+  // order, so it's the one most lines go into as well.
+  std::map<Timestamp, size_t>::iterator last_bucket_ = buckets_.end();
+  // Lines without a timestamp seen since the last one that had it. They go
+  // with the timestamped line before them in the file, which comes next.
+  size_t untimestamped_ = 0;
+
+  std::unordered_map<std::string, size_t, StringHash, std::equal_to<>>
+      values_;
+  // Whether the counters ever ran out, see above
+  bool approximate_ = false;
+  // Lines that don't have the field
+  size_t missing_ = 0;
+};
@@ -0,0 +1,107 @@
+#include "aho_corasick.h"
+
+#include <deque>
+
+namespace {
+
+unsigned char fold(unsigned char symbol, bool ignore_case) {
+  return ignore_case && symbol >= 'A' && symbol <= 'Z' ? symbol - 'A' + 'a'
+                                                       : symbol;
+}
+
+}  // namespace
+
+AhoCorasick::AhoCorasick(
+    const std::vector<std::string>& patterns, bool ignore_case) {
+  // Symbols that aren't in any of the patterns all share class 0
+  std::array<uint16_t, 256> folded_classes{};
+  for (const auto& pattern : patterns) {
+    for (unsigned char symbol : pattern) {
+      auto& symbol_class = folded_classes[fold(symbol, ignore_case)];
+      if (symbol_class == 0) {
+        symbol_class = class_count_++;
+      }
+    }
+  }
+  for (size_t symbol = 0; symbol < 256; ++symbol) {
+    classes_[symbol] = folded_classes[fold(symbol, ignore_case)];
+  }
+
+  // Trie of the reversed patterns, a zero transition means there is no child
+  // yet (the root is never anybody's child)
+  transitions_.assign(class_count_, 0);
+  matches_.assign(1, false);
+  for (const auto& pattern : patterns) {
+    if (pattern.empty()) {
+      matches_empty_ = true;
+      continue;
+    }
+    uint32_t state = 0;
+    for (auto it = pattern.rbegin(); it != pattern.rend(); ++it) {
+      size_t index =
+          state * class_count_ + classes_[static_cast<unsigned char>(*it)];
+      if (transitions_[index] == 0) {
+        transitions_[index] = matches_.size();
+        transitions_.resize(transitions_.size() + class_count_, 0);
+        matches_.push_back(false);
+      }
+      state = transitions_[index];
+    }
+    matches_[state] = true;
+  }
+
+  for (size_t symbol = 0; symbol < 256; ++symbol) {
+    starts_[symbol] = transitions_[classes_[symbol]] != 0;
+  }
+
+  // Breadth-first, so that the failure link of a state (the longest proper
+  // suffix of it that is in the trie) is complete by the time it's needed.
+  // Missing transitions are filled with the ones of the failure link.
+  std::vector<uint32_t> failure(matches_.size(), 0);
+  std::deque<uint32_t> queue{0};
+  while (!queue.empty()) {
+    auto state = queue.front();
+    queue.pop_front();
+    for (size_t symbol_class = 0; symbol_class < class_count_;
+         ++symbol_class) {
+      auto& next = transitions_[state * class_count_ + symbol_class];
+      auto fallback =
+          state == 0
+              ? 0
+              : transitions_[failure[state] * class_count_ + symbol_class];
+      if (next == 0) {
+        next = fallback;
+        continue;
+      }
+      failure[next] = fallback;
+      if (matches_[fallback]) {
+        matches_[next] = true;
+      }
+      queue.push_back(next);
+    }
+  }
+}
+
+std::optional<size_t> AhoCorasick::find_last(std::string_view text) const {
+  if (matches_empty_) {
+    return text.size();
+  }
+  uint32_t state = 0;
+  for (size_t i = text.size(); i-- > 0;) {
+    if (state == 0) {
+      // Most of the text doesn't even start a match, that part is skipped with
+      // a single lookup per byte
+      while (!starts_[static_cast<unsigned char>(text[i])]) {
+        if (i-- == 0) {
+          return std::nullopt;
+        }
+      }
+    }
+    state = transitions_[state * class_count_ +
+                         classes_[static_cast<unsigned char>(text[i])]];
+    if (matches_[state]) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
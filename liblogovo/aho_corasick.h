@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Search for any of several substrings at once (Aho-Corasick), used by `Grep`
+// for alternatives, case-insensitive substrings and literals required by
+// regular expressions.
+//
+// Like the rest of `tail()`, it looks for the last occurrence, so the
+// automaton is built of the reversed patterns and the text is read backwards:
+// the first match found is the one closest to the end of the text, and the
+// search takes a single pass over the part of the text after it. Transitions
+// are a dense table over classes of bytes that the patterns tell apart, so
+// every byte of the text is a couple of lookups.
+class AhoCorasick {
+ public:
+  // With `ignore_case`, ASCII letters match regardless of their case
+  AhoCorasick(const std::vector<std::string>& patterns, bool ignore_case);
+
+  // Start of the last occurrence of any of the patterns in `text`, if any
+  std::optional<size_t> find_last(std::string_view text) const;
+
+ private:
+  // Class of every byte of the text, after folding the case (if ignored)
+  std::array<uint16_t, 256> classes_;
+  size_t class_count_ = 1;
+  // `transitions_[state * class_count_ + class]`, state 0 is the root
+  std::vector<uint32_t> transitions_;
+  // Whether a symbol leads anywhere from the root, i.e. the last symbol of
+  // some pattern
+  std::array<bool, 256> starts_{};
+  // Whether reaching a state means that some pattern has been found
+  std::vector<bool> matches_;
+  // Set if one of the patterns is empty, it's found everywhere then
+  bool matches_empty_ = false;
+};
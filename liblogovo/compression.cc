@@ -0,0 +1,219 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+#if defined(LOGOVO_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr size_t MIN_OUTPUT_SPACE = 64 * 1024;
+
+std::string_view trim(std::string_view value) {
+  auto begin = value.find_first_not_of(" \t");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  auto end = value.find_last_not_of(" \t");
+  return value.substr(begin, end + 1 - begin);
+}
+
+bool equals_ignoring_case(std::string_view a, std::string_view b) {
+  return std::ranges::equal(a, b, [](char x, char y) {
+    return std::tolower(static_cast<unsigned char>(x)) ==
+           std::tolower(static_cast<unsigned char>(y));
+  });
+}
+
+// q-value of a single Accept-Encoding element, like "gzip;q=0.5"
+double quality(std::string_view parameters) {
+  auto q = trim(parameters);
+  if (!q.starts_with("q=")) {
+    return 1;
+  }
+  q.remove_prefix(2);
+  double result = 0;
+  auto [end, ec] = std::from_chars(q.data(), q.data() + q.size(), result);
+  if (ec != std::errc()) {
+    return 0;
+  }
+  return std::clamp(result, 0.0, 1.0);
+}
+
+class GzipCompressor : public Compressor {
+ public:
+  explicit GzipCompressor(int level) {
+    // 16 on top of the window bits asks for a gzip header and trailer
+    if (deflateInit2(&stream_, std::clamp(level, 1, 9), Z_DEFLATED, 15 + 16, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("Failed to initialize gzip compression");
+    }
+  }
+  ~GzipCompressor() override { deflateEnd(&stream_); }
+
+  std::string_view compress(std::string_view input, bool last) override {
+    stream_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream_.avail_in = input.size();
+    size_t used = 0;
+    for (;;) {
+      if (output_.size() - used < MIN_OUTPUT_SPACE) {
+        output_.resize(used + std::max(MIN_OUTPUT_SPACE, input.size() / 2));
+      }
+      stream_.next_out = reinterpret_cast<Bytef*>(output_.data() + used);
+      stream_.avail_out = output_.size() - used;
+      int result = deflate(&stream_, last ? Z_FINISH : Z_SYNC_FLUSH);
+      used = output_.size() - stream_.avail_out;
+      if (result == Z_STREAM_ERROR) {
+        throw std::runtime_error("gzip compression failed");
+      }
+      // Running out of output space is the only reason to go on
+      if (last ? result == Z_STREAM_END : stream_.avail_out != 0) {
+        break;
+      }
+    }
+    return {output_.data(), used};
+  }
+
+ private:
+  z_stream stream_{};
+};
+
+#if defined(LOGOVO_HAVE_ZSTD)
+class ZstdCompressor : public Compressor {
+ public:
+  explicit ZstdCompressor(int level) : context_(ZSTD_createCCtx()) {
+    if (!context_ || ZSTD_isError(ZSTD_CCtx_setParameter(
+                         context_, ZSTD_c_compressionLevel, level))) {
+      ZSTD_freeCCtx(context_);
+      throw std::runtime_error("Failed to initialize zstd compression");
+    }
+  }
+  ~ZstdCompressor() override { ZSTD_freeCCtx(context_); }
+
+  std::string_view compress(std::string_view input, bool last) override {
+    ZSTD_inBuffer in{input.data(), input.size(), 0};
+    size_t used = 0;
+    for (;;) {
+      if (output_.size() - used < ZSTD_CStreamOutSize()) {
+        output_.resize(
+            used + std::max(ZSTD_CStreamOutSize(), input.size() / 2));
+      }
+      ZSTD_outBuffer out{output_.data() + used, output_.size() - used, 0};
+      size_t remaining = ZSTD_compressStream2(
+          context_, &out, &in, last ? ZSTD_e_end : ZSTD_e_flush);
+      if (ZSTD_isError(remaining)) {
+        throw std::runtime_error(std::string("zstd compression failed: ") +
+                                 ZSTD_getErrorName(remaining));
+      }
+      used += out.pos;
+      if (remaining == 0) {
+        break;
+      }
+    }
+    return {output_.data(), used};
+  }
+
+ private:
+  ZSTD_CCtx* context_;
+};
+#endif
+
+}  // namespace
+
+std::string_view content_encoding_name(ContentEncoding encoding) {
+  switch (encoding) {
+    case ContentEncoding::GZIP:
+      return "gzip";
+    case ContentEncoding::ZSTD:
+      return "zstd";
+    default:
+      return "identity";
+  }
+}
+
+ContentEncoding choose_content_encoding(std::string_view accept_encoding) {
+  double gzip_quality = 0;
+  double zstd_quality = 0;
+  while (!accept_encoding.empty()) {
+    auto comma = accept_encoding.find(',');
+    auto element = accept_encoding.substr(0, comma);
+    accept_encoding.remove_prefix(
+        comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+    auto semicolon = element.find(';');
+    auto coding = trim(element.substr(0, semicolon));
+    double q = semicolon == std::string_view::npos
+                   ? 1
+                   : quality(element.substr(semicolon + 1));
+    if (equals_ignoring_case(coding, "gzip")) {
+      gzip_quality = q;
+    } else if (equals_ignoring_case(coding, "zstd")) {
+      zstd_quality = q;
+    } else if (coding == "*") {
+      gzip_quality = std::max(gzip_quality, q);
+      zstd_quality = std::max(zstd_quality, q);
+    }
+  }
+#if !defined(LOGOVO_HAVE_ZSTD)
+  zstd_quality = 0;
+#endif
+  if (zstd_quality > 0 && zstd_quality >= gzip_quality) {
+    return ContentEncoding::ZSTD;
+  }
+  if (gzip_quality > 0) {
+    return ContentEncoding::GZIP;
+  }
+  return ContentEncoding::IDENTITY;
+}
+
+std::unique_ptr<Compressor> Compressor::create(
+    ContentEncoding encoding, int level) {
+  switch (encoding) {
+    case ContentEncoding::GZIP:
+      return std::make_unique<GzipCompressor>(level);
+#if defined(LOGOVO_HAVE_ZSTD)
+    case ContentEncoding::ZSTD:
+      return std::make_unique<ZstdCompressor>(level);
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+CompressionBudget::CompressionBudget(double cores)
+    : budget_(std::chrono::nanoseconds(static_cast<int64_t>(cores * 1e9))),
+      window_start_(std::chrono::steady_clock::now()) {}
+
+bool CompressionBudget::available() {
+  std::lock_guard lock(mutex_);
+  advance();
+  return spent_current_ < budget_ && spent_previous_ < budget_;
+}
+
+void CompressionBudget::spend(std::chrono::nanoseconds duration) {
+  std::lock_guard lock(mutex_);
+  advance();
+  spent_current_ += duration;
+}
+
+void CompressionBudget::advance() {
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = now - window_start_;
+  if (elapsed < std::chrono::seconds(1)) {
+    return;
+  }
+  // The previous second is only of interest if it's the one right before
+  spent_previous_ = elapsed < std::chrono::seconds(2)
+                        ? spent_current_
+                        : std::chrono::nanoseconds(0);
+  spent_current_ = std::chrono::nanoseconds(0);
+  window_start_ = now;
+}
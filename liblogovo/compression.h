@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+enum class ContentEncoding { IDENTITY, GZIP, ZSTD };
+
+// Name of the encoding for the Content-Encoding header
+std::string_view content_encoding_name(ContentEncoding encoding);
+
+// Picks the encoding for a response given the Accept-Encoding header of the
+// request: the one with the highest q-value among the supported ones,
+// preferring zstd over gzip when they are equal.
+ContentEncoding choose_content_encoding(std::string_view accept_encoding);
+
+// Streaming compressor for response bodies
+class Compressor {
+ public:
+  // Returns nullptr for the identity encoding, or if it's not supported
+  static std::unique_ptr<Compressor> create(
+      ContentEncoding encoding, int level);
+  virtual ~Compressor() = default;
+
+  // Compresses the next piece of a response. Everything given so far is
+  // flushed to the output, so that it can be sent (and decompressed by the
+  // client) right away, while `last` ends the compressed stream. Returned data
+  // is valid until the next call.
+  virtual std::string_view compress(std::string_view input, bool last) = 0;
+
+ protected:
+  std::vector<char> output_;
+};
+
+// Limit of the CPU time taken by compressing responses, so that compression
+// doesn't starve serving when the server is saturated. Responses that start
+// while the budget is spent are sent as is.
+//
+// The time is accounted per second: the budget is spent if compression took
+// more than `cores` seconds either during the current second or during the
+// previous one.
+class CompressionBudget {
+ public:
+  explicit CompressionBudget(double cores);
+
+  bool available();
+  void spend(std::chrono::nanoseconds duration);
+
+ private:
+  // Moves on to the current second, if needed. Must be called with the mutex
+  // held.
+  void advance();
+
+  std::chrono::nanoseconds budget_;
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point window_start_;
+  std::chrono::nanoseconds spent_current_{0};
+  std::chrono::nanoseconds spent_previous_{0};
+};
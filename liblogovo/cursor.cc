@@ -0,0 +1,132 @@
+#include "cursor.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+
+#include "rotated_logs.h"
+#include "tail.h"
+
+std::string Cursor::to_string() const {
+  return fmt::format(
+      "{:x}-{:x}-{:x}", identity.device, identity.inode, offset);
+}
+
+std::optional<Cursor> Cursor::parse(std::string_view value) {
+  Cursor result;
+  const char* position = value.data();
+  const char* end = value.data() + value.size();
+  uint64_t offset;
+  for (auto* field :
+       {&result.identity.device, &result.identity.inode, &offset}) {
+    if (field != &result.identity.device) {
+      if (position == end || *position != '-') {
+        return std::nullopt;
+      }
+      ++position;
+    }
+    auto [field_end, error] = std::from_chars(position, end, *field, 16);
+    if (error != std::errc()) {
+      return std::nullopt;
+    }
+    position = field_end;
+  }
+  if (position != end) {
+    return std::nullopt;
+  }
+  result.offset = offset;
+  return result;
+}
+
+std::vector<PagedFile> paged_files(const std::filesystem::path& path,
+    const std::optional<Cursor>& before, bool with_generations) {
+  std::vector<PagedFile> result;
+  auto identity = file_identity(path);
+  if (identity) {
+    result.push_back({path, *identity});
+  }
+  if (with_generations) {
+    for (auto& generation : rotated_generations(path)) {
+      if (auto identity = file_identity(generation)) {
+        result.push_back({std::move(generation), *identity});
+      }
+    }
+  }
+
+  if (!before) {
+    if (!identity) {
+      result.clear();
+    }
+    return result;
+  }
+  auto start = std::find_if(result.begin(), result.end(),
+      [&](const PagedFile& file) { return file.identity == before->identity; });
+  result.erase(result.begin(), start);
+  return result;
+}
+
+std::generator<std::string_view> tail_page(std::vector<PagedFile> files,
+    size_t offset, size_t n, std::optional<Grep> grep,
+    DecompressedCache* decompressed_cache, ScanPool* pool,
+    std::optional<Cursor>* next, ScanBudget* budget, MapFile map_file) {
+  if (n == 0) {
+    co_return;
+  }
+  for (const auto& file : files) {
+    bool oldest = &file == &files.back();
+    std::optional<std::filesystem::path> readable_path = file.path;
+    if (is_compressed(file.path)) {
+      readable_path = decompressed_cache
+                          ? decompressed_cache->get(file.path, budget)
+                          : std::nullopt;
+      if (!readable_path && budget && budget->exhausted()) {
+        // Ran out while decompressing it, the next page starts with it
+        *next = Cursor{file.identity, offset};
+        co_return;
+      }
+      if (!readable_path) {
+        spdlog::debug("Skipping compressed {}", file.path.string());
+        continue;
+      }
+    }
+    auto mapped_file = map_file ? map_file(*readable_path)
+                                : MappedFile::open(*readable_path);
+    if (!mapped_file) {
+      spdlog::warn("Failed to map {}, skipping it", readable_path->string());
+      continue;
+    }
+    // Only the first file is read from the middle, the older ones are read
+    // from their very end
+    offset = std::min(offset, mapped_file->size());
+    *next = Cursor{file.identity, offset};
+    for (auto line :
+        tail(*mapped_file, n, grep, {0, offset}, pool, budget)) {
+      if (line.empty()) {
+        // A pause of the budget
+        co_yield line;
+        continue;
+      }
+      *next = Cursor{file.identity,
+          static_cast<size_t>(line.data() - mapped_file->data())};
+      co_yield line;
+      if (--n == 0) {
+        if (oldest && next->value().offset == 0) {
+          // Took the very first line, there is no page after this one
+          next->reset();
+        }
+        co_return;
+      }
+    }
+    if (budget && budget->exhausted()) {
+      if (auto stopped_at = budget->stopped_at()) {
+        *next = Cursor{file.identity, *stopped_at};
+      }
+      co_return;
+    }
+    offset = std::numeric_limits<size_t>::max();
+  }
+  // The history ran out before the page was full
+  next->reset();
+}
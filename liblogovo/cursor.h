@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "grep.h"
+#include "mapped_file.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
+#include "vendor/generator.h"
+
+class DecompressedCache;
+
+// Where a page of older lines starts: the start of the oldest line sent so
+// far, in the file it was read from. The file is told by its identity rather
+// than its path, since by the time the next page is requested it may well
+// have been rotated. Clients get it as an opaque string.
+struct Cursor {
+  FileIdentity identity;
+  size_t offset = 0;
+
+  bool operator==(const Cursor&) const = default;
+
+  std::string to_string() const;
+  // Returns nullopt if the value isn't something `to_string` returns
+  static std::optional<Cursor> parse(std::string_view value);
+};
+
+// A log file or one of its rotated generations. The identity is the one of
+// the file at `path`, even if it's compressed and read from a decompressed
+// copy.
+struct PagedFile {
+  std::filesystem::path path;
+  FileIdentity identity;
+};
+
+// The log file at `path` followed by its rotated generations (if
+// `with_generations`), newest first, starting from the one `before` points
+// into (or the log file itself if `before` is nullopt). Returns an empty
+// vector if that file is gone.
+std::vector<PagedFile> paged_files(const std::filesystem::path& path,
+    const std::optional<Cursor>& before, bool with_generations);
+
+// Up to `n` lines of `files` (as returned by `paged_files`) before `offset` in
+// the first one, newest first, going on with the next files once a file runs
+// out of lines. `*next` is kept at the start of the last line yielded, which
+// is where the next page starts, and reset once there are no older lines left
+// for another page. Compressed generations are skipped unless
+// given a `decompressed_cache`. If the `budget` runs out, the page ends there,
+// and `*next` is where the scan stopped. Files are mapped with `map_file`, or
+// `MappedFile::open` if it's empty.
+std::generator<std::string_view> tail_page(std::vector<PagedFile> files,
+    size_t offset, size_t n, std::optional<Grep> grep,
+    DecompressedCache* decompressed_cache, ScanPool* pool,
+    std::optional<Cursor>* next, ScanBudget* budget = nullptr,
+    MapFile map_file = {});
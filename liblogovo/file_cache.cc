@@ -0,0 +1,63 @@
+#include "file_cache.h"
+
+#include <sys/stat.h>
+
+#include "metrics.h"
+
+FileCache::FileCache(size_t max_files, size_t headroom)
+    : max_files_(max_files), headroom_(headroom) {}
+
+std::optional<MappedFile> FileCache::open(const std::filesystem::path& path) {
+  auto key = path.string();
+  // Unmapped once the lock is released
+  std::list<Item> dropped;
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    // Don't keep a deleted file around
+    std::lock_guard lock(mutex_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      dropped.splice(dropped.end(), items_, it->second);
+      index_.erase(it);
+    }
+    return std::nullopt;
+  }
+
+  auto& m = metrics();
+  {
+    std::lock_guard lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end() && it->second->second.identity() ==
+                                  FileIdentity{st.st_dev, st.st_ino}) {
+      if (auto file = it->second->second.with_size(st.st_size)) {
+        items_.splice(items_.begin(), items_, it->second);
+        m.file_cache_hits.add();
+        return file;
+      }
+    }
+  }
+  m.file_cache_misses.add();
+
+  // Mapped without holding the lock, so that requests for other files don't
+  // wait for it
+  auto file = MappedFile::open(path, headroom_);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::lock_guard lock(mutex_);
+  if (auto it = index_.find(key); it != index_.end()) {
+    dropped.splice(dropped.end(), items_, it->second);
+    index_.erase(it);
+  }
+  items_.emplace_front(key, *file);
+  index_.emplace(std::move(key), items_.begin());
+  while (items_.size() > max_files_) {
+    index_.erase(items_.back().first);
+    dropped.splice(dropped.end(), items_, std::prev(items_.end()));
+  }
+  return file;
+}
+
+size_t FileCache::size() const {
+  std::lock_guard lock(mutex_);
+  return items_.size();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "mapped_file.h"
+
+// Log files mapped by recent requests, so that lots of small requests for the
+// same files don't open, map and unmap them every time. A request only stats
+// the path, and shares the cached mapping if it's still the same file (see
+// `FileIdentity`) and the mapping covers the current size of the file. Files
+// are mapped with `headroom` past their end, so a log that keeps growing is
+// mapped again only once it has grown by that much.
+//
+// Every cached file keeps a file descriptor open, the least recently used
+// ones are closed once there are more than `max_files`. A file that is deleted
+// stays open (and keeps taking its disk space) until its path is requested
+// again or it's evicted.
+//
+// All methods are thread-safe.
+class FileCache {
+ public:
+  static constexpr size_t DEFAULT_HEADROOM = 64 * 1024 * 1024;
+
+  explicit FileCache(size_t max_files, size_t headroom = DEFAULT_HEADROOM);
+
+  // The regular file at `path` as it is now. Returns nullopt if there is no
+  // such file, or it can't be mapped.
+  std::optional<MappedFile> open(const std::filesystem::path& path);
+
+  // Files kept open
+  size_t size() const;
+
+ private:
+  using Item = std::pair<std::string, MappedFile>;
+
+  size_t max_files_;
+  size_t headroom_;
+  mutable std::mutex mutex_;
+  // Most recently used first
+  std::list<Item> items_;
+  std::unordered_map<std::string, std::list<Item>::iterator> index_;
+};
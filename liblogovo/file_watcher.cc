@@ -0,0 +1,274 @@
+#include "file_watcher.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <boost/asio/as_tuple.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace asio = boost::asio;
+
+namespace {
+
+constexpr uint32_t WATCH_MASK = IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF;
+// Appended data is read (and shared with subscribers) in chunks of up to this
+// size
+constexpr size_t READ_CHUNK_SIZE = 1024 * 1024;
+
+// Offset right past the last newline in the file, 0 if there are none
+size_t last_line_end(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return 0;
+  }
+  char block[64 * 1024];
+  for (size_t end = st.st_size; end > 0;) {
+    size_t size = std::min(end, sizeof(block));
+    if (!pread_exactly(fd, block, size, end - size)) {
+      return 0;
+    }
+    auto* newline = static_cast<const char*>(memrchr(block, '\n', size));
+    if (newline != nullptr) {
+      return end - size + (newline - block) + 1;
+    }
+    end -= size;
+  }
+  return 0;
+}
+
+}  // namespace
+
+FileWatcher::Subscription::Subscription(std::shared_ptr<FileWatcher> watcher,
+    int wd, size_t offset, std::shared_ptr<LogChunkChannel> channel)
+    : watcher_(std::move(watcher)),
+      wd_(wd),
+      offset_(offset),
+      channel_(std::move(channel)) {}
+
+FileWatcher::Subscription::~Subscription() {
+  watcher_->unsubscribe(wd_, channel_);
+}
+
+std::shared_ptr<FileWatcher> FileWatcher::create(
+    asio::any_io_executor executor, asio::thread_pool* read_pool) {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    throw boost::system::system_error(
+        errno, boost::system::system_category(), "inotify_init1");
+  }
+  return std::shared_ptr<FileWatcher>(
+      new FileWatcher(executor, read_pool, fd));
+}
+
+FileWatcher::FileWatcher(asio::any_io_executor executor,
+    asio::thread_pool* read_pool, int inotify_fd)
+    : executor_(executor),
+      read_pool_(read_pool),
+      inotify_(executor, inotify_fd) {}
+
+FileWatcher::~FileWatcher() = default;
+
+std::unique_ptr<FileWatcher::Subscription> FileWatcher::subscribe(
+    const std::filesystem::path& path) {
+  std::lock_guard lock(mutex_);
+
+  // Watches are per inode, so following the same file by different paths
+  // still ends up with a single watch.
+  int wd =
+      inotify_add_watch(inotify_.native_handle(), path.c_str(), WATCH_MASK);
+  if (wd < 0) {
+    spdlog::warn("Failed to watch {}: {}", path.string(), strerror(errno));
+    return nullptr;
+  }
+  auto [it, inserted] = watches_.try_emplace(wd);
+  auto& watch = it->second;
+  if (inserted) {
+    auto fd = FileDescriptor(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd) {
+      watches_.erase(it);
+      inotify_rm_watch(inotify_.native_handle(), wd);
+      return nullptr;
+    }
+    watch.offset = last_line_end(fd.get());
+    watch.fd = std::make_shared<const FileDescriptor>(std::move(fd));
+  }
+
+  auto channel =
+      std::make_shared<LogChunkChannel>(executor_, MAX_PENDING_CHUNKS);
+  watch.subscribers.push_back(channel);
+  if (!reading_) {
+    start_reading_events();
+  }
+  return std::unique_ptr<Subscription>(
+      new Subscription(shared_from_this(), wd, watch.offset, channel));
+}
+
+void FileWatcher::unsubscribe(
+    int wd, const std::shared_ptr<LogChunkChannel>& channel) {
+  std::lock_guard lock(mutex_);
+  auto it = watches_.find(wd);
+  if (it == watches_.end()) {
+    return;
+  }
+  auto& subscribers = it->second.subscribers;
+  std::erase(subscribers, channel);
+  if (subscribers.empty()) {
+    // The watch going away wakes `read_events` up with IN_IGNORED, so that it
+    // gets to see there is nothing to watch anymore.
+    remove_watch(wd);
+  }
+}
+
+void FileWatcher::start_reading_events() {
+  reading_ = true;
+  asio::co_spawn(
+      executor_,
+      [self = shared_from_this()]() -> asio::awaitable<void> {
+        co_await self->read_events();
+      },
+      asio::detached);
+}
+
+asio::awaitable<void> FileWatcher::read_events() {
+  alignas(inotify_event) char buffer[16 * 1024];
+  for (;;) {
+    auto [ec, size] = co_await inotify_.async_read_some(
+        asio::buffer(buffer), asio::as_tuple(asio::use_awaitable));
+
+    if (ec) {
+      spdlog::error("Failed to read inotify events: {}", ec.message());
+      std::lock_guard lock(mutex_);
+      for (auto& [wd, watch] : watches_) {
+        for (auto& subscriber : watch.subscribers) {
+          subscriber->close();
+        }
+      }
+      reading_ = false;
+      co_return;
+    }
+
+    // A single read covers all the modifications the events are about
+    std::vector<int> read;
+    for (size_t pos = 0; pos < size;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(buffer + pos);
+      pos += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_MODIFY &&
+          std::ranges::find(read, event->wd) == read.end()) {
+        read.push_back(event->wd);
+        if (read_pool_) {
+          co_await asio::co_spawn(
+              read_pool_->get_executor(),
+              [&]() -> asio::awaitable<void> {
+                read_appended(event->wd);
+                co_return;
+              },
+              asio::use_awaitable);
+        } else {
+          read_appended(event->wd);
+        }
+      }
+
+      std::lock_guard lock(mutex_);
+      auto it = watches_.find(event->wd);
+      if (it == watches_.end()) {
+        continue;
+      }
+      if (it->second.subscribers.empty() ||
+          event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+        remove_watch(event->wd);
+      }
+    }
+
+    std::lock_guard lock(mutex_);
+    if (watches_.empty()) {
+      reading_ = false;
+      co_return;
+    }
+  }
+}
+
+void FileWatcher::read_appended(int wd) {
+  // Only `read_events` moves the offset, so it's this one for the whole read
+  std::shared_ptr<const FileDescriptor> fd;
+  size_t offset;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = watches_.find(wd);
+    if (it == watches_.end()) {
+      return;
+    }
+    fd = it->second.fd;
+    offset = it->second.offset;
+  }
+
+  struct stat st;
+  if (fstat(fd->get(), &st) != 0) {
+    return;
+  }
+  size_t size = st.st_size;
+  if (size < offset) {
+    spdlog::info("Followed file was truncated, following it from the start");
+    offset = 0;
+    std::lock_guard lock(mutex_);
+    auto it = watches_.find(wd);
+    if (it != watches_.end() && it->second.fd == fd) {
+      it->second.offset = 0;
+    }
+  }
+
+  while (offset < size) {
+    std::string data(std::min(size - offset, READ_CHUNK_SIZE), '\0');
+    if (!pread_exactly(fd->get(), data.data(), data.size(), offset)) {
+      return;
+    }
+    auto last_newline = data.rfind('\n');
+    if (last_newline != std::string::npos) {
+      data.resize(last_newline + 1);
+    } else if (data.size() < READ_CHUNK_SIZE) {
+      // The last line isn't complete yet, it'll be sent once it is
+      return;
+    }
+    // Otherwise it's a single line longer than a chunk, which is passed on in
+    // pieces.
+    offset += data.size();
+
+    auto chunk = std::make_shared<const std::string>(std::move(data));
+    std::lock_guard lock(mutex_);
+    auto it = watches_.find(wd);
+    if (it == watches_.end() || it->second.fd != fd) {
+      // Nobody follows the file anymore
+      return;
+    }
+    // Subscribers that came along during the read start where it did, so
+    // they get the chunk as well
+    auto& watch = it->second;
+    watch.offset = offset;
+    std::erase_if(watch.subscribers, [&](const auto& subscriber) {
+      if (subscriber->try_send(boost::system::error_code{}, chunk)) {
+        return false;
+      }
+      // Too far behind (or gone already)
+      subscriber->close();
+      return true;
+    });
+  }
+}
+
+void FileWatcher::remove_watch(int wd) {
+  auto it = watches_.find(wd);
+  if (it == watches_.end()) {
+    return;
+  }
+  for (auto& subscriber : it->second.subscribers) {
+    subscriber->close();
+  }
+  inotify_rm_watch(inotify_.native_handle(), wd);
+  watches_.erase(it);
+}
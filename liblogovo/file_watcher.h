@@ -0,0 +1,102 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/experimental/concurrent_channel.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "posix_file.h"
+
+// Complete lines appended to a followed file, shared by all of its followers
+using LogChunk = std::shared_ptr<const std::string>;
+using LogChunkChannel = boost::asio::experimental::concurrent_channel<void(
+    boost::system::error_code, LogChunk)>;
+
+// Watches files for appended lines with inotify and hands them over to
+// subscribers.
+//
+// However many subscribers a file has, it is watched once and every appended
+// piece of it is read once: subscribers share the resulting chunks. Chunks
+// only ever contain complete lines, a line that is still being written is
+// picked up once its newline shows up.
+//
+// Subscribers that don't keep up (have more than `MAX_PENDING_CHUNKS` chunks
+// waiting) are dropped by closing their channel, the same happens once the
+// file is deleted or moved away. A truncated file is followed from its new
+// beginning.
+//
+// Appended pieces are read on the read pool if there is one, like the other
+// reads of log files, and never while holding the lock subscribing takes.
+class FileWatcher : public std::enable_shared_from_this<FileWatcher> {
+ public:
+  static constexpr size_t MAX_PENDING_CHUNKS = 256;
+
+  // Subscription to the lines appended to a single file. Unsubscribes once
+  // destroyed.
+  class Subscription {
+   public:
+    ~Subscription();
+
+    // File offset right past the last complete line as of subscribing.
+    // Everything after it is delivered through `chunks`.
+    size_t offset() const { return offset_; }
+    LogChunkChannel& chunks() { return *channel_; }
+
+   private:
+    friend class FileWatcher;
+    Subscription(std::shared_ptr<FileWatcher> watcher, int wd, size_t offset,
+        std::shared_ptr<LogChunkChannel> channel);
+
+    std::shared_ptr<FileWatcher> watcher_;
+    int wd_;
+    size_t offset_;
+    std::shared_ptr<LogChunkChannel> channel_;
+  };
+
+  // Creates a watcher that reads inotify events on the given executor, and
+  // the appended lines on `read_pool` (unless it's nullptr). Throws if inotify
+  // isn't available.
+  static std::shared_ptr<FileWatcher> create(
+      boost::asio::any_io_executor executor,
+      boost::asio::thread_pool* read_pool = nullptr);
+  ~FileWatcher();
+
+  // Returns nullptr if the file can't be watched
+  std::unique_ptr<Subscription> subscribe(const std::filesystem::path& path);
+
+ private:
+  // A file being watched (under a given inotify watch descriptor)
+  struct Watch {
+    // The file is kept open to read appended lines from it, for as long as a
+    // read is going on even if the watch goes away meanwhile
+    std::shared_ptr<const FileDescriptor> fd;
+    // Right past the last complete line read so far
+    size_t offset = 0;
+    std::vector<std::shared_ptr<LogChunkChannel>> subscribers;
+  };
+
+  FileWatcher(boost::asio::any_io_executor executor,
+      boost::asio::thread_pool* read_pool, int inotify_fd);
+
+  void unsubscribe(int wd, const std::shared_ptr<LogChunkChannel>& channel);
+  void start_reading_events();
+  boost::asio::awaitable<void> read_events();
+  void read_appended(int wd);
+  void remove_watch(int wd);
+
+  boost::asio::any_io_executor executor_;
+  boost::asio::thread_pool* read_pool_;
+  boost::asio::posix::stream_descriptor inotify_;
+
+  std::mutex mutex_;
+  // Whether `read_events` is running. It only runs while there are watches.
+  bool reading_ = false;
+  std::unordered_map<int, Watch> watches_;
+};
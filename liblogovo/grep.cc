@@ -0,0 +1,419 @@
+#include "grep.h"
+
+#include <re2/filtered_re2.h>
+#include <re2/re2.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <variant>
+
+#include "aho_corasick.h"
+#include "newline_scan.h"
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Checks candidate starts in `mask` (bit `i` is position `base + i`) from the
+// highest one down, given that the first and the last symbols already match.
+std::optional<size_t> verify_candidates(uint32_t mask, size_t base,
+    std::string_view text, std::string_view pattern) {
+  while (mask != 0) {
+    auto bit = 31 - std::countl_zero(mask);
+    auto candidate = base + bit;
+    if (std::memcmp(text.data() + candidate + 1, pattern.data() + 1,
+            pattern.size() - 2) == 0) {
+      return candidate;
+    }
+    mask &= ~(uint32_t{1} << bit);
+  }
+  return std::nullopt;
+}
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+
+// SIMD filter by the first and the last symbol of the pattern: a group of
+// candidate positions is compared with both of them at once and only the
+// positions where both match are verified. Groups are processed from the end
+// of the text. `remaining` receives the amount of leading positions that were
+// not covered by whole groups and are left for the caller to check.
+
+__attribute__((target("sse2"))) std::optional<size_t> find_last_sse2(
+    std::string_view text, std::string_view pattern, size_t& remaining) {
+  const __m128i first = _mm_set1_epi8(pattern.front());
+  const __m128i last = _mm_set1_epi8(pattern.back());
+  size_t m = pattern.size();
+  // Amount of possible starting positions of the pattern in text
+  size_t positions = text.size() - m + 1;
+  while (positions >= 16) {
+    size_t base = positions - 16;
+    auto first_chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + base));
+    auto last_chunk = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(text.data() + base + m - 1));
+    auto mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first_chunk, first),
+            _mm_cmpeq_epi8(last_chunk, last))));
+    if (auto found = verify_candidates(mask, base, text, pattern)) {
+      return found;
+    }
+    positions = base;
+  }
+  remaining = positions;
+  return std::nullopt;
+}
+
+__attribute__((target("avx2"))) std::optional<size_t> find_last_avx2(
+    std::string_view text, std::string_view pattern, size_t& remaining) {
+  const __m256i first = _mm256_set1_epi8(pattern.front());
+  const __m256i last = _mm256_set1_epi8(pattern.back());
+  size_t m = pattern.size();
+  // Amount of possible starting positions of the pattern in text
+  size_t positions = text.size() - m + 1;
+  while (positions >= 32) {
+    size_t base = positions - 32;
+    auto first_chunk = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(text.data() + base));
+    auto last_chunk = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(text.data() + base + m - 1));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first_chunk, first),
+            _mm256_cmpeq_epi8(last_chunk, last))));
+    if (auto found = verify_candidates(mask, base, text, pattern)) {
+      return found;
+    }
+    positions = base;
+  }
+  remaining = positions;
+  return std::nullopt;
+}
+
+using FilteredImplementation = std::optional<size_t> (*)(
+    std::string_view, std::string_view, size_t&);
+
+FilteredImplementation filtered_implementation() {
+  static const FilteredImplementation result =
+      cpu_supports_avx2() ? find_last_avx2 : find_last_sse2;
+  return result;
+}
+
+#endif
+
+}  // namespace
+
+LiteralSearch::LiteralSearch(std::string pattern)
+    : pattern_(std::move(pattern)) {
+  shift_.fill(pattern_.size());
+  // Going backwards so that the occurrence closest to the pattern start wins
+  for (size_t i = pattern_.size(); i-- > 1;) {
+    shift_[static_cast<unsigned char>(pattern_[i])] = i;
+  }
+}
+
+std::optional<size_t> LiteralSearch::find_last(std::string_view text) const {
+  size_t m = pattern_.size();
+  if (m > text.size()) {
+    return std::nullopt;
+  }
+  if (m == 0) {
+    return text.size();
+  }
+  if (m == 1) {
+    // Single symbol patterns are common (think `grep=E`) and libc already has
+    // a vectorized search for those.
+#if defined(__GLIBC__)
+    auto found = static_cast<const char*>(
+        memrchr(text.data(), pattern_.front(), text.size()));
+    if (found == nullptr) {
+      return std::nullopt;
+    }
+    return found - text.data();
+#else
+    auto found = text.rfind(pattern_.front());
+    if (found == std::string_view::npos) {
+      return std::nullopt;
+    }
+    return found;
+#endif
+  }
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+  size_t remaining;
+  if (auto found = filtered_implementation()(text, pattern_, remaining)) {
+    return found;
+  }
+  // Whatever is left at the start of the text is shorter than a SIMD register
+  // and is handled below.
+  text = text.substr(0, remaining + m - 1);
+#endif
+  return find_last_horspool(text);
+}
+
+std::optional<size_t> LiteralSearch::find_last_horspool(
+    std::string_view text) const {
+  size_t m = pattern_.size();
+  if (m > text.size()) {
+    return std::nullopt;
+  }
+  // Mirrored Horspool: the pattern is moved from the end of the text towards
+  // its start, and the shift is picked by the symbol under the pattern's first
+  // position.
+  size_t pos = text.size() - m;
+  for (;;) {
+    if (std::memcmp(text.data() + pos, pattern_.data(), m) == 0) {
+      return pos;
+    }
+    auto shift = shift_[static_cast<unsigned char>(text[pos])];
+    if (pos < shift) {
+      return std::nullopt;
+    }
+    pos -= shift;
+  }
+}
+
+namespace grep_detail {
+
+using Search = std::variant<LiteralSearch, AhoCorasick>;
+
+std::optional<size_t> find_last(const Search& search, std::string_view text) {
+  return std::visit(
+      [&](const auto& search) { return search.find_last(text); }, search);
+}
+
+// Compiled `GrepQuery` with more than a single substring
+struct Matcher {
+  std::vector<Search> all;
+  std::optional<Search> any;
+  std::optional<AhoCorasick> none;
+  std::vector<std::unique_ptr<RE2>> regexes;
+  // Literals required by one of the regexes
+  std::optional<Search> regex_literals;
+  // Search for the substrings one of which every matching line has, if any.
+  // Either one of `all`, or `any`, or `regex_literals`.
+  const Search* prefilter = nullptr;
+
+  // `line` is without its trailing newline
+  bool matches(std::string_view line) const {
+    for (const auto& search : all) {
+      if (!find_last(search, line)) {
+        return false;
+      }
+    }
+    if (any && !find_last(*any, line)) {
+      return false;
+    }
+    if (none && none->find_last(line)) {
+      return false;
+    }
+    for (const auto& regex : regexes) {
+      if (!RE2::PartialMatch(line, *regex)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Literals every match of `regex` has at least one of, or nullopt if there are
+// no such literals (e.g. for `\d+`). They come lowercased, whatever the case of
+// the regex is.
+std::optional<std::vector<std::string>> required_literals(
+    const std::string& regex, const RE2::Options& options) {
+  // Shorter literals would find too many lines to be worth it
+  constexpr int MIN_LITERAL_LENGTH = 3;
+  re2::FilteredRE2 filter(MIN_LITERAL_LENGTH);
+  int id;
+  if (filter.Add(regex, options, &id) != RE2::NoError) {
+    return std::nullopt;
+  }
+  std::vector<std::string> literals;
+  filter.Compile(&literals);
+  // The prefilter of a regex is a combination of ANDs and ORs of literals, so
+  // unless it lets lines without any literals through, at least one of them
+  // is needed.
+  std::vector<int> passing;
+  filter.AllPotentials({}, &passing);
+  if (!passing.empty() || literals.empty()) {
+    return std::nullopt;
+  }
+  return literals;
+}
+
+}  // namespace grep_detail
+
+Grep::Grep(std::string pattern)
+    : query_(std::make_shared<GrepQuery>(GrepQuery{.all = {pattern}})),
+      literal_(std::make_shared<LiteralSearch>(std::move(pattern))) {}
+
+Grep::Grep(GrepQuery query)
+    : query_(std::make_shared<GrepQuery>(std::move(query))) {}
+
+std::optional<Grep> Grep::create(GrepQuery query) {
+  if (query.all.size() == 1 && query.any.empty() && query.none.empty() &&
+      query.regexes.empty() && !query.ignore_case) {
+    return Grep(std::move(query.all.front()));
+  }
+
+  using grep_detail::Search;
+  auto matcher = std::make_shared<grep_detail::Matcher>();
+  bool ignore_case = query.ignore_case;
+  for (const auto& pattern : query.all) {
+    if (ignore_case) {
+      matcher->all.emplace_back(
+          std::in_place_type<AhoCorasick>, std::vector{pattern}, true);
+    } else {
+      matcher->all.emplace_back(std::in_place_type<LiteralSearch>, pattern);
+    }
+  }
+  if (!query.any.empty()) {
+    matcher->any.emplace(
+        std::in_place_type<AhoCorasick>, query.any, ignore_case);
+  }
+  if (!query.none.empty()) {
+    matcher->none.emplace(query.none, ignore_case);
+  }
+  RE2::Options options;
+  options.set_log_errors(false);
+  options.set_case_sensitive(!ignore_case);
+  for (const auto& regex : query.regexes) {
+    matcher->regexes.push_back(std::make_unique<RE2>(regex, options));
+    if (!matcher->regexes.back()->ok()) {
+      return std::nullopt;
+    }
+  }
+
+  // The longest substring is the rarest one, most likely
+  auto longest = std::max_element(query.all.begin(), query.all.end(),
+      [](const auto& a, const auto& b) { return a.size() < b.size(); });
+  if (longest != query.all.end() && !longest->empty()) {
+    matcher->prefilter = &matcher->all[longest - query.all.begin()];
+  } else if (matcher->any &&
+             std::none_of(query.any.begin(), query.any.end(),
+                 [](const auto& pattern) { return pattern.empty(); })) {
+    matcher->prefilter = &*matcher->any;
+  } else {
+    for (const auto& regex : query.regexes) {
+      if (auto literals = grep_detail::required_literals(regex, options)) {
+        matcher->regex_literals.emplace(
+            std::in_place_type<AhoCorasick>, *literals, true);
+        matcher->prefilter = &*matcher->regex_literals;
+        break;
+      }
+    }
+  }
+
+  Grep result(std::move(query));
+  result.matcher_ = std::move(matcher);
+  return result;
+}
+
+bool Grep::matches_all() const {
+  return std::all_of(query_->all.begin(), query_->all.end(),
+             [](const auto& pattern) { return pattern.empty(); }) &&
+         query_->any.empty() && query_->none.empty() && query_->regexes.empty();
+}
+
+bool Grep::can_match_lines() const {
+  auto can_match = [&](const std::string& pattern) {
+    auto newline = pattern.find('\n');
+    return newline == std::string::npos ||
+           (literal_ && newline + 1 == pattern.size());
+  };
+  return std::all_of(query_->all.begin(), query_->all.end(), can_match) &&
+         (query_->any.empty() ||
+             std::any_of(query_->any.begin(), query_->any.end(), can_match));
+}
+
+std::optional<size_t> Grep::find_last(std::string_view text) const {
+  if (literal_) {
+    return literal_->find_last(text);
+  }
+
+  // Lines in [0, end) are yet to be looked at
+  size_t end = text.size();
+  while (end > 0) {
+    size_t line_start;
+    size_t line_end;
+    if (matcher_->prefilter) {
+      auto hit = grep_detail::find_last(
+          *matcher_->prefilter, text.substr(0, end));
+      if (!hit) {
+        return std::nullopt;
+      }
+      auto previous_newline =
+          *hit == 0 ? std::string_view::npos : text.rfind('\n', *hit - 1);
+      line_start =
+          previous_newline == std::string_view::npos ? 0 : previous_newline + 1;
+      line_end = std::min(text.find('\n', *hit), end);
+    } else {
+      // The newline at the very end of the text belongs to the last line
+      auto previous_newline =
+          end < 2 ? std::string_view::npos : text.rfind('\n', end - 2);
+      line_start =
+          previous_newline == std::string_view::npos ? 0 : previous_newline + 1;
+      line_end = text[end - 1] == '\n' ? end - 1 : end;
+    }
+    if (matcher_->matches(text.substr(line_start, line_end - line_start))) {
+      return line_start;
+    }
+    end = line_start;
+  }
+  return std::nullopt;
+}
+
+size_t Grep::longest_substring() const {
+  size_t result = 0;
+  for (const auto* patterns : {&query_->all, &query_->any, &query_->none}) {
+    for (const auto& pattern : *patterns) {
+      result = std::max(result, pattern.size());
+    }
+  }
+  return result;
+}
+
+Grep::Pieces::Pieces(const Grep& grep)
+    : grep_(grep),
+      found_all_(grep.matcher_ ? grep.matcher_->all.size() : 0) {}
+
+void Grep::Pieces::add(std::string_view piece) {
+  if (grep_.literal_) {
+    found_ = found_ || grep_.literal_->find_last(piece);
+    return;
+  }
+
+  // Other filters match lines without their '\n'
+  if (piece.ends_with('\n')) {
+    piece.remove_suffix(1);
+  }
+  const auto& matcher = *grep_.matcher_;
+  if (first_) {
+    first_ = false;
+    for (const auto& regex : matcher.regexes) {
+      failed_ = failed_ || !RE2::PartialMatch(piece, *regex);
+    }
+  }
+  if (matcher.none && matcher.none->find_last(piece)) {
+    failed_ = true;
+  }
+  for (size_t i = 0; i < matcher.all.size(); ++i) {
+    if (!found_all_[i] && grep_detail::find_last(matcher.all[i], piece)) {
+      found_all_[i] = true;
+    }
+  }
+  if (matcher.any && !found_any_) {
+    found_any_ = grep_detail::find_last(*matcher.any, piece).has_value();
+  }
+  found_ = std::ranges::all_of(found_all_, std::identity()) &&
+           (!matcher.any || found_any_);
+}
+
+bool Grep::Pieces::decided() const {
+  // A line with none of `none` so far may still turn out to have one
+  return failed_ || (found_ && (!grep_.matcher_ || !grep_.matcher_->none));
+}
+
+bool Grep::Pieces::matches() const { return found_ && !failed_; }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Search for the last occurrence of a substring in a whole block of lines at
+// once, instead of restarting a substring search for every line.
+//
+// Candidate positions are filtered by the first and the last symbol of the
+// pattern with SIMD where available (the same runtime dispatch as
+// `find_newlines`), falling back to a Boyer-Moore-Horspool search run
+// backwards.
+class LiteralSearch {
+ public:
+  explicit LiteralSearch(std::string pattern);
+
+  const std::string& pattern() const { return pattern_; }
+
+  // Position of the last occurrence of the pattern in `text`, if any
+  std::optional<size_t> find_last(std::string_view text) const;
+
+ private:
+  std::optional<size_t> find_last_horspool(std::string_view text) const;
+
+  std::string pattern_;
+  // For each symbol - how far the pattern can be moved backwards when that
+  // symbol is found under the pattern's first position.
+  std::array<size_t, 256> shift_;
+};
+
+// Filter of a request: a line passes if it has all of `all`, at least one of
+// `any` (unless it's empty), none of `none`, and matches all of `regexes`.
+struct GrepQuery {
+  std::vector<std::string> all;
+  std::vector<std::string> any;
+  std::vector<std::string> none;
+  // In the RE2 syntax
+  std::vector<std::string> regexes;
+  // Whether letters match regardless of their case, in both substrings and
+  // regular expressions
+  bool ignore_case = false;
+
+  bool operator==(const GrepQuery&) const = default;
+
+  bool empty() const {
+    return all.empty() && any.empty() && none.empty() && regexes.empty();
+  }
+};
+
+namespace grep_detail {
+struct Matcher;
+}
+
+// Line filter used by `tail()`, compiled once per request.
+//
+// A single substring (the most common filter by far) is searched for with a
+// `LiteralSearch` over whole blocks. Other filters are compiled into a
+// prefilter and the full filter: the prefilter is a search for substrings one
+// of which any matching line has to have (the longest of `all`, `any` with an
+// `AhoCorasick`, or literals every match of a regular expression has), and
+// only the lines it finds are checked against the full filter. Filters that
+// have no such substrings (like `none` alone) are checked line by line.
+//
+// Copies share the compiled filter, which is immutable, so they can be used
+// from several threads at once.
+class Grep {
+ public:
+  // Filter by a single substring
+  explicit Grep(std::string pattern);
+
+  // Returns nullopt if one of the regular expressions is invalid
+  static std::optional<Grep> create(GrepQuery query);
+
+  const GrepQuery& query() const { return *query_; }
+
+  // Whether every line passes the filter
+  bool matches_all() const;
+
+  // Lines are matched including their trailing '\n' by a single substring, so
+  // it can only ever be found in a line if it has no '\n' other than at its
+  // very end. Other filters match lines without their '\n'.
+  bool can_match_lines() const;
+
+  // The substring of a filter by a single substring, nullptr for other
+  // filters. Unlike other filters, it can be searched for in any part of a
+  // line on its own.
+  const std::string* literal() const {
+    return literal_ ? &literal_->pattern() : nullptr;
+  }
+
+  // Position in the last line of `text` (which must start at a line start)
+  // that passes the filter, if any. For a single substring, that's the
+  // position of its last occurrence.
+  std::optional<size_t> find_last(std::string_view text) const;
+
+  // Length of the longest substring of the filter (of `all`, `any` and
+  // `none`), 0 if it has none
+  size_t longest_substring() const;
+
+  // Filter of a single line too long to be looked at at once, which is given
+  // in pieces instead, in order. Substrings are found anywhere in the line,
+  // as long as the pieces overlap by one symbol less than the substrings are
+  // long. Regular expressions only look at the first piece.
+  class Pieces {
+   public:
+    explicit Pieces(const Grep& grep);
+
+    // The next piece of the line, only the last one may end with its '\n'
+    void add(std::string_view piece);
+    // Whether the rest of the line can't change the outcome anymore
+    bool decided() const;
+    // Whether the line passes the filter, as far as the pieces so far tell
+    bool matches() const;
+
+   private:
+    const Grep& grep_;
+    bool first_ = true;
+    // Has one of `none`, or doesn't match one of the regular expressions
+    bool failed_ = false;
+    // The single substring, or all of `all` and one of `any`
+    bool found_ = false;
+    std::vector<bool> found_all_;
+    bool found_any_ = false;
+  };
+
+ private:
+  explicit Grep(GrepQuery query);
+
+  // Everything is shared by copies, so that copying a filter (which every
+  // request does a few times) doesn't copy the patterns
+  std::shared_ptr<const GrepQuery> query_;
+  // Set for a single substring, which doesn't need anything else
+  std::shared_ptr<const LiteralSearch> literal_;
+  std::shared_ptr<const grep_detail::Matcher> matcher_;
+};
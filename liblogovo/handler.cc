@@ -1,24 +1,104 @@
 #include "handler.h"
 
+#include <fcntl.h>
 #include <spdlog/spdlog.h>
+#include <sys/sendfile.h>
 
+#include <boost/asio/as_tuple.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/url/parse.hpp>
+#include <charconv>
 #include <fstream>
 
+#include "admission.h"
+#include "aggregate.h"
+#include "compression.h"
+#include "cursor.h"
+#include "file_cache.h"
+#include "file_watcher.h"
+#include "line_index.h"
+#include "mapped_file.h"
+#include "memory_pool.h"
+#include "merge.h"
+#include "metrics.h"
+#include "result_cache.h"
+#include "rotated_logs.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
 #include "tail.h"
+#include "time_range.h"
+#include "timestamp.h"
+#include "trigram_index.h"
 #include "vendor/generator.h"
 
+namespace asio = boost::asio;
 namespace beast = boost::beast;
 namespace http = beast::http;
 
+using namespace boost::asio::experimental::awaitable_operators;
+
 // Amount of lines to send if no number was explicitly requested.
 constexpr size_t DEFAULT_N = 10;
 // Maximum amount of lines that can be requested. Exceeding this will result in
 // bad request
 constexpr size_t REQUEST_MAX_N = 1000000;
+// Maximum amount of files a merged request can match, every one of them is
+// kept open for the whole request
+constexpr size_t MERGE_MAX_FILES = 1024;
+// Maximum amount of values an aggregation can report the most common of
+constexpr size_t TOPK_MAX_K = 1000;
+// Regions of a file a filtered request may add to its trigram index (see
+// `TrigramIndex::update`)
+constexpr size_t TRIGRAM_REGIONS_PER_REQUEST = 16;
+// Scans served from the read pool pause this often, so that a long scan takes
+// turns with other requests instead of holding a read thread until it's done
+constexpr auto SCAN_SLICE = std::chrono::milliseconds(10);
 
-Handler::Handler(std::filesystem::path root_dir) : root_dir_(root_dir) {}
+// Duration given in the options in (fractional) seconds
+std::chrono::steady_clock::duration seconds_option(double seconds) {
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(seconds));
+}
+
+Handler::Handler(std::filesystem::path root_dir, HandlerOptions options)
+    : root_dir_(root_dir), options_(options) {
+  if (options_.read_threads > 0) {
+    read_pool_ = std::make_unique<asio::thread_pool>(options_.read_threads);
+  }
+  if (options_.scan_threads > 1) {
+    scan_pool_ = std::make_unique<ScanPool>(options_.scan_threads);
+  }
+  if (options_.decompress_dir) {
+    decompressed_cache_ = std::make_unique<DecompressedCache>(
+        *options_.decompress_dir, options_.decompress_dir_size);
+  }
+  auto timestamp_parser = TimestampParser::create(options_.timestamp_format);
+  if (!timestamp_parser) {
+    throw std::invalid_argument(
+        "Invalid timestamp format: " + options_.timestamp_format);
+  }
+  timestamp_parser_ =
+      std::make_unique<TimestampParser>(std::move(*timestamp_parser));
+  if (options_.max_scans > 0) {
+    admission_ = std::make_unique<Admission>(options_.max_scans,
+        options_.max_queued_scans, seconds_option(options_.scan_queue_timeout));
+  }
+  if (options_.compression_cpu_budget > 0) {
+    compression_budget_ =
+        std::make_unique<CompressionBudget>(options_.compression_cpu_budget);
+  }
+  if (options_.result_cache_size > 0) {
+    result_cache_ = std::make_unique<ResultCache>(options_.result_cache_size);
+  }
+  if (options_.file_cache_size > 0) {
+    file_cache_ = std::make_unique<FileCache>(options_.file_cache_size);
+  }
+}
+
+Handler::~Handler() = default;
 
 auto bad_request(
     http::request<http::string_body>& req, beast::string_view why) {
@@ -54,11 +134,17 @@ auto internal_server_error(
   return res;
 };
 
-boost::beast::http::message_generator Handler::handle_request(
+Response Handler::handle_request(
     boost::beast::http::request<boost::beast::http::string_body>&& req) {
-  spdlog::info("Request: {} {}",
-      std::string(req.method_string().data(), req.method_string().size()),
-      std::string(req.target().data(), req.target().size()));
+  metrics().requests.add();
+  // Logging every request is a cost of its own under load
+  auto request_number = request_count_.fetch_add(1, std::memory_order_relaxed);
+  if (options_.log_requests_every != 0 &&
+      request_number % options_.log_requests_every == 0) {
+    spdlog::info("Request: {} {}",
+        std::string(req.method_string().data(), req.method_string().size()),
+        std::string(req.target().data(), req.target().size()));
+  }
 
   try {
     auto res = handle_request_(std::move(req));
@@ -69,17 +155,61 @@ boost::beast::http::message_generator Handler::handle_request(
   }
 }
 
+asio::awaitable<Response> Handler::async_handle_request(
+    http::request<http::string_body>&& req) {
+  if (!read_pool_) {
+    co_return handle_request(std::move(req));
+  }
+  // Responses can't be default constructed, which `co_spawn` would need to
+  // return them
+  std::optional<Response> response;
+  co_await asio::co_spawn(
+      read_pool_->get_executor(),
+      [&]() -> asio::awaitable<void> {
+        response.emplace(handle_request(std::move(req)));
+        co_return;
+      },
+      asio::use_awaitable);
+  co_return std::move(*response);
+}
+
 // Data required for serving a single log get request. Used as a value_type for
-// LogBody
+// LogBody. Comes from the memory pool, like the rest of what a request needs.
 struct LogStream {
-  // generator holds a reference to the stream, so we store it right in this
-  // structure to ensure it's alive for the whole duration of the request.
+  static void* operator new(size_t size) { return pool_allocate(size); }
+  static void operator delete(void* block, size_t size) {
+    pool_deallocate(block, size);
+  }
+
+  // generator holds a reference to the file (either mapped or opened as a
+  // stream), so we store it right in this structure to ensure it's alive for
+  // the whole duration of the request.
+  std::optional<MappedFile> mapped_file;
   std::ifstream input_stream;
+  // The generator spends it, so it goes before it as well
+  std::unique_ptr<ScanBudget> budget;
+  // Whether the current line of the generator goes on in the next one, for
+  // long lines of files that aren't mapped (see `tail()`)
+  bool fragment = false;
+  // Parts of the file a filter can't match in, by its trigram index
+  std::optional<TrigramSkip> skip;
   std::generator<std::string_view> generator;
+  // See `HandlerOptions::write_buffer_size`
+  size_t write_buffer_size = 0;
+  // Set if the response is compressed, batches of lines are compressed right
+  // before they are sent
+  std::unique_ptr<Compressor> compressor;
+  CompressionBudget* compression_budget = nullptr;
+  // For paged responses, where the next page starts (see `tail_page`)
+  std::optional<Cursor> next_page;
 };
 
 // Boost Beast body writer that fetches data from the LogStream and feeds it to
-// the network without having to save it in some sort of buffer first.
+// the network. Lines are copied into a buffer and sent in batches of
+// `write_buffer_size` bytes, so that a response is a handful of large writes
+// rather than a write per line. Compressed responses are compressed batch by
+// batch. Fragments of long lines need nothing special, they simply go one after
+// another.
 struct LogBodyWriter {
  public:
   using const_buffers_type = beast::net::const_buffer;
@@ -89,32 +219,40 @@ struct LogBodyWriter {
       std::unique_ptr<LogStream>& body)
       : log_stream_(body.get()) {}
 
-  void init(beast::error_code& ec) { ec = {}; }
+  void init(beast::error_code& ec) {
+    buffer_.resize(log_stream_->write_buffer_size);
+    ec = {};
+  }
 
   boost::optional<std::pair<const_buffers_type, bool>> get(
       beast::error_code& ec) {
+    ec = {};
     try {
-      if (!maybe_current_) {
-        maybe_current_ = log_stream_->generator.begin();
-      } else {
-        (*maybe_current_)++;
+      if (!log_stream_->compressor) {
+        auto batch = next_batch();
+        if (!batch) {
+          return boost::none;
+        }
+        return std::make_pair(
+            beast::net::const_buffer(batch->first.data(), batch->first.size()),
+            batch->second);
       }
-      auto& current = *maybe_current_;
 
-      if (current == log_stream_->generator.end()) {
-        ec = {};
+      if (finished_) {
         return boost::none;
       }
-
-      ec = {};
-      auto log_line = *current;
-      // Sending lines one at a time might not be the most efficient thing, so
-      // an obvious way to improve performance is to add buffering here at the
-      // writer.
-      auto result_buffer =
-          beast::net::const_buffer(log_line.data(), log_line.size());
-
-      return std::make_pair(result_buffer, true);
+      // The end of the response still has to end the compressed stream
+      auto batch =
+          next_batch().value_or(std::make_pair(std::string_view(), false));
+      finished_ = !batch.second;
+      auto start = std::chrono::steady_clock::now();
+      auto compressed =
+          log_stream_->compressor->compress(batch.first, finished_);
+      log_stream_->compression_budget->spend(
+          std::chrono::steady_clock::now() - start);
+      return std::make_pair(
+          beast::net::const_buffer(compressed.data(), compressed.size()),
+          !finished_);
     } catch (const std::exception& e) {
       spdlog::error(e.what());
       return boost::none;
@@ -122,13 +260,68 @@ struct LogBodyWriter {
   }
 
  private:
+  // Returns the next batch of lines, and whether there may be more
+  std::optional<std::pair<std::string_view, bool>> next_batch() {
+    size_t buffer_used = 0;
+    for (;;) {
+      // A line that didn't fit into the previous batch is still current, so
+      // it goes first.
+      if (!pending_) {
+        if (!maybe_current_) {
+          maybe_current_ = log_stream_->generator.begin();
+        } else {
+          (*maybe_current_)++;
+        }
+      }
+      pending_ = false;
+      auto& current = *maybe_current_;
+
+      if (current == log_stream_->generator.end()) {
+        if (buffer_used == 0) {
+          return std::nullopt;
+        }
+        return std::make_pair(
+            std::string_view(buffer_.data(), buffer_used), false);
+      }
+
+      auto log_line = *current;
+      if (log_line.empty()) {
+        // A pause of the scan budget: the batch ends here, even if it's empty,
+        // so that the reading thread can go serve someone else meanwhile
+        return std::make_pair(
+            std::string_view(buffer_.data(), buffer_used), true);
+      }
+      if (log_line.size() <= buffer_.size() - buffer_used) {
+        std::copy(
+            log_line.begin(), log_line.end(), buffer_.begin() + buffer_used);
+        buffer_used += log_line.size();
+        continue;
+      }
+      if (buffer_used != 0) {
+        // Send what we have, the line will be picked up by the next batch
+        pending_ = true;
+        return std::make_pair(
+            std::string_view(buffer_.data(), buffer_used), true);
+      }
+      // Lines that don't fit into an empty buffer (which is every line with
+      // the buffering switched off) are sent as is, right from where the
+      // generator keeps them.
+      return std::make_pair(log_line, true);
+    }
+  }
+
   std::optional<std::generator<std::string_view>::iterator> maybe_current_;
+  // Whether the current line of the generator is yet to be sent
+  bool pending_ = false;
+  // Whether the compressed stream has been ended
+  bool finished_ = false;
+  std::vector<char, PoolAllocator<char>> buffer_;
   LogStream* log_stream_;
 };
 
 // Boost Beast body type. We aren't using any of the default body types because
 // we want to stream data from the `tail` generator right as we fetch it instead
-// of saving it to some kind of buffer.
+// of saving the whole response to some kind of buffer.
 struct LogBody {
   using value_type = std::unique_ptr<LogStream>;
   using writer = LogBodyWriter;
@@ -138,9 +331,50 @@ struct LogBody {
 struct LogRequest {
   std::filesystem::path file_path;
   std::optional<size_t> maybe_n;
-  std::optional<std::string> maybe_grep;
+  // Compiled filter of the `grep`, `grep_any`, `grep_not`, `regex` and
+  // `icase` parameters
+  std::optional<Grep> maybe_grep;
+  // One-based numbers of the first and the last line of a range of lines, both
+  // inclusive
+  std::optional<std::pair<size_t, size_t>> maybe_lines;
+  // Whether to keep sending lines as they are appended to the file
+  bool follow = false;
+  // Bounds of the timestamps of lines to serve, both inclusive
+  std::optional<Timestamp> maybe_since;
+  std::optional<Timestamp> maybe_until;
+  // Whether to send a cursor to the next page of lines with the response, and
+  // where this page starts (the end of the file if not given)
+  bool paged = false;
+  std::optional<Cursor> maybe_before;
+  // Wildcard for the files to merge, for merged requests
+  std::optional<std::string> maybe_glob;
+  // Summary to send instead of the lines, from the `count`, `histogram`,
+  // `topk` and `k` parameters
+  std::optional<AggregationQuery> maybe_aggregation;
+  // Whether to send the lines in file order (`order=forward`), as the bytes of
+  // the file they are in
+  bool forward = false;
 };
 
+// Parses a line range in the form of "<first>-<last>"
+std::optional<std::pair<size_t, size_t>> parse_line_range(
+    std::string_view value) {
+  size_t first, last;
+  const char* end = value.data() + value.size();
+  auto [dash, first_error] = std::from_chars(value.data(), end, first);
+  if (first_error != std::errc() || dash == end || *dash != '-') {
+    return std::nullopt;
+  }
+  auto [last_end, last_error] = std::from_chars(dash + 1, end, last);
+  if (last_error != std::errc() || last_end != end) {
+    return std::nullopt;
+  }
+  if (first == 0 || last < first || last - first >= REQUEST_MAX_N) {
+    return std::nullopt;
+  }
+  return std::make_pair(first, last);
+}
+
 // Parses a GET request, validates it and returns LogRequest
 std::optional<LogRequest> parse_log_request(beast::string_view target) {
   auto origin_form = boost::urls::parse_origin_form(target);
@@ -169,57 +403,1100 @@ std::optional<LogRequest> parse_log_request(beast::string_view target) {
     result.maybe_n = static_cast<size_t>(n);
   }
 
-  auto params_grep = origin_form->params().find("grep");
-  if (params_grep != origin_form->params().end()) {
-    result.maybe_grep = (*params_grep).value;
+  // Filter parameters may be repeated
+  GrepQuery query;
+  for (auto param : origin_form->params()) {
+    if (param.key == "grep") {
+      query.all.push_back(param.value);
+    } else if (param.key == "grep_any") {
+      query.any.push_back(param.value);
+    } else if (param.key == "grep_not") {
+      query.none.push_back(param.value);
+    } else if (param.key == "regex") {
+      query.regexes.push_back(param.value);
+    } else if (param.key == "icase") {
+      query.ignore_case = param.value == "1" || param.value == "true";
+    }
+  }
+  if (!query.empty()) {
+    result.maybe_grep = Grep::create(std::move(query));
+    if (!result.maybe_grep) {
+      return std::nullopt;
+    }
+  }
+
+  auto params_follow = origin_form->params().find("follow");
+  if (params_follow != origin_form->params().end()) {
+    auto value = (*params_follow).value;
+    result.follow = value == "1" || value == "true";
+  }
+
+  auto params_lines = origin_form->params().find("lines");
+  if (params_lines != origin_form->params().end()) {
+    result.maybe_lines = parse_line_range((*params_lines).value);
+    if (!result.maybe_lines) {
+      return std::nullopt;
+    }
+  }
+
+  for (auto [name, bound] : {std::pair("since", &result.maybe_since),
+           std::pair("until", &result.maybe_until)}) {
+    auto params_bound = origin_form->params().find(name);
+    if (params_bound != origin_form->params().end()) {
+      *bound = parse_request_timestamp((*params_bound).value);
+      if (!*bound) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  auto params_before = origin_form->params().find("before");
+  if (params_before != origin_form->params().end()) {
+    result.paged = true;
+    // An empty cursor asks for the first page
+    auto value = (*params_before).value;
+    if (!value.empty()) {
+      result.maybe_before = Cursor::parse(value);
+      if (!result.maybe_before) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  auto params_glob = origin_form->params().find("glob");
+  if (params_glob != origin_form->params().end()) {
+    result.maybe_glob = (*params_glob).value;
+  }
+
+  auto params_order = origin_form->params().find("order");
+  if (params_order != origin_form->params().end()) {
+    auto value = (*params_order).value;
+    if (value != "forward" && value != "reverse") {
+      return std::nullopt;
+    }
+    result.forward = value == "forward";
+  }
+
+  AggregationQuery aggregation;
+  bool aggregated = false;
+  auto params_count = origin_form->params().find("count");
+  if (params_count != origin_form->params().end()) {
+    auto value = (*params_count).value;
+    aggregated = value == "1" || value == "true";
+  }
+  auto params_histogram = origin_form->params().find("histogram");
+  if (params_histogram != origin_form->params().end()) {
+    aggregation.histogram_bucket = parse_bucket((*params_histogram).value);
+    if (!aggregation.histogram_bucket) {
+      return std::nullopt;
+    }
+    aggregated = true;
+  }
+  auto params_topk = origin_form->params().find("topk");
+  if (params_topk != origin_form->params().end()) {
+    aggregation.topk_field = (*params_topk).value;
+    if (aggregation.topk_field->empty()) {
+      return std::nullopt;
+    }
+    aggregated = true;
+  }
+  auto params_k = origin_form->params().find("k");
+  if (params_k != origin_form->params().end()) {
+    auto value = (*params_k).value;
+    auto [end, error] = std::from_chars(
+        value.data(), value.data() + value.size(), aggregation.k);
+    if (error != std::errc() || end != value.data() + value.size() ||
+        aggregation.k > TOPK_MAX_K) {
+      return std::nullopt;
+    }
+  }
+  if (aggregated) {
+    result.maybe_aggregation = std::move(aggregation);
   }
 
   return result;
 }
 
-http::message_generator Handler::handle_request_(
+Response Handler::handle_request_(
     http::request<http::string_body>&& req) {
   // Only accept HTTP GET verb
   if (req.method() != http::verb::get)
     return bad_request(req, "Unsupported HTTP verb");
 
+  auto target = std::string_view(req.target().data(), req.target().size());
+  if (!options_.metrics_path.empty() &&
+      target.substr(0, target.find('?')) == options_.metrics_path) {
+    http::response<http::string_body> res{http::status::ok, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+    res.keep_alive(req.keep_alive());
+    res.body() = metrics().render();
+    res.prepare_payload();
+    return res;
+  }
+
   auto maybe_request = parse_log_request(req.target());
   if (!maybe_request) {
     return bad_request(req, "Invalid request");
   }
   auto& request = *maybe_request;
 
+  if (!options_.merge_path.empty() &&
+      target.substr(0, target.find('?')) == options_.merge_path) {
+    return merge_request(req, request);
+  }
+
   auto full_file_path =
       root_dir_ / std::filesystem::path(request.file_path).relative_path();
 
   spdlog::trace("Going to open the file at {}", full_file_path.string());
 
-  auto log_stream = make_log_stream(
-      full_file_path, request.maybe_n.value_or(DEFAULT_N), request.maybe_grep);
+  size_t n = request.maybe_n.value_or(DEFAULT_N);
+  bool time_range = request.maybe_since || request.maybe_until;
+  if (request.maybe_aggregation) {
+    if (request.follow || request.paged) {
+      return bad_request(req, "Aggregations can't be followed or paged");
+    }
+    // Aggregations go over all the lines unless asked otherwise
+    n = request.maybe_n.value_or(std::numeric_limits<size_t>::max());
+  }
+  if (request.forward && (request.maybe_grep || request.follow ||
+                             request.paged || request.maybe_aggregation)) {
+    return bad_request(
+        req, "File order can't be filtered, followed, paged or aggregated");
+  }
+  if (request.follow) {
+    if (request.maybe_lines || time_range) {
+      return bad_request(req, "Line and time ranges can't be followed");
+    }
+    if (!std::filesystem::is_regular_file(full_file_path)) {
+      return not_found(req);
+    }
+    return std::make_unique<FollowResponse>(
+        *this, full_file_path, n, request.maybe_grep, req.version());
+  }
+
+  if (request.paged) {
+    if (request.maybe_lines || time_range) {
+      return bad_request(req, "Line and time ranges can't be paged");
+    }
+    if (req.version() < 11) {
+      // The cursor only goes into a trailer
+      return bad_request(req, "Paging needs HTTP/1.1");
+    }
+    auto files = paged_files(
+        full_file_path, request.maybe_before, options_.read_rotated);
+    if (files.empty()) {
+      return not_found(req);
+    }
+    auto log_stream = std::make_unique<LogStream>();
+    log_stream->write_buffer_size = options_.write_buffer_size;
+    log_stream->budget = scan_budget();
+    log_stream->generator = tail_page(std::move(files),
+        request.maybe_before ? request.maybe_before->offset
+                             : std::numeric_limits<size_t>::max(),
+        n, std::move(request.maybe_grep), decompressed_cache_.get(),
+        scan_pool_.get(), &log_stream->next_page, log_stream->budget.get(),
+        [this](const std::filesystem::path& path) { return map_file(path); });
+    return log_response(req, std::move(log_stream), {}, true);
+  }
+
+  FileRange range;
+  std::optional<size_t> maybe_line_count;
+  if (request.maybe_lines && time_range) {
+    return bad_request(req, "Line and time ranges can't be combined");
+  }
+  if (time_range) {
+    auto maybe_range = find_time_range(full_file_path, *timestamp_parser_,
+        request.maybe_since, request.maybe_until);
+    if (!maybe_range) {
+      return not_found(req);
+    }
+    range = *maybe_range;
+    // Like with line ranges, the range is what limits the amount of lines
+    n = request.maybe_n.value_or(
+        request.maybe_aggregation ? std::numeric_limits<size_t>::max()
+                                  : REQUEST_MAX_N);
+  }
+  if (request.maybe_lines) {
+    if (!options_.index_dir) {
+      return bad_request(req, "Line ranges require line indexes to be enabled");
+    }
+    // Zero-based [first, last) here
+    auto [first, last] = *request.maybe_lines;
+    first -= 1;
+    auto lines =
+        line_index(request.file_path)->lines(full_file_path, first, last);
+    if (!lines) {
+      return not_found(req);
+    }
+    range = FileRange{lines->begin, lines->end};
+    // The range itself is what limits the amount of lines (unless it's
+    // filtered), so `n` only applies if it was given explicitly.
+    n = std::min(last - first, request.maybe_n.value_or(REQUEST_MAX_N));
+    maybe_line_count = lines->line_count;
+  }
+
+  http::fields headers;
+  if (maybe_line_count) {
+    headers.set("X-Line-Count", std::to_string(*maybe_line_count));
+  }
+
+  if (request.forward) {
+    auto file = map_file(full_file_path);
+    if (!file) {
+      return not_found(req);
+    }
+    // Ranges are sent whole unless `n` is given explicitly
+    std::optional<size_t> maybe_n;
+    if (request.maybe_n || range == FileRange{}) {
+      maybe_n = n;
+    }
+    return std::make_unique<FileResponse>(*this, std::move(*file), maybe_n,
+        range, std::move(headers), req.version(), req.keep_alive());
+  }
+
+  auto log_stream = make_log_stream(full_file_path, n, request.maybe_grep,
+      range, !request.maybe_lines && !time_range, scan_budget());
   if (!log_stream) {
     return not_found(req);
   }
+  if (request.maybe_aggregation) {
+    return aggregate_response(
+        req, std::move(log_stream), *request.maybe_aggregation);
+  }
+  return log_response(req, std::move(log_stream), std::move(headers));
+}
+
+Response Handler::merge_request(
+    http::request<http::string_body>& req, LogRequest& request) {
+  if (!request.maybe_glob) {
+    return bad_request(req, "Merged requests need a glob");
+  }
+  if (request.maybe_lines || request.maybe_since || request.maybe_until ||
+      request.follow || request.paged || request.forward) {
+    return bad_request(req, "Merged requests only support n and filters");
+  }
+  // Wildcards are only supported in the file name. The directory is made
+  // absolute before normalizing it, so that it can't go above the root dir.
+  auto glob =
+      std::filesystem::path("/" + *request.maybe_glob).lexically_normal();
+  auto paths = glob_files(root_dir_ / glob.parent_path().relative_path(),
+      glob.filename().string());
+  if (paths.empty()) {
+    return not_found(req);
+  }
+  if (paths.size() > MERGE_MAX_FILES) {
+    return bad_request(req, "Too many files to merge");
+  }
+  std::vector<MappedFile> files;
+  for (const auto& path : paths) {
+    if (auto file = map_file(path)) {
+      files.push_back(std::move(*file));
+    } else {
+      spdlog::warn("Failed to map {}, skipping it", path.string());
+    }
+  }
+  auto log_stream = std::make_unique<LogStream>();
+  log_stream->write_buffer_size = options_.write_buffer_size;
+  log_stream->budget = scan_budget();
+  log_stream->generator = merged_tail(std::move(files),
+      request.maybe_n.value_or(request.maybe_aggregation
+                                   ? std::numeric_limits<size_t>::max()
+                                   : DEFAULT_N),
+      std::move(request.maybe_grep), *timestamp_parser_, scan_pool_.get(),
+      log_stream->budget.get());
 
-  http::response<LogBody> res{http::status::ok, req.version()};
+  if (request.maybe_aggregation) {
+    return aggregate_response(
+        req, std::move(log_stream), *request.maybe_aggregation);
+  }
+  return log_response(req, std::move(log_stream));
+}
+
+// Summary of the lines of `log_stream`, as JSON
+std::string aggregate(LogStream& log_stream, const AggregationQuery& query,
+    const TimestampParser* parser) {
+  Aggregator aggregator(query, parser);
+  for (auto line : log_stream.generator) {
+    // Pauses of the budget don't matter, the whole summary is sent at once.
+    // Long lines are only summarized by their last fragment.
+    if (!line.empty() && !log_stream.fragment) {
+      aggregator.add(line);
+    }
+  }
+  if (log_stream.budget && log_stream.budget->exhausted()) {
+    metrics().scans_truncated.add();
+    aggregator.set_truncated(log_stream.budget->exhausted_reason());
+  }
+  return aggregator.json();
+}
+
+http::response<http::string_body> json_response(
+    unsigned version, bool keep_alive, std::string body) {
+  http::response<http::string_body> res{http::status::ok, version};
   res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-  res.set(http::field::content_type, "text/plain");
-  res.keep_alive(req.keep_alive());
-  res.body() = std::move(log_stream);
+  res.set(http::field::content_type, "application/json");
+  res.keep_alive(keep_alive);
+  res.body() = std::move(body);
+  res.prepare_payload();
+  return res;
+}
+
+// Response to a scan that wasn't admitted: 429 if too many scans are waiting
+// already, 503 if it waited for too long
+http::response<http::string_body> scan_rejected(
+    Admission::Rejection rejection, unsigned version, bool keep_alive) {
+  http::response<http::string_body> res{
+      rejection == Admission::Rejection::QUEUE_FULL
+          ? http::status::too_many_requests
+          : http::status::service_unavailable,
+      version};
+  res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  res.set(http::field::content_type, "text/html");
+  res.set(http::field::retry_after, "1");
+  res.keep_alive(keep_alive);
+  res.body() = "Too many requests, try again later";
   res.prepare_payload();
   return res;
 }
 
+Response Handler::aggregate_response(http::request<http::string_body>& req,
+    std::unique_ptr<LogStream> log_stream, const AggregationQuery& query) {
+  if (admission_) {
+    return std::make_unique<AggregateResponse>(
+        *this, std::move(log_stream), query, req.version(), req.keep_alive());
+  }
+  return json_response(req.version(), req.keep_alive(),
+      aggregate(*log_stream, query, timestamp_parser_.get()));
+}
+
+std::unique_ptr<ScanBudget> Handler::scan_budget() const {
+  if (options_.scan_byte_budget == 0 && options_.scan_time_budget <= 0 &&
+      !read_pool_) {
+    return nullptr;
+  }
+  return std::make_unique<ScanBudget>(options_.scan_byte_budget,
+      seconds_option(std::max(options_.scan_time_budget, 0.0)),
+      read_pool_ ? ScanBudget::Clock::duration(SCAN_SLICE)
+                 : ScanBudget::Clock::duration::zero());
+}
+
+Response Handler::log_response(http::request<http::string_body>& req,
+    std::unique_ptr<LogStream> log_stream, http::fields headers, bool paged) {
+  if (req.version() < 11 &&
+      (options_.scan_byte_budget != 0 || options_.scan_time_budget > 0)) {
+    // Without a trailer, a response cut short would look like a whole one
+    return bad_request(req, "Scans with a budget need HTTP/1.1");
+  }
+  if (!paged && !read_pool_ && !admission_ && !log_stream->budget) {
+    http::response<LogBody> res{http::status::ok, req.version()};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/plain");
+    for (const auto& field : headers) {
+      res.set(field.name_string(), field.value());
+    }
+    compress(req, res, *log_stream);
+    res.keep_alive(req.keep_alive());
+    res.body() = std::move(log_stream);
+    res.prepare_payload();
+    return res;
+  }
+
+  http::response<http::empty_body> res{http::status::ok, req.version()};
+  res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  res.set(http::field::content_type, "text/plain");
+  for (const auto& field : headers) {
+    res.set(field.name_string(), field.value());
+  }
+  compress(req, res, *log_stream);
+  res.keep_alive(req.keep_alive());
+  if (req.version() >= 11) {
+    res.chunked(true);
+    if (paged || log_stream->budget) {
+      res.set(http::field::trailer,
+          !log_stream->budget ? "X-Cursor"
+          : paged             ? "X-Cursor, X-Truncated"
+                              : "X-Truncated");
+    }
+  } else {
+    // Without chunks, the end of the body is the end of the connection
+    res.keep_alive(false);
+  }
+  return std::make_unique<LogResponse>(std::move(res), std::move(log_stream),
+      read_pool_.get(), admission_.get());
+}
+
+void Handler::compress(const http::request<http::string_body>& req,
+    http::fields& headers, LogStream& log_stream) {
+  if (!compression_budget_) {
+    return;
+  }
+  headers.set(http::field::vary, "Accept-Encoding");
+  auto encoding = choose_content_encoding(req[http::field::accept_encoding]);
+  if (encoding == ContentEncoding::IDENTITY) {
+    return;
+  }
+  if (!compression_budget_->available()) {
+    metrics().compression_fallbacks.add();
+    return;
+  }
+  log_stream.compressor = Compressor::create(encoding,
+      encoding == ContentEncoding::ZSTD ? options_.zstd_level
+                                        : options_.gzip_level);
+  log_stream.compression_budget = compression_budget_.get();
+  headers.set(http::field::content_encoding, content_encoding_name(encoding));
+  metrics().compressed_responses.add();
+}
+
+// Lines of `current` (the tail of a log file), and once those run out, lines
+// of the rotated generations of the file, up to `n` lines in total.
+// Generations are only opened (and decompressed) once they are needed, and
+// not at all once `budget` (which `current` and decompressing spend as well)
+// runs out. Generations are mapped with `map_file`.
+// `fragment` tells fragments of long lines of `current` apart. The frame comes
+// from the memory pool.
+std::generator<std::string_view> tail_generations(std::allocator_arg_t,
+    PoolAllocator<std::byte>, std::generator<std::string_view> current,
+    std::filesystem::path path, size_t n, std::optional<Grep> grep,
+    DecompressedCache* decompressed_cache, ScanPool* scan_pool,
+    ScanBudget* budget, const bool* fragment, MapFile map_file) {
+  // Pauses of the budget are passed on, but aren't lines, and neither are
+  // fragments but the last one
+  for (auto line : current) {
+    co_yield line;
+    if (!line.empty() && !*fragment && --n == 0) {
+      co_return;
+    }
+  }
+
+  for (const auto& generation : rotated_generations(path)) {
+    if (budget && budget->exhausted()) {
+      co_return;
+    }
+    std::optional<std::filesystem::path> readable_path = generation;
+    if (is_compressed(generation)) {
+      readable_path = decompressed_cache
+                          ? decompressed_cache->get(generation, budget)
+                          : std::nullopt;
+      if (!readable_path) {
+        spdlog::debug("Skipping compressed {}", generation.string());
+        continue;
+      }
+    }
+    auto file = map_file(*readable_path);
+    if (!file) {
+      spdlog::warn("Failed to map {}, skipping it", readable_path->string());
+      continue;
+    }
+    for (auto line : tail(*file, n, grep, {}, scan_pool, budget)) {
+      co_yield line;
+      if (!line.empty() && --n == 0) {
+        co_return;
+      }
+    }
+  }
+}
+
 std::unique_ptr<LogStream> Handler::make_log_stream(std::filesystem::path path,
-    size_t n, std::optional<std::string> maybe_grep) {
-  if (!std::filesystem::is_regular_file(path)) {
+    size_t n, std::optional<Grep> grep, FileRange range,
+    bool with_generations, std::unique_ptr<ScanBudget> budget) {
+  // Mapped files are served right from the page cache and have no line length
+  // limit, so they are preferred whenever mapping works.
+  auto mapped_file = map_file(path);
+  if (!mapped_file && !std::filesystem::is_regular_file(path)) {
     return nullptr;
   }
+
   auto result = std::make_unique<LogStream>();
-  result->input_stream.open(path);
-  if (!result->input_stream.is_open() || !result->input_stream.good()) {
-    return nullptr;
+  result->write_buffer_size = options_.write_buffer_size;
+  result->budget = std::move(budget);
+  result->mapped_file = std::move(mapped_file);
+  if (grep && result->mapped_file && options_.grep_index &&
+      options_.index_dir) {
+    auto index = trigram_index(path.lexically_relative(root_dir_));
+    // A large file that isn't indexed yet gets indexed a few regions per
+    // request, as part of the request's reads, rather than all at once
+    if (index->update(
+            path, TRIGRAM_REGIONS_PER_REQUEST, result->budget.get())) {
+      result->skip = TrigramSkip::create(
+          index->regions(result->mapped_file->identity()), *grep);
+    }
+  }
+  const TrigramSkip* skip = result->skip ? &*result->skip : nullptr;
+  // Requests for more lines than can be sent (aggregations over whole files)
+  // would only push everything else out of the cache
+  if (result->mapped_file && result_cache_ && range == FileRange{} &&
+      n <= REQUEST_MAX_N) {
+    result->generator = cached_tail(*result->mapped_file, n, grep,
+        *result_cache_, result_cache_key(path.string(), n, grep),
+        scan_pool_.get(), result->budget.get(), skip);
+  } else if (result->mapped_file) {
+    result->generator = tail(*result->mapped_file, n, grep, range,
+        scan_pool_.get(), result->budget.get(), nullptr, skip);
+  } else {
+    result->input_stream.open(path);
+    if (!result->input_stream.is_open() || !result->input_stream.good()) {
+      return nullptr;
+    }
+    result->generator = tail(result->input_stream, n, grep, range, nullptr,
+        result->budget.get(), &result->fragment);
+  }
+
+  if (with_generations && options_.read_rotated) {
+    result->generator = tail_generations(std::allocator_arg,
+        PoolAllocator<std::byte>(), std::move(result->generator),
+        std::move(path), n, std::move(grep), decompressed_cache_.get(),
+        scan_pool_.get(), result->budget.get(), &result->fragment,
+        [this](const std::filesystem::path& path) { return map_file(path); });
+  }
+  return result;
+}
+
+std::optional<MappedFile> Handler::map_file(const std::filesystem::path& path) {
+  if (file_cache_) {
+    return file_cache_->open(path);
+  }
+  return MappedFile::open(path);
+}
+
+std::shared_ptr<LineIndex> Handler::line_index(
+    const std::filesystem::path& path) {
+  std::lock_guard lock(line_indexes_mutex_);
+  auto& result = line_indexes_[path.string()];
+  if (!result) {
+    auto index_path = *options_.index_dir / path.relative_path();
+    index_path += ".lidx";
+    result = std::make_shared<LineIndex>(
+        std::move(index_path), options_.index_sample_every);
   }
-  result->generator = tail(result->input_stream, n, maybe_grep);
+  return result;
+}
 
+std::shared_ptr<TrigramIndex> Handler::trigram_index(
+    const std::filesystem::path& path) {
+  std::lock_guard lock(trigram_indexes_mutex_);
+  auto& result = trigram_indexes_[path.string()];
+  if (!result) {
+    auto index_path = *options_.index_dir / path.relative_path();
+    index_path += ".tidx";
+    result = std::make_shared<TrigramIndex>(std::move(index_path));
+  }
   return result;
 }
+
+std::shared_ptr<FileWatcher> Handler::file_watcher(
+    asio::any_io_executor executor) {
+  std::lock_guard lock(file_watcher_mutex_);
+  if (!file_watcher_) {
+    file_watcher_ = FileWatcher::create(executor, read_pool_.get());
+  }
+  return file_watcher_;
+}
+
+// Lines of `chunk` that have a match for `grep`, in the order they are in the
+// chunk
+std::vector<asio::const_buffer> matching_lines(
+    std::string_view chunk, const std::optional<Grep>& grep) {
+  if (!grep) {
+    return {asio::buffer(chunk)};
+  }
+  std::vector<asio::const_buffer> result;
+  size_t end = chunk.size();
+  while (auto hit = grep->find_last(chunk.substr(0, end))) {
+    auto line_start = *hit == 0 ? std::string_view::npos
+                                : chunk.rfind('\n', *hit - 1);
+    line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+    auto line_end = chunk.find('\n', *hit);
+    line_end = line_end == std::string_view::npos ? end
+                                                  : std::min(line_end + 1, end);
+    result.push_back(
+        asio::buffer(chunk.substr(line_start, line_end - line_start)));
+    end = line_start;
+  }
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+// Copies the next batch of lines of a response into `batch`, on `read_pool`
+// (if given), so that the thread serving the connection doesn't wait for the
+// disk. Returns whether there may be more.
+asio::awaitable<bool> read_batch(LogBodyWriter& writer, PooledString& batch,
+    asio::thread_pool* read_pool) {
+  auto read = [&] {
+    beast::error_code ec;
+    auto buffers = writer.get(ec);
+    if (!buffers) {
+      batch.clear();
+      return false;
+    }
+    batch.assign(static_cast<const char*>(buffers->first.data()),
+        buffers->first.size());
+    return buffers->second;
+  };
+  if (!read_pool) {
+    co_return read();
+  }
+  co_return co_await asio::co_spawn(
+      read_pool->get_executor(),
+      [&]() -> asio::awaitable<bool> { co_return read(); },
+      asio::use_awaitable);
+}
+
+asio::awaitable<void> write_batch(
+    beast::tcp_stream& stream, const PooledString& batch, bool chunked) {
+  if (batch.empty()) {
+    co_return;
+  }
+  auto& m = metrics();
+  auto write_start = std::chrono::steady_clock::now();
+  size_t size =
+      chunked ? co_await asio::async_write(
+                    stream, http::make_chunk(asio::buffer(batch)))
+              : co_await asio::async_write(stream, asio::buffer(batch));
+  auto write_duration = std::chrono::steady_clock::now() - write_start;
+  m.bytes_sent.add(size);
+  if (write_duration > WRITE_STALL_THRESHOLD) {
+    m.write_stalls.add();
+    m.write_stall_duration.observe(write_duration);
+  }
+}
+
+// Writes the lines of `log_stream` as the body of a response (which header is
+// sent already), as chunks or as is. Batches are copied out of the writer, so
+// that the next one is read while the current one is being sent.
+asio::awaitable<void> write_log_body(beast::tcp_stream& stream,
+    const http::response_header<>& header,
+    std::unique_ptr<LogStream>& log_stream, asio::thread_pool* read_pool,
+    bool chunked) {
+  beast::error_code ec;
+  LogBodyWriter writer(header, log_stream);
+  writer.init(ec);
+  PooledString batch;
+  PooledString next_batch;
+  bool more = co_await read_batch(writer, batch, read_pool);
+  while (more) {
+    more = co_await (write_batch(stream, batch, chunked) &&
+                     read_batch(writer, next_batch, read_pool));
+    std::swap(batch, next_batch);
+  }
+  co_await write_batch(stream, batch, chunked);
+}
+
+// Response to `follow=1` requests: the last `n` lines (newest first, like any
+// other response), and then lines appended to the file, in the order they are
+// appended, until the client goes away or the file is deleted or moved. The
+// body is chunked, or for HTTP/1.0 clients, ends with the connection.
+class Handler::FollowResponse : public StreamingResponse {
+ public:
+  FollowResponse(Handler& handler, std::filesystem::path path, size_t n,
+      std::optional<Grep> grep, unsigned version)
+      : handler_(handler),
+        path_(std::move(path)),
+        n_(n),
+        grep_(std::move(grep)),
+        version_(version) {}
+
+  // The end of the response is the client going away, there is nothing to
+  // keep alive.
+  bool keep_alive() const override { return false; }
+
+  asio::awaitable<void> write(beast::tcp_stream& stream) override {
+    auto watcher = handler_.file_watcher(co_await asio::this_coro::executor);
+    // Subscribing first so that no line gets lost between the last lines and
+    // the appended ones: the last lines are the ones up to where the
+    // subscription starts.
+    auto subscription = watcher->subscribe(path_);
+    std::unique_ptr<LogStream> log_stream;
+    if (subscription) {
+      // Opening the file (and bringing its indexes up to date) may wait for
+      // the disk, like any other scan
+      auto open = [&] {
+        log_stream = handler_.make_log_stream(
+            path_, n_, grep_, FileRange{0, subscription->offset()});
+      };
+      if (handler_.read_pool_) {
+        co_await asio::co_spawn(
+            handler_.read_pool_->get_executor(),
+            [&]() -> asio::awaitable<void> {
+              open();
+              co_return;
+            },
+            asio::use_awaitable);
+      } else {
+        open();
+      }
+    }
+    if (!log_stream) {
+      http::response<http::string_body> res{
+          http::status::internal_server_error, version_};
+      res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+      res.set(http::field::content_type, "text/html");
+      res.keep_alive(false);
+      res.body() = "Failed to follow the file";
+      res.prepare_payload();
+      co_await http::async_write(stream, res);
+      co_return;
+    }
+
+    http::response<http::empty_body> res{http::status::ok, version_};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/plain");
+    res.keep_alive(false);
+    // HTTP/1.0 has no chunks, the body simply ends with the connection
+    bool chunked = version_ >= 11;
+    res.chunked(chunked);
+    http::response_serializer<http::empty_body> serializer{res};
+    co_await http::async_write_header(stream, serializer);
+
+    co_await write_log_body(
+        stream, res.base(), log_stream, handler_.read_pool_.get(), chunked);
+
+    if (grep_ && grep_->matches_all()) {
+      grep_.reset();
+    }
+    if (!grep_ || grep_->can_match_lines()) {
+      co_await follow(stream, *subscription, grep_, chunked);
+    }
+
+    if (chunked) {
+      // The client may be gone already, so errors don't matter here
+      co_await asio::async_write(stream, http::make_chunk_last(),
+          asio::as_tuple(asio::use_awaitable));
+    }
+  }
+
+ private:
+  asio::awaitable<void> follow(beast::tcp_stream& stream,
+      FileWatcher::Subscription& subscription, const std::optional<Grep>& grep,
+      bool chunked) {
+    // Clients aren't supposed to send anything while following, so a read
+    // completing means that the client has closed the connection.
+    char probe;
+    for (;;) {
+      auto result = co_await (
+          subscription.chunks().async_receive(
+              asio::as_tuple(asio::use_awaitable)) ||
+          stream.socket().async_read_some(
+              asio::buffer(&probe, 1), asio::as_tuple(asio::use_awaitable)));
+      if (result.index() != 0) {
+        co_return;
+      }
+      auto [ec, chunk] = std::get<0>(result);
+      if (ec) {
+        // The file is gone, or we weren't fast enough to keep up with it
+        co_return;
+      }
+      auto lines = matching_lines(*chunk, grep);
+      if (lines.empty()) {
+        continue;
+      }
+      if (chunked) {
+        co_await asio::async_write(stream, http::make_chunk(lines));
+      } else {
+        co_await asio::async_write(stream, lines);
+      }
+    }
+  }
+
+  Handler& handler_;
+  std::filesystem::path path_;
+  size_t n_;
+  std::optional<Grep> grep_;
+  unsigned version_;
+};
+
+// Waits for `admission` (if any) to let a scan in, keeping its slot in
+// `ticket`. If it doesn't, sends the rejection and returns false, otherwise
+// (re)starts the budget of the scan.
+asio::awaitable<bool> admit(beast::tcp_stream& stream, Admission* admission,
+    ScanBudget* budget, unsigned version, bool keep_alive,
+    std::optional<Admission::Ticket>& ticket) {
+  if (admission) {
+    Admission::Rejection rejection;
+    ticket = co_await admission->acquire(&rejection);
+    if (!ticket) {
+      auto& m = metrics();
+      m.scans_rejected.add();
+      auto res = scan_rejected(rejection, version, keep_alive);
+      m.bytes_sent.add(co_await http::async_write(stream, res));
+      co_return false;
+    }
+  }
+  // Time spent waiting doesn't count
+  if (budget) {
+    budget->start();
+  }
+  co_return true;
+}
+
+// Response streaming the lines of a `LogStream` in a chunked body (or, for
+// HTTP/1.0 clients, until the connection is closed). Paged responses get the
+// cursor to the next page in the `X-Cursor` trailer, it's only known once the
+// last line is read. Responses cut short by the scan budget get the
+// `X-Truncated` trailer.
+class Handler::LogResponse : public StreamingResponse {
+ public:
+  LogResponse(http::response<http::empty_body> res,
+      std::unique_ptr<LogStream> log_stream, asio::thread_pool* read_pool,
+      Admission* admission)
+      : res_(std::move(res)),
+        log_stream_(std::move(log_stream)),
+        read_pool_(read_pool),
+        admission_(admission),
+        start_(std::chrono::steady_clock::now()) {}
+
+  bool keep_alive() const override { return res_.keep_alive(); }
+
+  asio::awaitable<void> write(beast::tcp_stream& stream) override {
+    auto& m = metrics();
+    auto& budget = log_stream_->budget;
+    // Held until the whole body is sent
+    std::optional<Admission::Ticket> ticket;
+    if (!co_await admit(stream, admission_, budget.get(), res_.version(),
+            res_.keep_alive(), ticket)) {
+      co_return;
+    }
+
+    http::response_serializer<http::empty_body> serializer{res_};
+    m.bytes_sent.add(co_await http::async_write_header(stream, serializer));
+    m.time_to_first_byte.observe(std::chrono::steady_clock::now() - start_);
+
+    co_await write_log_body(
+        stream, res_.base(), log_stream_, read_pool_, res_.chunked());
+
+    bool truncated = budget && budget->exhausted();
+    if (truncated) {
+      m.scans_truncated.add();
+    }
+    if (res_.chunked()) {
+      http::fields trailer;
+      if (log_stream_->next_page) {
+        trailer.set("X-Cursor", log_stream_->next_page->to_string());
+      }
+      if (truncated) {
+        trailer.set("X-Truncated", budget->exhausted_reason());
+      }
+      m.bytes_sent.add(co_await asio::async_write(
+          stream, http::make_chunk_last(trailer)));
+    }
+    m.request_duration.observe(std::chrono::steady_clock::now() - start_);
+  }
+
+ private:
+  http::response<http::empty_body> res_;
+  std::unique_ptr<LogStream> log_stream_;
+  asio::thread_pool* read_pool_;
+  Admission* admission_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Summary of a `LogStream` that has to be admitted first. Lines are read on
+// the read pool (if any) once it is.
+class Handler::AggregateResponse : public StreamingResponse {
+ public:
+  AggregateResponse(Handler& handler, std::unique_ptr<LogStream> log_stream,
+      AggregationQuery query, unsigned version, bool keep_alive)
+      : handler_(handler),
+        log_stream_(std::move(log_stream)),
+        query_(std::move(query)),
+        version_(version),
+        keep_alive_(keep_alive) {}
+
+  bool keep_alive() const override { return keep_alive_; }
+
+  asio::awaitable<void> write(beast::tcp_stream& stream) override {
+    std::optional<Admission::Ticket> ticket;
+    if (!co_await admit(stream, handler_.admission_.get(),
+            log_stream_->budget.get(), version_, keep_alive_, ticket)) {
+      co_return;
+    }
+
+    std::string body;
+    auto summarize = [&] {
+      body = aggregate(*log_stream_, query_, handler_.timestamp_parser_.get());
+    };
+    if (handler_.read_pool_) {
+      co_await asio::co_spawn(
+          handler_.read_pool_->get_executor(),
+          [&]() -> asio::awaitable<void> {
+            summarize();
+            co_return;
+          },
+          asio::use_awaitable);
+    } else {
+      summarize();
+    }
+    // The scan is over, sending the summary doesn't need the slot
+    ticket.reset();
+
+    auto res = json_response(version_, keep_alive_, std::move(body));
+    metrics().bytes_sent.add(co_await http::async_write(stream, res));
+  }
+
+ private:
+  Handler& handler_;
+  std::unique_ptr<LogStream> log_stream_;
+  AggregationQuery query_;
+  unsigned version_;
+  bool keep_alive_;
+};
+
+// Most to send with a single sendfile(2), so that a large transfer takes turns
+// with other requests on the read pool
+constexpr size_t SENDFILE_CHUNK = 1024 * 1024;
+
+// Sends [begin, end) of `file` as is, from the page cache right to the socket
+// with sendfile(2), so the bytes never go through user space. Calls are made
+// on `read_pool` (if given), since they read the file. Where the file system
+// doesn't support sendfile, the bytes are written from the mapping instead.
+// Throws if the file turns out to be shorter (it was truncated meanwhile): the
+// length of the body is sent already, so the connection can't go on.
+asio::awaitable<void> send_file(beast::tcp_stream& stream, MappedFile& file,
+    size_t begin, size_t end, asio::thread_pool* read_pool) {
+  auto& m = metrics();
+  auto& socket = stream.socket();
+  // Once the socket buffer is full, sendfile returns EAGAIN instead of
+  // blocking, and the socket is waited on to take more
+  socket.native_non_blocking(true);
+  ::posix_fadvise(file.fd(), begin, end - begin, POSIX_FADV_SEQUENTIAL);
+
+  off_t offset = begin;
+  // Returns -errno on errors, as `errno` is per thread
+  auto send = [&]() -> ssize_t {
+    ssize_t sent = ::sendfile(socket.native_handle(), file.fd(), &offset,
+        std::min(end - offset, SENDFILE_CHUNK));
+    return sent < 0 ? -errno : sent;
+  };
+  while (static_cast<size_t>(offset) < end) {
+    ssize_t sent;
+    if (read_pool) {
+      sent = co_await asio::co_spawn(
+          read_pool->get_executor(),
+          [&]() -> asio::awaitable<ssize_t> { co_return send(); },
+          asio::use_awaitable);
+    } else {
+      sent = send();
+    }
+
+    if (sent > 0) {
+      m.bytes_sent.add(sent);
+      m.zero_copy_bytes.add(sent);
+    } else if (sent == -EAGAIN) {
+      auto wait_start = std::chrono::steady_clock::now();
+      co_await socket.async_wait(
+          asio::socket_base::wait_write, asio::use_awaitable);
+      auto wait_duration = std::chrono::steady_clock::now() - wait_start;
+      if (wait_duration > WRITE_STALL_THRESHOLD) {
+        m.write_stalls.add();
+        m.write_stall_duration.observe(wait_duration);
+      }
+    } else if (sent == -EINVAL || sent == -ENOSYS) {
+      // Not supported for the file
+      while (static_cast<size_t>(offset) < end) {
+        auto data = file.read(offset, std::min(end - offset, SENDFILE_CHUNK));
+        if (!data) {
+          break;
+        }
+        m.bytes_sent.add(
+            co_await asio::async_write(stream, asio::buffer(*data)));
+        offset += data->size();
+      }
+      break;
+    } else if (sent == 0) {
+      // End of file
+      break;
+    } else {
+      throw boost::system::system_error(
+          -sent, boost::system::system_category(), "sendfile");
+    }
+  }
+  if (static_cast<size_t>(offset) < end) {
+    throw std::runtime_error("File was truncated while being sent");
+  }
+}
+
+// Response to `order=forward` requests: the last `n` lines of a range of a file
+// (the whole range without `n`) in file order, sent as the bytes of the file
+// they are in (see `send_file`), with a known length. Where the lines start is
+// found once the request is admitted, by going back through them.
+class Handler::FileResponse : public StreamingResponse {
+ public:
+  FileResponse(Handler& handler, MappedFile file, std::optional<size_t> n,
+      FileRange range, http::fields headers, unsigned version, bool keep_alive)
+      : handler_(handler),
+        file_(std::move(file)),
+        n_(n),
+        range_(range),
+        headers_(std::move(headers)),
+        version_(version),
+        keep_alive_(keep_alive),
+        start_(std::chrono::steady_clock::now()) {}
+
+  bool keep_alive() const override { return keep_alive_; }
+
+  asio::awaitable<void> write(beast::tcp_stream& stream) override {
+    auto& m = metrics();
+    std::optional<Admission::Ticket> ticket;
+    if (!co_await admit(stream, handler_.admission_.get(), nullptr, version_,
+            keep_alive_, ticket)) {
+      co_return;
+    }
+
+    size_t end = std::min(file_.size(), range_.end);
+    std::optional<size_t> begin = std::min(range_.begin, end);
+    if (n_) {
+      auto find_start = [&] { begin = last_lines_start(file_, *n_, range_); };
+      if (handler_.read_pool_) {
+        co_await asio::co_spawn(
+            handler_.read_pool_->get_executor(),
+            [&]() -> asio::awaitable<void> {
+              find_start();
+              co_return;
+            },
+            asio::use_awaitable);
+      } else {
+        find_start();
+      }
+    }
+    // The scan is over, sending the bytes doesn't need the slot
+    ticket.reset();
+
+    if (!begin) {
+      http::response<http::string_body> res{
+          http::status::internal_server_error, version_};
+      res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+      res.set(http::field::content_type, "text/html");
+      res.keep_alive(keep_alive_);
+      res.body() = "Failed to read the file";
+      res.prepare_payload();
+      m.bytes_sent.add(co_await http::async_write(stream, res));
+      co_return;
+    }
+
+    http::response<http::empty_body> res{http::status::ok, version_};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/plain");
+    for (const auto& field : headers_) {
+      res.set(field.name_string(), field.value());
+    }
+    res.keep_alive(keep_alive_);
+    res.content_length(end - *begin);
+    http::response_serializer<http::empty_body> serializer{res};
+    m.bytes_sent.add(co_await http::async_write_header(stream, serializer));
+    m.time_to_first_byte.observe(std::chrono::steady_clock::now() - start_);
+
+    co_await send_file(stream, file_, *begin, end, handler_.read_pool_.get());
+    m.request_duration.observe(std::chrono::steady_clock::now() - start_);
+  }
+
+ private:
+  Handler& handler_;
+  MappedFile file_;
+  std::optional<size_t> n_;
+  FileRange range_;
+  http::fields headers_;
+  unsigned version_;
+  bool keep_alive_;
+  std::chrono::steady_clock::time_point start_;
+};
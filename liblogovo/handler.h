@@ -1,23 +1,210 @@
 #pragma once
 
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
 #include <boost/beast/http.hpp>
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <variant>
 
+#include "grep.h"
+
+class Admission;
+struct AggregationQuery;
+class FileWatcher;
+class CompressionBudget;
+class DecompressedCache;
+class FileCache;
+class LineIndex;
+class MappedFile;
+class ResultCache;
+class ScanBudget;
+class ScanPool;
+class TimestampParser;
+class TrigramIndex;
 class LogStream;
+struct FileRange;
+struct LogRequest;
+
+struct HandlerOptions {
+  // Log lines are sent to the network in batches of up to this many bytes. Zero
+  // means sending every line on its own.
+  size_t write_buffer_size = 128 * 1024;
+  // Directory to keep line indexes of log files in (see `LineIndex`). Requests
+  // for line ranges are only supported if it's set.
+  std::optional<std::filesystem::path> index_dir;
+  // Line indexes keep the offset of every this many lines
+  size_t index_sample_every = 1024;
+  // Whether to keep trigram indexes of files searched with filters in
+  // `index_dir` too (see `TrigramIndex`), so that searches skip the parts of
+  // files the filter can't match in
+  bool grep_index = false;
+  // Threads to read log files on, so that the threads serving connections
+  // never wait for the disk: requests are handled there, and batches of lines
+  // are read there while the previous ones are being sent. Files are read on
+  // the serving threads if this is 0.
+  size_t read_threads = 0;
+  // Threads to search large files on in parallel when filtering (see
+  // `parallel_grep`). Files are searched on the serving thread if this is 0
+  // or 1.
+  size_t scan_threads = 0;
+  // Whether to go on with the rotated generations of a file (`app.log.1`,
+  // `app.log.2.gz`, ...) once the file itself runs out of lines
+  bool read_rotated = true;
+  // Directory to keep decompressed copies of compressed generations in (see
+  // `DecompressedCache`), and the most it may take, in bytes. Compressed
+  // generations are skipped if it's not set.
+  std::optional<std::filesystem::path> decompress_dir;
+  size_t decompress_dir_size = 4ull * 1024 * 1024 * 1024;
+  // Format of timestamps at the start of log lines, for time range requests
+  // (see `TimestampParser`)
+  std::string timestamp_format = "%Y-%m-%d %H:%M:%S";
+  // Path to serve metrics at (see `Metrics`), empty to not serve them
+  std::string metrics_path = "/metrics";
+  // Path to serve merged tails of several files at (see `merged_tail`), empty
+  // to not serve them
+  std::string merge_path = "/_merge";
+  // Every this many requests get logged, 0 means none
+  size_t log_requests_every = 1;
+  // Compression levels for responses to clients that accept gzip or zstd
+  int gzip_level = 6;
+  int zstd_level = 3;
+  // CPU time compression may take per second, in seconds (i.e. in cores).
+  // Responses are sent uncompressed while that is spent. 0 disables
+  // compression.
+  double compression_cpu_budget = 1;
+  // Memory for results of recent requests for the last lines of files, in
+  // bytes (see `ResultCache`). 0 disables caching.
+  size_t result_cache_size = 64 * 1024 * 1024;
+  // Log files to keep open and mapped between requests (see `FileCache`), 0
+  // means mapping files anew for every request
+  size_t file_cache_size = 1024;
+  // Requests scanning log files that may run at once (see `Admission`), 0
+  // means no limit. Requests over the limit wait for up to
+  // `scan_queue_timeout` seconds, with up to `max_queued_scans` of them
+  // waiting. Followed files don't count.
+  size_t max_scans = 0;
+  size_t max_queued_scans = 256;
+  double scan_queue_timeout = 5;
+  // The most a single request may scan, in bytes and in seconds (see
+  // `ScanBudget`), 0 means no limit. Responses that run out of it are cut
+  // short and marked as such.
+  size_t scan_byte_budget = 0;
+  double scan_time_budget = 0;
+};
+
+// Response that the session lets write itself instead of going through a
+// message_generator. Used for responses that have to wait for something in
+// the middle, like new lines showing up in a followed file.
+class StreamingResponse {
+ public:
+  virtual ~StreamingResponse() = default;
+
+  virtual boost::asio::awaitable<void> write(
+      boost::beast::tcp_stream& stream) = 0;
+  virtual bool keep_alive() const = 0;
+};
+
+using Response = std::variant<boost::beast::http::message_generator,
+    std::unique_ptr<StreamingResponse>>;
 
 class Handler {
  public:
-  Handler(std::filesystem::path root_dir);
+  Handler(std::filesystem::path root_dir, HandlerOptions options = {});
+  ~Handler();
 
-  boost::beast::http::message_generator handle_request(
+  Response handle_request(
+      boost::beast::http::request<boost::beast::http::string_body>&& req);
+  // Does `handle_request` on the read threads, if there are any (see
+  // `HandlerOptions::read_threads`)
+  boost::asio::awaitable<Response> async_handle_request(
       boost::beast::http::request<boost::beast::http::string_body>&& req);
 
  private:
-  boost::beast::http::message_generator handle_request_(
+  class AggregateResponse;
+  class FileResponse;
+  class FollowResponse;
+  class LogResponse;
+
+  Response handle_request_(
       boost::beast::http::request<boost::beast::http::string_body>&& req);
 
-  std::unique_ptr<LogStream> make_log_stream(
-      std::filesystem::path, size_t n, std::optional<std::string> maybe_grep);
+  // Serves the last lines of the files matching a glob, merged by timestamps
+  Response merge_request(
+      boost::beast::http::request<boost::beast::http::string_body>& req,
+      LogRequest& request);
+
+  // Response with a JSON summary of the lines of `log_stream`. The lines are
+  // read right away, unless the request has to be admitted first.
+  Response aggregate_response(
+      boost::beast::http::request<boost::beast::http::string_body>& req,
+      std::unique_ptr<LogStream> log_stream, const AggregationQuery& query);
+
+  // Response with the lines of `log_stream`, with the given extra headers.
+  // With `paged`, the cursor to the next page goes into the `X-Cursor`
+  // trailer.
+  Response log_response(
+      boost::beast::http::request<boost::beast::http::string_body>& req,
+      std::unique_ptr<LogStream> log_stream,
+      boost::beast::http::fields headers = {}, bool paged = false);
+
+  // Sets up compression of the response (if the client accepts it and there
+  // is CPU time for it), adding its headers to `headers`
+  void compress(const boost::beast::http::request<
+                    boost::beast::http::string_body>& req,
+      boost::beast::http::fields& headers, LogStream& log_stream);
+
+  // With `with_generations`, lines of rotated generations follow the ones of
+  // the file itself (if enabled in the options). The stream keeps the
+  // `budget` (if given) and scans within it.
+  std::unique_ptr<LogStream> make_log_stream(std::filesystem::path, size_t n,
+      std::optional<Grep> grep, FileRange range,
+      bool with_generations = false,
+      std::unique_ptr<ScanBudget> budget = nullptr);
+
+  // Maps the log file at `path`, through the file cache if there is one.
+  // Returns nullopt if there is no such file or it can't be mapped.
+  std::optional<MappedFile> map_file(const std::filesystem::path& path);
+
+  // Budget for a request scanning log files, nullptr if there are no limits
+  // (see `HandlerOptions::scan_byte_budget`)
+  std::unique_ptr<ScanBudget> scan_budget() const;
+
+  // Returns the (shared) line index for a file at the given path relative to
+  // the root dir
+  std::shared_ptr<LineIndex> line_index(const std::filesystem::path& path);
+  // Same for trigram indexes
+  std::shared_ptr<TrigramIndex> trigram_index(
+      const std::filesystem::path& path);
+
+  // Returns the file watcher shared by all followed files, creating it on
+  // the given executor if needed
+  std::shared_ptr<FileWatcher> file_watcher(
+      boost::asio::any_io_executor executor);
 
   std::filesystem::path root_dir_;
+  HandlerOptions options_;
+  std::unique_ptr<boost::asio::thread_pool> read_pool_;
+  std::unique_ptr<ScanPool> scan_pool_;
+  std::unique_ptr<DecompressedCache> decompressed_cache_;
+  std::unique_ptr<CompressionBudget> compression_budget_;
+  std::unique_ptr<ResultCache> result_cache_;
+  std::unique_ptr<FileCache> file_cache_;
+  std::unique_ptr<TimestampParser> timestamp_parser_;
+  std::unique_ptr<Admission> admission_;
+  std::atomic<size_t> request_count_ = 0;
+
+  std::mutex line_indexes_mutex_;
+  std::unordered_map<std::string, std::shared_ptr<LineIndex>> line_indexes_;
+  std::mutex trigram_indexes_mutex_;
+  std::unordered_map<std::string, std::shared_ptr<TrigramIndex>>
+      trigram_indexes_;
+
+  std::mutex file_watcher_mutex_;
+  std::shared_ptr<FileWatcher> file_watcher_;
 };
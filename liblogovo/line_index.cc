@@ -0,0 +1,246 @@
+#include "line_index.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "newline_scan.h"
+#include "posix_file.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'L', 'G', 'V', 'L', 'I', 'D', 'X', '1'};
+// Files are scanned in chunks of this size while indexing
+constexpr size_t SCAN_BLOCK_SIZE = 1024 * 1024;
+
+// Calls `on_newline(offset)` for every newline in [begin, end) of the file,
+// in order, until it returns false. Returns false on read errors.
+template <typename OnNewline>
+bool scan_newlines(int fd, size_t begin, size_t end, OnNewline on_newline) {
+  std::vector<char> block(std::min(end - begin, SCAN_BLOCK_SIZE));
+  NewlineBitmap newlines(block.size());
+  for (size_t offset = begin; offset < end;) {
+    size_t size = std::min(end - offset, block.size());
+    if (!pread_exactly(fd, block.data(), size, offset)) {
+      return false;
+    }
+    newlines.scan(std::string_view(block.data(), size));
+    for (auto pos = newlines.find_first_from(0); pos;
+         pos = newlines.find_first_from(*pos + 1)) {
+      if (!on_newline(offset + *pos)) {
+        return true;
+      }
+    }
+    offset += size;
+  }
+  return true;
+}
+
+}  // namespace
+
+// On-disk layout of the index is this header followed by the samples, all in
+// native byte order (the index is a cache local to the machine anyway).
+struct LineIndex::Header {
+  char magic[8];
+  uint64_t device;
+  uint64_t inode;
+  uint64_t sample_every;
+  uint64_t indexed_size;
+  uint64_t indexed_lines;
+};
+
+LineIndex::LineIndex(std::filesystem::path index_path, size_t sample_every)
+    : index_path_(std::move(index_path)), sample_every_(sample_every) {}
+
+void LineIndex::load() {
+  loaded_ = true;
+  reset(0, 0);
+
+  FileDescriptor fd(::open(index_path_.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd) {
+    return;
+  }
+  Header header;
+  if (!pread_exactly(fd.get(), &header, sizeof(header), 0) ||
+      std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.sample_every != sample_every_) {
+    spdlog::info(
+        "Ignoring incompatible line index at {}", index_path_.string());
+    return;
+  }
+  std::vector<uint64_t> samples(header.indexed_lines / sample_every_ + 1);
+  if (!pread_exactly(fd.get(), samples.data(),
+          samples.size() * sizeof(uint64_t), sizeof(header))) {
+    spdlog::warn("Line index at {} is truncated", index_path_.string());
+    return;
+  }
+  device_ = header.device;
+  inode_ = header.inode;
+  indexed_size_ = header.indexed_size;
+  indexed_lines_ = header.indexed_lines;
+  samples_ = std::move(samples);
+}
+
+void LineIndex::reset(uint64_t device, uint64_t inode) {
+  device_ = device;
+  inode_ = inode;
+  file_size_ = 0;
+  indexed_size_ = 0;
+  indexed_lines_ = 0;
+  samples_ = {0};
+}
+
+bool LineIndex::save(size_t first_new_sample) const {
+  std::filesystem::create_directories(index_path_.parent_path());
+  // A rebuilt index is written elsewhere and renamed over the old one, which
+  // may be longer or for another file. Samples are only appended to an
+  // existing index otherwise, and go first with the header last, so that an
+  // interrupted save leaves the index consistent with its previous state
+  // either way.
+  bool rewrite = first_new_sample == 0;
+  auto path = index_path_;
+  if (rewrite) {
+    path += ".tmp";
+  }
+  FileDescriptor fd(::open(path.c_str(),
+      O_WRONLY | O_CREAT | O_CLOEXEC | (rewrite ? O_TRUNC : 0), 0644));
+  if (!fd) {
+    return false;
+  }
+  if (!pwrite_exactly(fd.get(), samples_.data() + first_new_sample,
+          (samples_.size() - first_new_sample) * sizeof(uint64_t),
+          sizeof(Header) + first_new_sample * sizeof(uint64_t))) {
+    return false;
+  }
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.device = device_;
+  header.inode = inode_;
+  header.sample_every = sample_every_;
+  header.indexed_size = indexed_size_;
+  header.indexed_lines = indexed_lines_;
+  if (!pwrite_exactly(fd.get(), &header, sizeof(header), 0)) {
+    return false;
+  }
+  return !rewrite || ::rename(path.c_str(), index_path_.c_str()) == 0;
+}
+
+bool LineIndex::update(const std::filesystem::path& log_path) {
+  std::lock_guard lock(mutex_);
+  FileDescriptor fd(::open(log_path.c_str(), O_RDONLY | O_CLOEXEC));
+  return fd && update(fd.get(), log_path);
+}
+
+bool LineIndex::update(int fd, const std::filesystem::path& log_path) {
+  if (!loaded_) {
+    load();
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  size_t size = st.st_size;
+
+  bool same_file = st.st_dev == device_ && st.st_ino == inode_ &&
+                   size >= indexed_size_;
+  if (same_file && indexed_size_ > 0) {
+    // Inodes get reused, so double check that the indexed part still ends
+    // with a newline
+    char last;
+    same_file =
+        pread_exactly(fd, &last, 1, indexed_size_ - 1) && last == '\n';
+  }
+  if (!same_file) {
+    if (indexed_size_ > 0) {
+      spdlog::info("{} was truncated or replaced, rebuilding its line index",
+          log_path.string());
+    }
+    reset(st.st_dev, st.st_ino);
+  }
+
+  file_size_ = size;
+  if (size == indexed_size_ && same_file) {
+    return true;
+  }
+
+  size_t first_new_sample = same_file ? samples_.size() : 0;
+  bool ok = scan_newlines(fd, indexed_size_, size, [&](size_t newline) {
+    indexed_size_ = newline + 1;
+    if (++indexed_lines_ % sample_every_ == 0) {
+      samples_.push_back(indexed_size_);
+    }
+    return true;
+  });
+  if (!ok) {
+    return false;
+  }
+
+  if (!save(first_new_sample)) {
+    // The index is still usable in memory, it just won't survive a restart
+    spdlog::warn("Failed to save line index at {}: {}", index_path_.string(),
+        strerror(errno));
+  }
+  return true;
+}
+
+size_t LineIndex::line_count() const {
+  std::lock_guard lock(mutex_);
+  return count_lines();
+}
+
+size_t LineIndex::count_lines() const {
+  return indexed_lines_ + (file_size_ > indexed_size_ ? 1 : 0);
+}
+
+std::optional<size_t> LineIndex::line_offset(
+    const std::filesystem::path& log_path, size_t line) const {
+  std::lock_guard lock(mutex_);
+  FileDescriptor fd(::open(log_path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd) {
+    return std::nullopt;
+  }
+  return offset_of(fd.get(), line);
+}
+
+std::optional<LineIndex::Lines> LineIndex::lines(
+    const std::filesystem::path& log_path, size_t first, size_t last) {
+  std::lock_guard lock(mutex_);
+  FileDescriptor fd(::open(log_path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd || !update(fd.get(), log_path)) {
+    return std::nullopt;
+  }
+  auto begin = offset_of(fd.get(), first);
+  auto end = offset_of(fd.get(), last);
+  if (!begin || !end) {
+    return std::nullopt;
+  }
+  return Lines{*begin, *end, count_lines()};
+}
+
+std::optional<size_t> LineIndex::offset_of(int fd, size_t line) const {
+  if (line >= indexed_lines_) {
+    if (line == indexed_lines_) {
+      return indexed_size_;
+    }
+    return file_size_;
+  }
+
+  size_t offset = samples_[line / sample_every_];
+  size_t skip = line % sample_every_;
+  if (skip == 0) {
+    return offset;
+  }
+
+  bool ok = scan_newlines(fd, offset, indexed_size_, [&](size_t newline) {
+    offset = newline + 1;
+    return --skip != 0;
+  });
+  if (!ok || skip != 0) {
+    return std::nullopt;
+  }
+  return offset;
+}
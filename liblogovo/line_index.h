@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Persistent index of line start offsets of a log file, sampled every
+// `sample_every` lines and kept in a sidecar file next to the other indexes.
+//
+// The index is brought up to date incrementally: as long as the file only
+// grows, just the appended bytes are scanned. If the file turns out to be a
+// different one (a different inode, e.g. after rotation) or to be truncated,
+// the index is rebuilt from scratch.
+//
+// Finding the offset of any line takes a single seek to the closest sample and
+// reading at most `sample_every` lines forward from there.
+//
+// All methods are thread-safe.
+class LineIndex {
+ public:
+  LineIndex(std::filesystem::path index_path, size_t sample_every);
+
+  // Indexes whatever was appended to the file at `log_path` since the last
+  // update. Returns false if the file can't be read.
+  bool update(const std::filesystem::path& log_path);
+
+  // Amount of lines in the file as of the last update, including the last
+  // line even if it's not terminated by a newline.
+  size_t line_count() const;
+
+  // Start offset of the given (zero-based) line. The line right past the last
+  // one starts at the end of file.
+  std::optional<size_t> line_offset(
+      const std::filesystem::path& log_path, size_t line) const;
+
+  struct Lines {
+    size_t begin;
+    size_t end;
+    // Amount of lines in the whole file, see `line_count`
+    size_t line_count;
+  };
+
+  // Updates the index and finds the offsets of the (zero-based) lines
+  // [first, last) in one go, so that they all come from the same state of the
+  // file even if it's rotated or truncated meanwhile. Returns nothing if the
+  // file can't be read.
+  std::optional<Lines> lines(
+      const std::filesystem::path& log_path, size_t first, size_t last);
+
+ private:
+  struct Header;
+
+  // These expect `mutex_` to be locked
+  bool update(int fd, const std::filesystem::path& log_path);
+  size_t count_lines() const;
+  std::optional<size_t> offset_of(int fd, size_t line) const;
+
+  void load();
+  void reset(uint64_t device, uint64_t inode);
+  bool save(size_t first_new_sample) const;
+
+  mutable std::mutex mutex_;
+  std::filesystem::path index_path_;
+  size_t sample_every_;
+  bool loaded_ = false;
+
+  uint64_t device_ = 0;
+  uint64_t inode_ = 0;
+  // Size of the file as of the last update
+  size_t file_size_ = 0;
+  // Everything up to the last newline is indexed, this is where it ends
+  size_t indexed_size_ = 0;
+  // Amount of newline-terminated lines in [0, indexed_size_)
+  size_t indexed_lines_ = 0;
+  // samples_[i] is the start offset of the line number `i * sample_every_`
+  std::vector<uint64_t> samples_;
+};
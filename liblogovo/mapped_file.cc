@@ -0,0 +1,113 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+std::optional<FileIdentity> file_identity(const std::filesystem::path& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+  return FileIdentity{st.st_dev, st.st_ino};
+}
+
+std::optional<MappedFile> MappedFile::open(
+    const std::filesystem::path& path, size_t headroom) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  size_t size = st.st_size;
+  FileIdentity identity{st.st_dev, st.st_ino};
+  size_t capacity = size + headroom;
+  if (capacity == 0) {
+    // Empty files can't be mapped, but there is nothing to read anyway
+    return MappedFile(std::make_shared<Mapping>(fd, nullptr, 0), 0, identity);
+  }
+  // Pages past the end of the file can be mapped as well, they just must not
+  // be touched until the file grows there
+  void* data = mmap(nullptr, capacity, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    spdlog::warn("Failed to map {}: {}", path.string(), strerror(errno));
+    ::close(fd);
+    return std::nullopt;
+  }
+  return MappedFile(
+      std::make_shared<Mapping>(fd, static_cast<const char*>(data), capacity),
+      size, identity);
+}
+
+MappedFile::MappedFile(std::shared_ptr<const Mapping> mapping, size_t size,
+    const FileIdentity& identity)
+    : mapping_(std::move(mapping)), size_(size), identity_(identity) {}
+
+MappedFile::Mapping::~Mapping() {
+  if (data != nullptr) {
+    munmap(const_cast<char*>(data), capacity);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+std::optional<MappedFile> MappedFile::with_size(size_t size) const {
+  if (size > mapping_->capacity) {
+    return std::nullopt;
+  }
+  return MappedFile(mapping_, size, identity_);
+}
+
+std::optional<std::string_view> MappedFile::read(size_t offset, size_t size) {
+  if (offset + size > size_) {
+    return std::nullopt;
+  }
+  if (size > 0 && (offset < window_begin_ || offset + size > window_end_) &&
+      !check_window(offset, offset + size)) {
+    return std::nullopt;
+  }
+  return std::string_view(mapping_->data + offset, size);
+}
+
+bool MappedFile::check_window(size_t begin, size_t end) {
+  struct stat st;
+  if (fstat(mapping_->fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < size_) {
+    spdlog::warn("File was truncated while being read");
+    return false;
+  }
+  // Reads normally go backwards, so the window is the one ending with the
+  // read, unless the read is past the previous window
+  if (window_end_ > 0 && begin >= window_end_) {
+    window_begin_ = begin;
+    window_end_ = std::max(end, std::min(size_, begin + WINDOW_SIZE));
+  } else {
+    window_begin_ = std::min(begin, end - std::min(end, WINDOW_SIZE));
+    window_end_ = end;
+  }
+
+  // Prefetch the part of the window the reads go on with, the one next to the
+  // read itself
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t prefetch_begin = window_begin_;
+  size_t prefetch_end = window_end_;
+  if (prefetch_end - prefetch_begin > WINDOW_SIZE) {
+    prefetch_begin = prefetch_end - WINDOW_SIZE;
+  }
+  prefetch_begin -= prefetch_begin % page_size;
+  madvise(const_cast<char*>(mapping_->data) + prefetch_begin,
+      prefetch_end - prefetch_begin, MADV_WILLNEED);
+  return true;
+}
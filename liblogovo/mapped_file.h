@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+// Which file a path leads to, regardless of the path: a file that is rotated
+// (renamed away and replaced) gets a new identity.
+struct FileIdentity {
+  uint64_t device = 0;
+  uint64_t inode = 0;
+
+  bool operator==(const FileIdentity&) const = default;
+};
+
+// Returns nullopt if the file can't be stat'ed
+std::optional<FileIdentity> file_identity(const std::filesystem::path& path);
+
+// Read-only memory mapping of a whole file, a `BlockSource` for `tail()` that
+// yields lines right out of the page cache without copying them anywhere.
+//
+// Log files are normally only appended to, but rotation by truncation
+// (logrotate's copytruncate) happens as well, and touching pages past the end
+// of file raises SIGBUS. Reads are checked against the size of the file once
+// per window of `WINDOW_SIZE` bytes rather than on every block: a read outside
+// of the window last checked stats the file, fails if it has shrunk, and moves
+// the window to where the read is. A file truncated while a window of it is
+// being read still raises SIGBUS, it's only caught between the windows.
+//
+// Since `tail()` walks files backwards, the kernel's (forward) readahead is of
+// little use here. Instead, every new window is prefetched with
+// MADV_WILLNEED, so that it's likely already in memory once `tail()` gets to
+// it.
+//
+// Copies share the mapping (and the file descriptor), which is unmapped once
+// the last of them is gone. A copy may see a different size of the file, as
+// long as the mapping covers it (see `with_size`), so a mapping made with some
+// headroom past the end of a log file can serve it for a while as it grows.
+class MappedFile {
+ public:
+  static constexpr bool CONTIGUOUS = true;
+  static constexpr size_t WINDOW_SIZE = 4 * 1024 * 1024;
+
+  // Maps `headroom` more bytes past the end of the file. Returns nullopt if the
+  // file can't be opened or mapped.
+  static std::optional<MappedFile> open(
+      const std::filesystem::path& path, size_t headroom = 0);
+
+  size_t size() const { return size_; }
+  const FileIdentity& identity() const { return identity_; }
+  // Start of the mapping, to tell offsets of the views `read` returns
+  const char* data() const { return mapping_->data; }
+  // The file itself, e.g. to `sendfile` parts of it
+  int fd() const { return mapping_->fd; }
+
+  // The same file as of `size` bytes (e.g. once it has grown), sharing the
+  // mapping. Returns nullopt if the mapping doesn't cover that many.
+  std::optional<MappedFile> with_size(size_t size) const;
+
+  // Returns nullopt if `offset + size` is past the size of the file, or if the
+  // file turns out to have been truncated since (see above).
+  std::optional<std::string_view> read(size_t offset, size_t size);
+
+ private:
+  struct Mapping {
+    Mapping(int fd, const char* data, size_t capacity)
+        : fd(fd), data(data), capacity(capacity) {}
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping();
+
+    int fd;
+    const char* data;
+    // Bytes mapped, the file may be smaller
+    size_t capacity;
+  };
+
+  MappedFile(std::shared_ptr<const Mapping> mapping, size_t size,
+      const FileIdentity& identity);
+
+  // Checks that [begin, end) is still in the file, and moves the window there
+  bool check_window(size_t begin, size_t end);
+
+  std::shared_ptr<const Mapping> mapping_;
+  size_t size_ = 0;
+  FileIdentity identity_;
+  // Reads within [window_begin_, window_end_) need no checks
+  size_t window_begin_ = 0;
+  size_t window_end_ = 0;
+};
+
+// Maps the file at a path one way or another (like `MappedFile::open`, or
+// through a `FileCache`)
+using MapFile =
+    std::function<std::optional<MappedFile>(const std::filesystem::path&)>;
@@ -0,0 +1,83 @@
+#include "memory_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+
+namespace {
+
+constexpr size_t MIN_SHIFT = 6;
+constexpr size_t MAX_SHIFT = 18;
+constexpr size_t MAX_BLOCK = size_t(1) << MAX_SHIFT;
+// A list keeps up to this many bytes of blocks, but at least `MIN_BLOCKS`
+constexpr size_t LIST_BYTES = 512 * 1024;
+constexpr size_t MIN_BLOCKS = 4;
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct FreeList {
+  FreeBlock* head = nullptr;
+  size_t count = 0;
+};
+
+// Set once the lists of the thread are gone, blocks freed by destructors of
+// other thread-locals go right to the heap then. Trivially destructible, so
+// it's there till the very end.
+thread_local bool lists_gone = false;
+
+struct ThreadLists {
+  std::array<FreeList, MAX_SHIFT - MIN_SHIFT + 1> lists;
+
+  ~ThreadLists() {
+    lists_gone = true;
+    for (auto& list : lists) {
+      while (list.head) {
+        ::operator delete(std::exchange(list.head, list.head->next));
+      }
+    }
+  }
+};
+
+thread_local ThreadLists thread_lists;
+
+// Index of the list of blocks of `size` bytes
+size_t size_class(size_t size) {
+  return std::max<size_t>(std::bit_width(std::max<size_t>(size, 1) - 1),
+             MIN_SHIFT) -
+         MIN_SHIFT;
+}
+
+}  // namespace
+
+void* pool_allocate(size_t size) {
+  if (size > MAX_BLOCK) {
+    return ::operator new(size);
+  }
+  size_t index = size_class(size);
+  if (!lists_gone) {
+    auto& list = thread_lists.lists[index];
+    if (list.head) {
+      --list.count;
+      return std::exchange(list.head, list.head->next);
+    }
+  }
+  return ::operator new(size_t(1) << (index + MIN_SHIFT));
+}
+
+void pool_deallocate(void* block, size_t size) noexcept {
+  if (size > MAX_BLOCK || lists_gone) {
+    ::operator delete(block);
+    return;
+  }
+  size_t index = size_class(size);
+  auto& list = thread_lists.lists[index];
+  if (list.count >= std::max(MIN_BLOCKS, LIST_BYTES >> (index + MIN_SHIFT))) {
+    ::operator delete(block);
+    return;
+  }
+  list.head = ::new (block) FreeBlock{list.head};
+  ++list.count;
+}
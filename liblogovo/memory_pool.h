@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+
+// Per-thread free lists of the memory every request allocates and frees again:
+// coroutine frames of the line generators, buffers and batches of lines,
+// newline bitmaps. Blocks come in power-of-two sizes from 64 bytes to 256 KiB
+// (larger ones go right to the heap), and a freed block goes to the list of
+// the thread that frees it, which may not be the one that allocated it. Each
+// list keeps up to 512 KiB of blocks (but at least 4), the rest is freed, so
+// the memory a thread holds on to is bounded by what it used at once.
+//
+// With the lists warmed up, the steady-state request path recycles its memory
+// instead of going to the heap and touching fresh pages every time.
+void* pool_allocate(size_t size);
+// `size` is the one the block was allocated with
+void pool_deallocate(void* block, size_t size) noexcept;
+
+// Standard allocator on top of the pool. It's stateless, so coroutines don't
+// keep a copy of it in their frames.
+template <typename T>
+struct PoolAllocator {
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool_allocate(n * sizeof(T)));
+  }
+  void deallocate(T* block, size_t n) noexcept {
+    pool_deallocate(block, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const noexcept {
+    return true;
+  }
+};
+
+using PooledString =
+    std::basic_string<char, std::char_traits<char>, PoolAllocator<char>>;
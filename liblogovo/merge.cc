@@ -0,0 +1,198 @@
+#include "merge.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <queue>
+#include <string>
+#include <system_error>
+
+#include "tail.h"
+
+namespace {
+
+// Lines of a file read in one go, newest first. Lines are grouped into
+// entries: a line with a timestamp, and the lines without one right after it
+// (i.e. before it, in the order lines are read).
+struct Batch {
+  std::vector<std::string_view> lines;
+  // Timestamp of every entry, and the end of its lines in `lines`
+  std::vector<std::pair<Timestamp, size_t>> entries;
+  // Whether the file has no more lines after this batch
+  bool last = false;
+};
+
+// Reads batches of lines of a file. Batches may be read on another thread,
+// but only one at a time.
+class FileReader {
+ public:
+  FileReader(MappedFile file, size_t n, std::optional<Grep> grep,
+      const TimestampParser& parser, ScanBudget* budget)
+      : file_(std::move(file)),
+        lines_(tail(file_, n, std::move(grep), {}, nullptr, budget)),
+        parser_(parser) {}
+
+  // Stops at the end of an entry once there are `BATCH_LINES` lines, so that
+  // an entry is never split between batches
+  Batch read_batch() {
+    Batch result;
+    for (;;) {
+      if (!current_) {
+        current_ = lines_.begin();
+      } else {
+        ++*current_;
+      }
+      if (*current_ == lines_.end()) {
+        // Lines at the start of the file that have no timestamp at all go
+        // after everything else
+        size_t entries_end =
+            result.entries.empty() ? 0 : result.entries.back().second;
+        if (entries_end != result.lines.size()) {
+          result.entries.emplace_back(Timestamp::min(), result.lines.size());
+        }
+        result.last = true;
+        return result;
+      }
+      auto line = **current_;
+      if (line.empty()) {
+        // A pause of the budget
+        continue;
+      }
+      result.lines.push_back(line);
+      if (auto timestamp = parser_.parse(line)) {
+        result.entries.emplace_back(*timestamp, result.lines.size());
+        if (result.lines.size() >= merge_detail::BATCH_LINES) {
+          return result;
+        }
+      }
+    }
+  }
+
+ private:
+  MappedFile file_;
+  std::generator<std::string_view> lines_;
+  std::optional<std::generator<std::string_view>::iterator> current_;
+  const TimestampParser& parser_;
+};
+
+}  // namespace
+
+std::vector<std::filesystem::path> glob_files(
+    const std::filesystem::path& dir, std::string_view pattern) {
+  std::vector<std::filesystem::path> result;
+  std::string pattern_string(pattern);
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    auto name = entry.path().filename().string();
+    if (fnmatch(pattern_string.c_str(), name.c_str(), 0) == 0 &&
+        entry.is_regular_file(ec)) {
+      result.push_back(entry.path());
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::generator<std::string_view> merged_tail(std::vector<MappedFile> files,
+    size_t n, std::optional<Grep> grep, const TimestampParser& parser,
+    ScanPool* pool, ScanBudget* budget) {
+  if (n == 0) {
+    co_return;
+  }
+
+  struct Source {
+    // The reader's generator refers to the file it holds, so it's never moved
+    Source(MappedFile file, size_t n, const std::optional<Grep>& grep,
+        const TimestampParser& parser, ScanBudget* budget)
+        : reader(std::move(file), n, grep, parser, budget) {}
+
+    FileReader reader;
+    Batch batch;
+    // Next entry of the batch to yield, and the first line of it
+    size_t entry = 0;
+    size_t line = 0;
+    // Batch being read on the pool
+    std::future<Batch> ahead;
+  };
+  std::vector<std::unique_ptr<Source>> sources;
+  sources.reserve(files.size());
+  for (auto& file : files) {
+    sources.push_back(
+        std::make_unique<Source>(std::move(file), n, grep, parser, budget));
+  }
+  // Batches being read ahead look into the sources, so they have to be done
+  // before the sources are gone
+  struct WaitForBatches {
+    std::vector<std::unique_ptr<Source>>& sources;
+    ~WaitForBatches() {
+      for (auto& source : sources) {
+        if (source->ahead.valid()) {
+          source->ahead.wait();
+        }
+      }
+    }
+  } wait_for_batches{sources};
+
+  auto read_ahead = [&](Source& source) {
+    if (!pool) {
+      return;
+    }
+    auto task = std::make_shared<std::packaged_task<Batch()>>(
+        [&reader = source.reader] { return reader.read_batch(); });
+    source.ahead = task->get_future();
+    pool->post([task] { (*task)(); });
+  };
+  // Returns false if the file has no more entries
+  auto next_batch = [&](Source& source) {
+    if (source.batch.last) {
+      return false;
+    }
+    source.batch = source.ahead.valid() ? source.ahead.get()
+                                        : source.reader.read_batch();
+    source.entry = 0;
+    source.line = 0;
+    if (!source.batch.last) {
+      read_ahead(source);
+    }
+    return !source.batch.entries.empty();
+  };
+
+  // Newest entry on top, files that go first in the list win ties
+  auto newer = [&](size_t a, size_t b) {
+    auto& source_a = *sources[a];
+    auto& source_b = *sources[b];
+    auto timestamp_a = source_a.batch.entries[source_a.entry].first;
+    auto timestamp_b = source_b.batch.entries[source_b.entry].first;
+    return timestamp_a != timestamp_b ? timestamp_a < timestamp_b : a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(newer)> heap(
+      newer);
+
+  // The first batches of all files are read at once
+  for (auto& source : sources) {
+    read_ahead(*source);
+  }
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (next_batch(*sources[i])) {
+      heap.push(i);
+    }
+  }
+
+  while (!heap.empty()) {
+    auto i = heap.top();
+    heap.pop();
+    auto& source = *sources[i];
+    auto end = source.batch.entries[source.entry].second;
+    for (; source.line < end; ++source.line) {
+      co_yield source.batch.lines[source.line];
+      if (--n == 0) {
+        co_return;
+      }
+    }
+    if (++source.entry < source.batch.entries.size() || next_batch(source)) {
+      heap.push(i);
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "grep.h"
+#include "mapped_file.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
+#include "timestamp.h"
+#include "vendor/generator.h"
+
+// Regular files in `dir` whose names match a shell wildcard `pattern` (`*`,
+// `?` and `[...]`), sorted by name
+std::vector<std::filesystem::path> glob_files(
+    const std::filesystem::path& dir, std::string_view pattern);
+
+namespace merge_detail {
+
+// Files are read ahead in batches of up to this many lines
+constexpr size_t BATCH_LINES = 1024;
+
+}  // namespace merge_detail
+
+// Last `n` lines of several log files (optionally having a hit for `grep`)
+// merged into one sequence, newest first by the timestamps at the start of the
+// lines.
+//
+// Every file is read by its own `tail()` generator, and a heap picks the file
+// with the newest pending line every time. Lines without a timestamp (like
+// continuation lines of multi-line messages) go with the closest line before
+// them that has one. Lines of a file are read ahead in batches of up to
+// `BATCH_LINES` lines, on `pool` if given, so that reading one file overlaps
+// with merging the others. Memory taken is bounded by the amount of files and
+// the batch size, not by the sizes of the files.
+//
+// The parser (and the `budget`, if given) must stay valid while the generator
+// object is alive. Pauses of the budget aren't passed on, since files are
+// read ahead anyway.
+std::generator<std::string_view> merged_tail(std::vector<MappedFile> files,
+    size_t n, std::optional<Grep> grep, const TimestampParser& parser,
+    ScanPool* pool = nullptr, ScanBudget* budget = nullptr);
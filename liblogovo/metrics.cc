@@ -0,0 +1,142 @@
+#include "metrics.h"
+
+#include <fmt/format.h>
+
+namespace {
+
+constexpr std::string_view PREFIX = "logovo_";
+
+void render_header(std::string& out, std::string_view name,
+    std::string_view type, std::string_view help) {
+  fmt::format_to(std::back_inserter(out), "# HELP {}{} {}\n# TYPE {}{} {}\n",
+      PREFIX, name, help, PREFIX, name, type);
+}
+
+template <typename Metric>
+void render_value(std::string& out, std::string_view name,
+    std::string_view type, std::string_view help, const Metric& metric) {
+  render_header(out, name, type, help);
+  fmt::format_to(
+      std::back_inserter(out), "{}{} {}\n", PREFIX, name, metric.value());
+}
+
+void render_histogram(std::string& out, std::string_view name,
+    std::string_view help, const Histogram& histogram) {
+  render_header(out, name, "histogram", help);
+  auto snapshot = histogram.snapshot();
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < Histogram::BOUNDS.size(); ++i) {
+    cumulative += snapshot.counts[i];
+    fmt::format_to(std::back_inserter(out), "{}{}_bucket{{le=\"{}\"}} {}\n",
+        PREFIX, name, Histogram::BOUNDS[i], cumulative);
+  }
+  fmt::format_to(std::back_inserter(out),
+      "{}{}_bucket{{le=\"+Inf\"}} {}\n{}{}_sum {}\n{}{}_count {}\n", PREFIX,
+      name, snapshot.count, PREFIX, name,
+      std::chrono::duration<double>(snapshot.sum).count(), PREFIX, name,
+      snapshot.count);
+}
+
+}  // namespace
+
+size_t metrics_detail::shard_index() {
+  static std::atomic<size_t> next_index = 0;
+  thread_local size_t index =
+      next_index.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+  return index;
+}
+
+uint64_t Counter::value() const {
+  uint64_t result = 0;
+  for (const auto& shard : shards_) {
+    result += shard.value.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+void Histogram::observe(std::chrono::nanoseconds duration) {
+  double seconds = std::chrono::duration<double>(duration).count();
+  size_t bucket = 0;
+  while (bucket < BOUNDS.size() && seconds > BOUNDS[bucket]) {
+    ++bucket;
+  }
+  auto& shard = shards_[metrics_detail::shard_index()];
+  shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  shard.sum_ns.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+  Snapshot result;
+  for (const auto& shard : shards_) {
+    for (size_t i = 0; i < shard.counts.size(); ++i) {
+      auto count = shard.counts[i].load(std::memory_order_relaxed);
+      result.counts[i] += count;
+      result.count += count;
+    }
+    result.sum +=
+        std::chrono::nanoseconds(shard.sum_ns.load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+std::string Metrics::render() const {
+  std::string out;
+  render_value(out, "requests_total", "counter", "Requests handled", requests);
+  render_histogram(out, "request_duration_seconds",
+      "Time from reading a request to sending the whole response",
+      request_duration);
+  render_histogram(out, "time_to_first_byte_seconds",
+      "Time from reading a request to sending the first bytes of the response",
+      time_to_first_byte);
+  render_value(out, "response_bytes_sent_total", "counter",
+      "Bytes of responses sent", bytes_sent);
+  render_value(out, "response_bytes_sent_zero_copy_total", "counter",
+      "Bytes of responses sent right from the page cache", zero_copy_bytes);
+  render_value(out, "write_stalls_total", "counter",
+      "Writes that had to wait for the client to catch up", write_stalls);
+  render_histogram(out, "write_stall_duration_seconds",
+      "Time writes waited for the client to catch up", write_stall_duration);
+  render_value(out, "active_sessions", "gauge", "Open client connections",
+      active_sessions);
+  render_value(out, "compressed_responses_total", "counter",
+      "Responses compressed", compressed_responses);
+  render_value(out, "compression_fallbacks_total", "counter",
+      "Responses sent uncompressed because of the compression CPU budget",
+      compression_fallbacks);
+  render_value(out, "blocks_read_total", "counter",
+      "Blocks of log files read by tail", blocks_read);
+  render_value(out, "bytes_read_total", "counter",
+      "Bytes of log files read by tail", bytes_read);
+  render_value(out, "grep_searches_total", "counter",
+      "Searches for a grep pattern in a part of a log file", grep_searches);
+  render_value(out, "grep_hits_total", "counter",
+      "Searches for a grep pattern that found a line", grep_hits);
+  render_value(out, "grep_skipped_bytes_total", "counter",
+      "Bytes of log files grep ruled out by trigram indexes",
+      grep_skipped_bytes);
+  render_value(out, "result_cache_hits_total", "counter",
+      "Requests that reused a cached result", result_cache_hits);
+  render_value(out, "result_cache_misses_total", "counter",
+      "Requests that could not reuse a cached result", result_cache_misses);
+  render_value(out, "result_cache_bytes", "gauge",
+      "Memory taken by cached results", result_cache_bytes);
+  render_value(out, "file_cache_hits_total", "counter",
+      "Requests that found their file mapped already", file_cache_hits);
+  render_value(out, "file_cache_misses_total", "counter",
+      "Requests that had to map their file", file_cache_misses);
+  render_histogram(out, "scan_queue_wait_seconds",
+      "Time scans waited in the admission queue", scan_queue_wait);
+  render_value(out, "scans_rejected_total", "counter",
+      "Scans rejected by admission control", scans_rejected);
+  render_value(out, "scans_truncated_total", "counter",
+      "Responses cut short by their scan budget", scans_truncated);
+  render_value(out, "sessions_rejected_total", "counter",
+      "Connections turned away because of the limit on sessions",
+      sessions_rejected);
+  return out;
+}
+
+Metrics& metrics() {
+  static Metrics result;
+  return result;
+}
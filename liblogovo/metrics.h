@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Counters and histograms behind the `/metrics` endpoint.
+//
+// Metrics are updated on hot paths by all the serving threads, so updates are
+// lock-free and don't share cache lines between threads: every metric is split
+// into shards, and each thread updates its own shard (threads are assigned
+// shards round-robin). Reading a metric sums the shards up.
+
+namespace metrics_detail {
+
+constexpr size_t SHARDS = 16;
+
+// Shard of the calling thread
+size_t shard_index();
+
+}  // namespace metrics_detail
+
+class Counter {
+ public:
+  void add(uint64_t value = 1) {
+    shards_[metrics_detail::shard_index()].value.fetch_add(
+        value, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value = 0;
+  };
+  std::array<Shard, metrics_detail::SHARDS> shards_;
+};
+
+// Value that goes both up and down. Not sharded: it's meant for things that
+// change once per connection or so.
+class Gauge {
+ public:
+  void add(int64_t value) {
+    value_.fetch_add(value, std::memory_order_relaxed);
+  }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_ = 0;
+};
+
+// Distribution of durations over a fixed set of buckets, from 100 us to 10 s
+class Histogram {
+ public:
+  // Upper bounds of the buckets, in seconds. There is one more bucket for
+  // everything above the last one.
+  static constexpr std::array<double, 13> BOUNDS = {0.0001, 0.00025, 0.0005,
+      0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.5, 1, 10};
+
+  void observe(std::chrono::nanoseconds duration);
+
+  struct Snapshot {
+    // Not cumulative
+    std::array<uint64_t, BOUNDS.size() + 1> counts{};
+    uint64_t count = 0;
+    std::chrono::nanoseconds sum{0};
+  };
+  Snapshot snapshot() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, BOUNDS.size() + 1> counts{};
+    std::atomic<uint64_t> sum_ns = 0;
+  };
+  std::array<Shard, metrics_detail::SHARDS> shards_;
+};
+
+// Writes that take longer than this are considered stalled: the data didn't
+// fit into the socket buffer and had to wait for the client
+constexpr auto WRITE_STALL_THRESHOLD = std::chrono::milliseconds(1);
+
+// All the metrics of the server
+struct Metrics {
+  Counter requests;
+  Histogram request_duration;
+  Histogram time_to_first_byte;
+  Counter bytes_sent;
+  // Part of `bytes_sent` sent right from the page cache, with sendfile
+  Counter zero_copy_bytes;
+  // A write stalls if the socket doesn't take the data right away, i.e. the
+  // client (or the network) is slower than the server
+  Counter write_stalls;
+  Histogram write_stall_duration;
+  Gauge active_sessions;
+  // Responses compressed, and the ones sent as is because compression took
+  // too much CPU time already
+  Counter compressed_responses;
+  Counter compression_fallbacks;
+
+  Counter blocks_read;
+  Counter bytes_read;
+  // Searches of a grep pattern in a piece of a file, and the ones that found
+  // a matching line
+  Counter grep_searches;
+  Counter grep_hits;
+  // Bytes filtered scans didn't read, by trigram indexes
+  Counter grep_skipped_bytes;
+  // Requests for the last lines of a file that reused a cached result (only
+  // reading what was appended since), the ones that read the file anew, and
+  // the memory the cached results take
+  Counter result_cache_hits;
+  Counter result_cache_misses;
+  Gauge result_cache_bytes;
+  // Requests that found their file mapped already, and the ones that had to
+  // map it (see `FileCache`)
+  Counter file_cache_hits;
+  Counter file_cache_misses;
+
+  // Time scans waited in the admission queue, scans rejected by admission
+  // control, and responses cut short by their scan budget (see `Admission`,
+  // `ScanBudget`)
+  Histogram scan_queue_wait;
+  Counter scans_rejected;
+  Counter scans_truncated;
+  // Connections turned away because of the limit on sessions
+  Counter sessions_rejected;
+
+  // Text exposition format of Prometheus
+  std::string render() const;
+};
+
+Metrics& metrics();
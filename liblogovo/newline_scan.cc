@@ -0,0 +1,148 @@
+#include "newline_scan.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using Implementation = void (*)(const char*, size_t, uint64_t*);
+
+void find_newlines_scalar_word(const char* data, size_t size, uint64_t* bits) {
+  uint64_t word = 0;
+  for (size_t i = 0; i < size; ++i) {
+    word |= static_cast<uint64_t>(data[i] == '\n') << i;
+  }
+  *bits = word;
+}
+
+struct Dispatch {
+  Implementation implementation;
+  std::string_view name;
+};
+
+Dispatch pick_implementation() {
+#if defined(NEWLINE_SCAN_HAS_X86)
+  if (cpu_supports_avx2()) {
+    return {find_newlines_avx2, "avx2"};
+  }
+  return {find_newlines_sse2, "sse2"};
+#else
+  return {find_newlines_scalar, "scalar"};
+#endif
+}
+
+const Dispatch& dispatch() {
+  static const Dispatch result = pick_implementation();
+  return result;
+}
+
+}  // namespace
+
+void find_newlines(const char* data, size_t size, uint64_t* bits) {
+  dispatch().implementation(data, size, bits);
+}
+
+std::string_view find_newlines_implementation() { return dispatch().name; }
+
+void find_newlines_scalar(const char* data, size_t size, uint64_t* bits) {
+  for (size_t i = 0; i < size; i += 64) {
+    find_newlines_scalar_word(data + i, std::min<size_t>(64, size - i), bits++);
+  }
+}
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+
+bool cpu_supports_avx2() { return __builtin_cpu_supports("avx2"); }
+
+__attribute__((target("sse2"))) void find_newlines_sse2(
+    const char* data, size_t size, uint64_t* bits) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    uint64_t word = 0;
+    for (size_t lane = 0; lane < 4; ++lane) {
+      auto chunk = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(data + i + lane * 16));
+      auto mask = static_cast<uint32_t>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+      word |= static_cast<uint64_t>(mask) << (lane * 16);
+    }
+    *bits++ = word;
+  }
+  if (i < size) {
+    find_newlines_scalar_word(data + i, size - i, bits);
+  }
+}
+
+__attribute__((target("avx2"))) void find_newlines_avx2(
+    const char* data, size_t size, uint64_t* bits) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    auto high =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+    auto low_mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline)));
+    auto high_mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)));
+    *bits++ = static_cast<uint64_t>(high_mask) << 32 | low_mask;
+  }
+  if (i < size) {
+    find_newlines_scalar_word(data + i, size - i, bits);
+  }
+}
+
+#endif
+
+NewlineBitmap::NewlineBitmap(size_t capacity)
+    : words_((capacity + 63) / 64) {}
+
+void NewlineBitmap::scan(std::string_view block) {
+  assert(block.size() <= words_.size() * 64);
+  size_ = block.size();
+  find_newlines(block.data(), block.size(), words_.data());
+}
+
+std::optional<size_t> NewlineBitmap::find_last_before(size_t pos) const {
+  pos = std::min(pos, size_);
+  if (pos == 0) {
+    return std::nullopt;
+  }
+  // Look at bits [0, pos), starting from the word holding `pos - 1`
+  size_t last = pos - 1;
+  size_t word_index = last / 64;
+  uint64_t word = words_[word_index] & (~uint64_t{0} >> (63 - last % 64));
+  for (;;) {
+    if (word != 0) {
+      return word_index * 64 + 63 - std::countl_zero(word);
+    }
+    if (word_index == 0) {
+      return std::nullopt;
+    }
+    word = words_[--word_index];
+  }
+}
+
+std::optional<size_t> NewlineBitmap::find_first_from(size_t pos) const {
+  if (pos >= size_) {
+    return std::nullopt;
+  }
+  size_t word_index = pos / 64;
+  size_t word_count = (size_ + 63) / 64;
+  uint64_t word = words_[word_index] & (~uint64_t{0} << (pos % 64));
+  for (;;) {
+    if (word != 0) {
+      return word_index * 64 + std::countr_zero(word);
+    }
+    if (++word_index == word_count) {
+      return std::nullopt;
+    }
+    word = words_[word_index];
+  }
+}
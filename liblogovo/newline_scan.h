@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "memory_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEWLINE_SCAN_HAS_X86 1
+#endif
+
+// Fills `bits` (which must have room for `(size + 63) / 64` words) with a
+// bitmap of '\n' positions in `data`: bit `i % 64` of word `i / 64` is set iff
+// `data[i] == '\n'`. Dispatches at runtime to the widest implementation the CPU
+// supports.
+void find_newlines(const char* data, size_t size, uint64_t* bits);
+
+// Individual implementations behind `find_newlines`, exposed for tests and
+// benchmarks.
+void find_newlines_scalar(const char* data, size_t size, uint64_t* bits);
+#if defined(NEWLINE_SCAN_HAS_X86)
+void find_newlines_sse2(const char* data, size_t size, uint64_t* bits);
+void find_newlines_avx2(const char* data, size_t size, uint64_t* bits);
+bool cpu_supports_avx2();
+#endif
+
+// Name of the implementation `find_newlines` dispatches to.
+std::string_view find_newlines_implementation();
+
+// Positions of all newlines in a block of data. The block is classified once
+// (with SIMD where available) so that walking lines backwards doesn't have to
+// look at every byte again: locating the neighbouring newline of a position is
+// a couple of bit operations per 64 bytes of data.
+class NewlineBitmap {
+ public:
+  // `capacity` is the maximum size of a block that can be scanned
+  explicit NewlineBitmap(size_t capacity);
+
+  void scan(std::string_view block);
+
+  // Position of the last newline strictly before `pos`, if any
+  std::optional<size_t> find_last_before(size_t pos) const;
+  // Position of the first newline at or after `pos`, if any
+  std::optional<size_t> find_first_from(size_t pos) const;
+
+ private:
+  std::vector<uint64_t, PoolAllocator<uint64_t>> words_;
+  size_t size_ = 0;
+};
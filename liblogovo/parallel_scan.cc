@@ -0,0 +1,172 @@
+#include "parallel_scan.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <memory>
+
+#include "metrics.h"
+
+namespace {
+
+using ChunkLines = std::vector<std::pair<size_t, size_t>>;
+
+// Start of the first line starting at or after `pos`
+size_t next_line_start(std::string_view data, size_t pos) {
+  if (pos == 0 || pos >= data.size()) {
+    return std::min(pos, data.size());
+  }
+  auto newline = data.find('\n', pos - 1);
+  return newline == std::string_view::npos ? data.size() : newline + 1;
+}
+
+}  // namespace
+
+ChunkLines grep_chunk(std::string_view data, size_t chunk_begin,
+    size_t chunk_end, const Grep& grep, size_t n,
+    const std::atomic<bool>& cancelled) {
+  ChunkLines result;
+  size_t lines_begin = next_line_start(data, chunk_begin);
+  size_t lines_end = next_line_start(data, chunk_end);
+  if (lines_begin < lines_end && !cancelled.load(std::memory_order_relaxed)) {
+    metrics().blocks_read.add();
+    metrics().bytes_read.add(lines_end - lines_begin);
+  }
+  while (result.size() < n && lines_begin < lines_end &&
+         !cancelled.load(std::memory_order_relaxed)) {
+    auto hit =
+        grep.find_last(data.substr(lines_begin, lines_end - lines_begin));
+    metrics().grep_searches.add();
+    if (!hit) {
+      break;
+    }
+    metrics().grep_hits.add();
+    size_t hit_offset = lines_begin + *hit;
+    // `lines_begin` is a line start, so the newline before it (if any) stops
+    // the search
+    auto previous_newline =
+        hit_offset == 0 ? std::string_view::npos
+                        : data.rfind('\n', hit_offset - 1);
+    size_t line_start =
+        previous_newline == std::string_view::npos ? 0 : previous_newline + 1;
+    auto next_newline = data.find('\n', hit_offset);
+    size_t line_end = next_newline == std::string_view::npos
+                          ? lines_end
+                          : std::min(next_newline + 1, lines_end);
+    result.emplace_back(line_start, line_end);
+    lines_end = line_start;
+  }
+  return result;
+}
+
+std::generator<std::string_view> parallel_grep(std::string_view data,
+    size_t n, Grep grep, ScanPool& pool, size_t chunk_size,
+    ScanBudget* budget, std::function<bool(size_t, size_t)> may_have_hits) {
+  if (n == 0 || data.empty()) {
+    co_return;
+  }
+
+  // Shared with the tasks, which may outlive the generator for a bit
+  struct State {
+    Grep grep;
+    std::atomic<bool> cancelled = false;
+  };
+  auto state = std::make_shared<State>(std::move(grep));
+
+  // Search of a chunk, run by the pool or by the consumer itself, whichever
+  // gets to it first
+  struct Task {
+    std::packaged_task<ChunkLines()> search;
+    std::atomic<bool> started = false;
+
+    void run() {
+      if (!started.exchange(true)) {
+        search();
+      }
+    }
+  };
+  struct Chunk {
+    size_t begin;
+    size_t end;
+    std::shared_ptr<Task> task;
+    std::future<ChunkLines> lines;
+  };
+  std::deque<Chunk> in_flight;
+  // Tasks look into `data`, so they have to be done before the generator is
+  // gone (and whatever `data` points into along with it). Those the pool
+  // hasn't got to yet are cancelled right here rather than waited for.
+  struct WaitForTasks {
+    std::deque<Chunk>& chunks;
+    std::atomic<bool>& cancelled;
+    ~WaitForTasks() {
+      cancelled = true;
+      for (auto& chunk : chunks) {
+        chunk.task->run();
+        chunk.lines.wait();
+      }
+    }
+  } wait_for_tasks{in_flight, state->cancelled};
+
+  // Chunks [0, next_chunk) are yet to be searched
+  size_t next_chunk = (data.size() + chunk_size - 1) / chunk_size;
+  size_t max_in_flight = std::max<size_t>(pool.size(), 1) * 2;
+  // Starts with a couple of chunks, and doubles every time the chunks searched
+  // so far don't have enough lines, so that asking for a few lines that are
+  // near the end doesn't search much more than that
+  size_t window = std::min<size_t>(2, max_in_flight);
+  auto submit = [&] {
+    size_t begin = (next_chunk - 1) * chunk_size;
+    size_t end = std::min(begin + chunk_size, data.size());
+    --next_chunk;
+    if (may_have_hits &&
+        !may_have_hits(next_line_start(data, begin),
+            next_line_start(data, end))) {
+      metrics().grep_skipped_bytes.add(end - begin);
+      return;
+    }
+    auto task = std::make_shared<Task>(std::packaged_task<ChunkLines()>(
+        [state, data, begin, end, n] {
+          return grep_chunk(data, begin, end, state->grep, n, state->cancelled);
+        }));
+    in_flight.push_back({begin, end, task, task->search.get_future()});
+    pool.post([task] { task->run(); });
+  };
+
+  // Chunks that are ruled out don't take a place in flight
+  auto fill = [&] {
+    while (next_chunk > 0 && in_flight.size() < window) {
+      submit();
+    }
+  };
+
+  fill();
+  while (!in_flight.empty()) {
+    if (budget && budget->pause_due()) {
+      co_yield std::string_view();
+    }
+    auto& chunk = in_flight.front();
+    // Chunks are paid for once they are needed, those searched ahead but never
+    // got to don't count
+    if (budget && !budget->spend(chunk.end - chunk.begin)) {
+      // Chunks after this one are all yielded
+      budget->stop_at(next_line_start(data, chunk.end));
+      co_return;
+    }
+    // Searched right here if the pool hasn't started it yet, rather than
+    // waiting for it
+    chunk.task->run();
+    auto lines = chunk.lines.get();
+    in_flight.pop_front();
+    // Nothing more is needed if the chunk has enough lines
+    if (lines.size() < n) {
+      window = std::min(window * 2, max_in_flight);
+      fill();
+    }
+    for (auto [begin, end] : lines) {
+      co_yield data.substr(begin, end - begin);
+      if (--n == 0) {
+        co_return;
+      }
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "grep.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
+#include "vendor/generator.h"
+
+// Lines of `data` that have a hit for `grep` and start in
+// [chunk_begin, chunk_end), as [begin, end) offsets in `data`, newest first.
+// Stops after `n` lines, or once `cancelled` is set.
+//
+// A line belongs to the chunk it starts in, so a line crossing the end of the
+// chunk is searched in full by this chunk, and skipped by the next one.
+std::vector<std::pair<size_t, size_t>> grep_chunk(std::string_view data,
+    size_t chunk_begin, size_t chunk_end, const Grep& grep, size_t n,
+    const std::atomic<bool>& cancelled);
+
+// Last `n` lines of `data` having a hit for `grep`, newest first, like
+// `tail()` yields them, but with the data split into chunks of `chunk_size`
+// bytes that are searched in parallel on `pool`.
+//
+// Chunks are searched ahead of the one being yielded from, starting from the
+// end. Only a couple of them at first, and more (up to twice as many as the
+// pool has threads) as long as those don't have `n` lines. That keeps the
+// memory taken by the results per request bounded, and the work wasted when
+// the consumer doesn't need more lines small. The consumer searches the chunk
+// it needs next itself if the pool hasn't got to it yet, instead of waiting.
+// `data` must stay valid while the generator object is alive: it waits for
+// the chunks in progress before going away.
+//
+// Given a `budget`, chunks are paid for as they are consumed, like blocks in
+// `tail()`, so chunks searched ahead but never needed don't count. Once it
+// runs out, the generator stops, noting where (in `data`) in the budget.
+//
+// Chunks `may_have_hits` (if given) rules out aren't searched at all. It's
+// asked about the [begin, end) offsets in `data` of the lines of a chunk.
+std::generator<std::string_view> parallel_grep(std::string_view data,
+    size_t n, Grep grep, ScanPool& pool, size_t chunk_size,
+    ScanBudget* budget = nullptr,
+    std::function<bool(size_t, size_t)> may_have_hits = {});
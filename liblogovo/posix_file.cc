@@ -0,0 +1,54 @@
+#include "posix_file.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <utility>
+
+FileDescriptor::~FileDescriptor() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+FileDescriptor::FileDescriptor(FileDescriptor&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)) {}
+
+FileDescriptor& FileDescriptor::operator=(FileDescriptor&& other) noexcept {
+  std::swap(fd_, other.fd_);
+  return *this;
+}
+
+bool pread_exactly(int fd, void* data, size_t size, size_t offset) {
+  auto* out = static_cast<char*>(data);
+  while (size > 0) {
+    auto result = ::pread(fd, out, size, offset);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    out += result;
+    size -= result;
+    offset += result;
+  }
+  return true;
+}
+
+bool pwrite_exactly(int fd, const void* data, size_t size, size_t offset) {
+  const auto* in = static_cast<const char*>(data);
+  while (size > 0) {
+    auto result = ::pwrite(fd, in, size, offset);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    in += result;
+    size -= result;
+    offset += result;
+  }
+  return true;
+}
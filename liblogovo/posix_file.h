@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// File descriptor that is closed when going out of scope
+class FileDescriptor {
+ public:
+  FileDescriptor() = default;
+  explicit FileDescriptor(int fd) : fd_(fd) {}
+  ~FileDescriptor();
+
+  FileDescriptor(FileDescriptor&& other) noexcept;
+  FileDescriptor& operator=(FileDescriptor&& other) noexcept;
+
+  int get() const { return fd_; }
+  explicit operator bool() const { return fd_ >= 0; }
+
+ private:
+  int fd_ = -1;
+};
+
+// `pread`/`pwrite` that retry until the whole buffer is transferred. Return
+// false on errors and on reaching the end of file.
+bool pread_exactly(int fd, void* data, size_t size, size_t offset);
+bool pwrite_exactly(int fd, const void* data, size_t size, size_t offset);
@@ -0,0 +1,209 @@
+#include "result_cache.h"
+
+#include <fmt/format.h>
+
+#include <vector>
+
+#include "memory_pool.h"
+#include "metrics.h"
+#include "tail.h"
+
+// Bytes of a file before the end of a cached result that have to stay the same
+// for the result to be reused
+constexpr size_t FINGERPRINT_SIZE = 64;
+
+ResultCache::ResultCache(size_t max_size) : max_size_(max_size) {}
+
+std::shared_ptr<const ResultCache::Entry> ResultCache::find(
+    const std::string& key) {
+  std::lock_guard lock(mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  items_.splice(items_.begin(), items_, it->second);
+  return it->second->second;
+}
+
+void ResultCache::insert(
+    const std::string& key, std::shared_ptr<const Entry> entry) {
+  std::lock_guard lock(mutex_);
+  size_t old_size = size_;
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    size_ -= it->second->second->lines.size();
+    items_.erase(it->second);
+    index_.erase(it);
+  }
+  if (entry->lines.size() <= max_entry_size()) {
+    size_ += entry->lines.size();
+    items_.emplace_front(key, std::move(entry));
+    index_.emplace(key, items_.begin());
+  }
+  while (size_ > max_size_) {
+    size_ -= items_.back().second->lines.size();
+    index_.erase(items_.back().first);
+    items_.pop_back();
+  }
+  metrics().result_cache_bytes.add(
+      static_cast<int64_t>(size_) - static_cast<int64_t>(old_size));
+}
+
+size_t ResultCache::size() const {
+  std::lock_guard lock(mutex_);
+  return size_;
+}
+
+std::string result_cache_key(
+    std::string_view path, size_t n, const std::optional<Grep>& grep) {
+  // The path goes last, as it's the only part that may have any character
+  if (!grep) {
+    return fmt::format("{}\n{}", n, path);
+  }
+  std::string filter;
+  const auto& query = grep->query();
+  for (const auto* terms :
+       {&query.all, &query.any, &query.none, &query.regexes}) {
+    filter += fmt::format("{}\n", terms->size());
+    for (const auto& term : *terms) {
+      filter += fmt::format("{}\n{}", term.size(), term);
+    }
+  }
+  return fmt::format("{}\n{}\n{}\n{}{}", n, query.ignore_case ? 'i' : 'c',
+      filter.size(), filter, path);
+}
+
+namespace {
+
+// `cached_tail()` itself, with the coroutine frame from the memory pool
+std::generator<std::string_view> cached_tail(std::allocator_arg_t,
+    PoolAllocator<std::byte>, MappedFile& file, size_t n,
+    std::optional<Grep> grep, ResultCache& cache, std::string key,
+    ScanPool* pool, ScanBudget* budget, const TrigramSkip* skip) {
+  if (n == 0) {
+    co_return;
+  }
+  auto data = file.read(0, file.size());
+  if (!data) {
+    co_return;
+  }
+  auto last_newline = data->rfind('\n');
+  size_t complete_end =
+      last_newline == std::string_view::npos ? 0 : last_newline + 1;
+
+  auto cached = cache.find(key);
+  if (cached && cached->identity == file.identity() &&
+      cached->end <= complete_end &&
+      data->substr(cached->end - cached->fingerprint.size(),
+          cached->fingerprint.size()) == cached->fingerprint) {
+    metrics().result_cache_hits.add();
+  } else {
+    metrics().result_cache_misses.add();
+    cached.reset();
+  }
+
+  // Lines of the part of the file that isn't cached yet. They are collected
+  // (as views into the mapped file) before anything is yielded, so that the
+  // cache is updated even if the caller stops early. A result too large to be
+  // cached is streamed like any other.
+  auto lines = tail(file, n, grep,
+      FileRange{cached ? cached->end : 0, complete_end}, pool, budget, nullptr,
+      skip);
+  auto it = lines.begin();
+  std::vector<std::string_view, PoolAllocator<std::string_view>> fresh;
+  size_t fresh_size = 0;
+  for (; it != lines.end() && fresh_size <= cache.max_entry_size(); ++it) {
+    // Pauses of the budget can't be passed on before the lines are collected
+    if ((*it).empty()) {
+      continue;
+    }
+    fresh.push_back(*it);
+    fresh_size += fresh.back().size();
+  }
+
+  std::shared_ptr<const ResultCache::Entry> entry;
+  if (cached && cached->end == complete_end) {
+    // Nothing was appended, the cached result is the result
+    entry = std::move(cached);
+  } else if (it == lines.end() && !(budget && budget->exhausted())) {
+    auto fresh_entry = std::make_shared<ResultCache::Entry>();
+    entry = fresh_entry;
+    fresh_entry->identity = file.identity();
+    fresh_entry->end = complete_end;
+    size_t fingerprint_size = std::min(complete_end, FINGERPRINT_SIZE);
+    fresh_entry->fingerprint =
+        data->substr(complete_end - fingerprint_size, fingerprint_size);
+    fresh_entry->lines.reserve(fresh_size);
+    for (auto line : fresh) {
+      fresh_entry->lines += line;
+    }
+    fresh_entry->line_count = fresh.size();
+    if (cached) {
+      // Older lines are the newest ones of the cached result
+      size_t older_end = 0;
+      while (fresh_entry->line_count < n && older_end < cached->lines.size()) {
+        older_end = cached->lines.find('\n', older_end) + 1;
+        ++fresh_entry->line_count;
+      }
+      fresh_entry->lines.append(cached->lines, 0, older_end);
+    }
+    cache.insert(key, entry);
+  }
+
+  // The last line of the file if it's incomplete, which is never cached
+  for (auto line :
+      tail(file, n, grep, FileRange{complete_end, data->size()})) {
+    co_yield line;
+    if (--n == 0) {
+      co_return;
+    }
+  }
+
+  if (entry) {
+    std::string_view rest = entry->lines;
+    while (!rest.empty()) {
+      auto line_size = rest.find('\n') + 1;
+      co_yield rest.substr(0, line_size);
+      if (--n == 0) {
+        co_return;
+      }
+      rest.remove_prefix(line_size);
+    }
+    co_return;
+  }
+  for (auto line : fresh) {
+    co_yield line;
+    if (--n == 0) {
+      co_return;
+    }
+  }
+  for (; it != lines.end(); ++it) {
+    co_yield *it;
+    if (!(*it).empty() && --n == 0) {
+      co_return;
+    }
+  }
+  if (!cached || (budget && budget->exhausted())) {
+    co_return;
+  }
+  // Too much was appended to cache the result, but the older lines are still
+  // the cached ones
+  std::string_view older = cached->lines;
+  while (!older.empty()) {
+    auto line_size = older.find('\n') + 1;
+    co_yield older.substr(0, line_size);
+    if (--n == 0) {
+      co_return;
+    }
+    older.remove_prefix(line_size);
+  }
+}
+
+}  // namespace
+
+std::generator<std::string_view> cached_tail(MappedFile& file, size_t n,
+    std::optional<Grep> grep, ResultCache& cache, std::string key,
+    ScanPool* pool, ScanBudget* budget, const TrigramSkip* skip) {
+  return cached_tail(std::allocator_arg, PoolAllocator<std::byte>(), file, n,
+      std::move(grep), cache, std::move(key), pool, budget, skip);
+}
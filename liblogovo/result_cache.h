@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "grep.h"
+#include "mapped_file.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
+#include "trigram_index.h"
+#include "vendor/generator.h"
+
+// Results of recent tail requests, so that the same request repeated over and
+// over (e.g. by dashboards) doesn't read the file again every time.
+//
+// Log files are appended to, so a cached result is not thrown away once the
+// file grows: only the new part of the file is read, and its lines are put in
+// front of the cached ones. A result is only reused for the same file (see
+// `FileIdentity`) that still has the same data at the end of the part it was
+// made of, so rotated and truncated files are read anew.
+//
+// Results are kept in memory, least recently used ones are dropped once they
+// take more than `max_size` bytes.
+class ResultCache {
+ public:
+  // Last lines of [0, end) of a file, newest first. All of them end with a
+  // newline: the last line of a file that doesn't is left out, as it may yet
+  // grow.
+  struct Entry {
+    FileIdentity identity;
+    size_t end = 0;
+    // A few bytes of the file right before `end`, to tell whether the file
+    // still has the same data there
+    std::string fingerprint;
+    std::string lines;
+    size_t line_count = 0;
+  };
+
+  explicit ResultCache(size_t max_size);
+
+  std::shared_ptr<const Entry> find(const std::string& key);
+  // Entries larger than `max_entry_size()` are not kept
+  void insert(const std::string& key, std::shared_ptr<const Entry> entry);
+
+  size_t max_entry_size() const { return max_size_ / 8; }
+  // Bytes taken by the cached lines
+  size_t size() const;
+
+ private:
+  using Item = std::pair<std::string, std::shared_ptr<const Entry>>;
+
+  size_t max_size_;
+  mutable std::mutex mutex_;
+  // Most recently used first
+  std::list<Item> items_;
+  std::unordered_map<std::string, std::list<Item>::iterator> index_;
+  size_t size_ = 0;
+};
+
+// Key of the results of a request for the last `n` lines of a file
+std::string result_cache_key(
+    std::string_view path, size_t n, const std::optional<Grep>& grep);
+
+// Does what `tail(file, n, grep)` does, reusing and updating the result
+// cached under `key`. Results cut short by the `budget` aren't cached. `skip`
+// rules out parts of the file for `grep` (see `tail()`).
+std::generator<std::string_view> cached_tail(MappedFile& file, size_t n,
+    std::optional<Grep> grep, ResultCache& cache, std::string key,
+    ScanPool* pool = nullptr, ScanBudget* budget = nullptr,
+    const TrigramSkip* skip = nullptr);
@@ -0,0 +1,353 @@
+#include "rotated_logs.h"
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+
+#if defined(LOGOVO_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "posix_file.h"
+#include "scan_budget.h"
+
+namespace {
+
+constexpr std::string_view GZIP_SUFFIX = ".gz";
+constexpr std::string_view ZSTD_SUFFIX = ".zst";
+constexpr size_t DECOMPRESS_BUFFER_SIZE = 256 * 1024;
+
+// Generation number of `name` if it is `<log name>.<number>[.gz|.zst]`
+std::optional<size_t> generation_number(
+    std::string_view name, std::string_view log_name) {
+  if (!name.starts_with(log_name) || name.size() < log_name.size() + 2 ||
+      name[log_name.size()] != '.') {
+    return std::nullopt;
+  }
+  name.remove_prefix(log_name.size() + 1);
+  if (name.ends_with(GZIP_SUFFIX)) {
+    name.remove_suffix(GZIP_SUFFIX.size());
+  } else if (name.ends_with(ZSTD_SUFFIX)) {
+    name.remove_suffix(ZSTD_SUFFIX.size());
+  }
+  size_t result;
+  auto [end, ec] =
+      std::from_chars(name.data(), name.data() + name.size(), result);
+  if (ec != std::errc() || end != name.data() + name.size()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+// Appends `size` bytes to the output file, keeping track of the offset.
+// Decompressed bytes are charged to `budget` (if any), like bytes a scan reads.
+struct Output {
+  int fd;
+  ScanBudget* budget = nullptr;
+  size_t offset = 0;
+
+  bool write(const void* data, size_t size) {
+    if (budget && !budget->spend(size)) {
+      return false;
+    }
+    if (!pwrite_exactly(fd, data, size, offset)) {
+      return false;
+    }
+    offset += size;
+    return true;
+  }
+};
+
+bool decompress_gzip(const std::filesystem::path& path, Output& output) {
+  gzFile input = gzopen(path.c_str(), "rb");
+  if (input == nullptr) {
+    return false;
+  }
+  gzbuffer(input, DECOMPRESS_BUFFER_SIZE);
+  std::vector<char> buffer(DECOMPRESS_BUFFER_SIZE);
+  bool ok = true;
+  for (;;) {
+    int size = gzread(input, buffer.data(), buffer.size());
+    if (size < 0) {
+      int error;
+      spdlog::warn("Failed to decompress {}: {}", path.string(),
+          gzerror(input, &error));
+      ok = false;
+      break;
+    }
+    if (size == 0) {
+      // A file that is cut short (e.g. still being compressed) reads as if it
+      // ended, only the error tells it apart
+      int error;
+      const char* message = gzerror(input, &error);
+      if (error != Z_OK) {
+        spdlog::warn("Failed to decompress {}: {}", path.string(), message);
+        ok = false;
+      }
+      break;
+    }
+    if (!output.write(buffer.data(), size)) {
+      ok = false;
+      break;
+    }
+  }
+  gzclose(input);
+  return ok;
+}
+
+#if defined(LOGOVO_HAVE_ZSTD)
+bool decompress_zstd(const std::filesystem::path& path, Output& output) {
+  FileDescriptor input(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!input) {
+    return false;
+  }
+  std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(
+      ZSTD_createDCtx(), ZSTD_freeDCtx);
+  std::vector<char> in_buffer(ZSTD_DStreamInSize());
+  std::vector<char> out_buffer(ZSTD_DStreamOutSize());
+  size_t in_offset = 0;
+  size_t last_result = 0;
+  for (;;) {
+    auto size =
+        pread(input.get(), in_buffer.data(), in_buffer.size(), in_offset);
+    if (size < 0) {
+      return false;
+    }
+    if (size == 0) {
+      break;
+    }
+    in_offset += size;
+    ZSTD_inBuffer in{in_buffer.data(), static_cast<size_t>(size), 0};
+    while (in.pos < in.size) {
+      ZSTD_outBuffer out{out_buffer.data(), out_buffer.size(), 0};
+      last_result = ZSTD_decompressStream(context.get(), &out, &in);
+      if (ZSTD_isError(last_result)) {
+        spdlog::warn("Failed to decompress {}: {}", path.string(),
+            ZSTD_getErrorName(last_result));
+        return false;
+      }
+      if (!output.write(out_buffer.data(), out.pos)) {
+        return false;
+      }
+    }
+  }
+  // Anything but zero means that the last frame is cut short
+  return last_result == 0;
+}
+#endif
+
+bool decompress(const std::filesystem::path& path, Output& output) {
+  auto extension = path.extension();
+  if (extension == GZIP_SUFFIX) {
+    return decompress_gzip(path, output);
+  }
+#if defined(LOGOVO_HAVE_ZSTD)
+  if (extension == ZSTD_SUFFIX) {
+    return decompress_zstd(path, output);
+  }
+#endif
+  spdlog::warn("Can't decompress {}: unsupported format", path.string());
+  return false;
+}
+
+}  // namespace
+
+std::vector<std::filesystem::path> rotated_generations(
+    const std::filesystem::path& log_path) {
+  auto log_name = log_path.filename().string();
+  // (number, compressed, path), so that sorting puts uncompressed files
+  // before compressed ones of the same generation
+  std::vector<std::tuple<size_t, bool, std::filesystem::path>> generations;
+  std::error_code ec;
+  for (const auto& entry :
+      std::filesystem::directory_iterator(log_path.parent_path(), ec)) {
+    auto name = entry.path().filename().string();
+    auto number = generation_number(name, log_name);
+    if (number && entry.is_regular_file(ec)) {
+      generations.emplace_back(*number, is_compressed(name), entry.path());
+    }
+  }
+  std::ranges::sort(generations);
+
+  std::vector<std::filesystem::path> result;
+  std::optional<size_t> last_number;
+  for (auto& [number, compressed, path] : generations) {
+    if (number != last_number) {
+      result.push_back(std::move(path));
+      last_number = number;
+    }
+  }
+  return result;
+}
+
+bool is_compressed(const std::filesystem::path& path) {
+  auto extension = path.extension();
+  return extension == GZIP_SUFFIX || extension == ZSTD_SUFFIX;
+}
+
+namespace {
+
+// Whether `path` is a regular file (not a symlink) of the current user that
+// only they can write to
+bool is_own_file(const std::filesystem::path& path) {
+  struct stat st;
+  return lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+         st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+}  // namespace
+
+DecompressedCache::DecompressedCache(std::filesystem::path dir, size_t max_size)
+    : dir_(std::move(dir)), max_size_(max_size) {}
+
+std::optional<std::filesystem::path> DecompressedCache::get(
+    const std::filesystem::path& compressed_path, ScanBudget* budget) {
+  if (budget && budget->exhausted()) {
+    return std::nullopt;
+  }
+  struct stat st;
+  if (stat(compressed_path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+  auto path = dir_ / fmt::format("{:x}-{:x}-{:x}-{:x}.log", st.st_dev,
+                         st.st_ino, st.st_size,
+                         st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+
+  std::shared_ptr<std::mutex> copy_mutex;
+  {
+    std::lock_guard lock(mutex_);
+    if (!prepare_dir()) {
+      return std::nullopt;
+    }
+    auto& weak_mutex = copy_mutexes_[path.string()];
+    copy_mutex = weak_mutex.lock();
+    if (!copy_mutex) {
+      copy_mutex = std::make_shared<std::mutex>();
+      weak_mutex = copy_mutex;
+    }
+  }
+
+  bool decompressed = false;
+  std::optional<std::filesystem::path> result;
+  {
+    std::lock_guard copy_lock(*copy_mutex);
+    result = get_copy(compressed_path, path, budget, decompressed);
+  }
+
+  std::lock_guard lock(mutex_);
+  copy_mutex.reset();
+  if (auto it = copy_mutexes_.find(path.string());
+      it != copy_mutexes_.end() && it->second.expired()) {
+    copy_mutexes_.erase(it);
+  }
+  if (decompressed) {
+    evict(path);
+  }
+  return result;
+}
+
+std::optional<std::filesystem::path> DecompressedCache::get_copy(
+    const std::filesystem::path& compressed_path,
+    const std::filesystem::path& path, ScanBudget* budget,
+    bool& decompressed) {
+  std::error_code ec;
+  if (std::filesystem::exists(path, ec)) {
+    if (is_own_file(path)) {
+      // Recently used copies are the last to be evicted
+      std::filesystem::last_write_time(
+          path, std::filesystem::file_time_type::clock::now(), ec);
+      return path;
+    }
+    spdlog::warn("Replacing {}, which isn't a private file", path.string());
+    std::filesystem::remove(path, ec);
+  }
+
+  // A fresh file of a name nobody can guess (and so plant a symlink at), only
+  // the current user can read
+  auto temp_path = path.string() + ".XXXXXX";
+  spdlog::info("Decompressing {}", compressed_path.string());
+  {
+    FileDescriptor fd(mkostemp(temp_path.data(), O_CLOEXEC));
+    if (!fd) {
+      spdlog::warn("Failed to create a file in {}: {}", dir_.string(),
+          strerror(errno));
+      return std::nullopt;
+    }
+    Output output{fd.get(), budget};
+    if (!decompress(compressed_path, output)) {
+      if (budget && budget->exhausted()) {
+        spdlog::info("Gave up decompressing {}: out of the scan budget",
+            compressed_path.string());
+      }
+      std::filesystem::remove(temp_path, ec);
+      return std::nullopt;
+    }
+  }
+  // Only complete copies ever show up under their final name
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    spdlog::warn("Failed to rename {}: {}", temp_path, ec.message());
+    std::filesystem::remove(temp_path, ec);
+    return std::nullopt;
+  }
+  decompressed = true;
+  return path;
+}
+
+bool DecompressedCache::prepare_dir() {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_.parent_path(), ec);
+  if (::mkdir(dir_.c_str(), 0700) != 0 && errno != EEXIST) {
+    spdlog::warn("Failed to create {}: {}", dir_.string(), strerror(errno));
+    return false;
+  }
+  // It may have been there already, made by someone else
+  struct stat st;
+  if (lstat(dir_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+    spdlog::warn(
+        "Not decompressing into {}: it has to be a directory only the server's "
+        "user can access",
+        dir_.string());
+    return false;
+  }
+  return true;
+}
+
+void DecompressedCache::evict(const std::filesystem::path& keep) {
+  std::vector<std::pair<std::filesystem::file_time_type,
+      std::filesystem::directory_entry>>
+      copies;
+  size_t total_size = 0;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+    if (entry.path().extension() != ".log") {
+      continue;
+    }
+    total_size += entry.file_size(ec);
+    copies.emplace_back(entry.last_write_time(ec), entry);
+  }
+  std::ranges::sort(copies, {}, [](const auto& copy) { return copy.first; });
+  // Files being read stay readable after removal until they are closed
+  for (const auto& [time, entry] : copies) {
+    if (total_size <= max_size_) {
+      break;
+    }
+    if (entry.path() == keep) {
+      continue;
+    }
+    total_size -= entry.file_size(ec);
+    std::filesystem::remove(entry.path(), ec);
+  }
+}
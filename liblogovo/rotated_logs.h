@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ScanBudget;
+
+// Rotated generations of a log file, i.e. `app.log.1`, `app.log.2.gz`,
+// `app.log.3.zst` and so on next to `app.log`, newest (lowest number) first.
+// If a generation is there both as is and compressed, the uncompressed one is
+// used.
+std::vector<std::filesystem::path> rotated_generations(
+    const std::filesystem::path& log_path);
+
+// Whether a generation has to be decompressed to be read (see
+// `DecompressedCache`)
+bool is_compressed(const std::filesystem::path& path);
+
+// Directory of decompressed copies of compressed log generations.
+//
+// Compressed streams can only be read forwards, while `tail()` reads files
+// backwards. Rotated generations don't change though, so each of them is
+// decompressed once, and the copy is then mapped and read like any other file.
+// Copies are keyed by the inode, size and modification time of the original,
+// so a generation that is replaced (rotated further) gets a fresh copy.
+//
+// Once the copies take more than `max_size` bytes, the least recently used
+// ones are removed.
+//
+// The directory has to be private to the user the server runs as (it's
+// created with mode 0700), as anyone who can write to it could replace the
+// copies, and so what gets served. Copies that aren't the user's own regular
+// files are never served.
+class DecompressedCache {
+ public:
+  DecompressedCache(std::filesystem::path dir, size_t max_size);
+
+  // Returns the path of the decompressed copy of a file, decompressing it
+  // first if needed, or nullopt if that fails (or the directory isn't private)
+  //
+  // Decompressing is charged to `budget` (if given) as it goes, and given up
+  // on if the budget runs out. Only requests for the same file wait for each
+  // other while it's being decompressed.
+  std::optional<std::filesystem::path> get(
+      const std::filesystem::path& compressed_path,
+      ScanBudget* budget = nullptr);
+
+ private:
+  std::optional<std::filesystem::path> get_copy(
+      const std::filesystem::path& compressed_path,
+      const std::filesystem::path& path, ScanBudget* budget,
+      bool& decompressed);
+  bool prepare_dir();
+  void evict(const std::filesystem::path& keep);
+
+  std::filesystem::path dir_;
+  size_t max_size_;
+  // Guards `copy_mutexes_` and the directory itself (creating it, evicting)
+  std::mutex mutex_;
+  // Held while a copy is looked up or made, by its path, so that the same
+  // file isn't decompressed by several requests at once
+  std::unordered_map<std::string, std::weak_ptr<std::mutex>> copy_mutexes_;
+};
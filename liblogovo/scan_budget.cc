@@ -0,0 +1,59 @@
+#include "scan_budget.h"
+
+ScanBudget::ScanBudget(
+    size_t max_bytes, Clock::duration max_time, Clock::duration slice)
+    : max_bytes_(max_bytes), max_time_(max_time), slice_(slice) {
+  start();
+}
+
+void ScanBudget::start() {
+  auto now = Clock::now();
+  deadline_ = max_time_ == Clock::duration::zero() ? Clock::time_point::max()
+                                                   : now + max_time_;
+  slice_end_.store(
+      (now + slice_).time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool ScanBudget::spend(size_t bytes) {
+  if (exhausted()) {
+    return false;
+  }
+  if (max_bytes_ != 0 &&
+      bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes >
+          max_bytes_) {
+    exhaust("bytes");
+    return false;
+  }
+  if (deadline_ != Clock::time_point::max() && Clock::now() > deadline_) {
+    exhaust("time");
+    return false;
+  }
+  return true;
+}
+
+bool ScanBudget::pause_due() {
+  if (slice_ == Clock::duration::zero()) {
+    return false;
+  }
+  auto now = Clock::now();
+  auto slice_end = slice_end_.load(std::memory_order_relaxed);
+  if (now.time_since_epoch().count() < slice_end) {
+    return false;
+  }
+  return slice_end_.compare_exchange_strong(slice_end,
+      (now + slice_).time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+std::optional<size_t> ScanBudget::stopped_at() const {
+  auto offset = stopped_at_.load(std::memory_order_relaxed);
+  if (offset == NOT_STOPPED) {
+    return std::nullopt;
+  }
+  return offset;
+}
+
+void ScanBudget::exhaust(const char* reason) {
+  // The first reason sticks
+  const char* none = nullptr;
+  reason_.compare_exchange_strong(none, reason, std::memory_order_acq_rel);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+// Limits of the work a single request may do: bytes of log files scanned and
+// wall time. `tail()` (and everything built on it) spends the budget block by
+// block, and stops as if the file ended there once it runs out, so that a
+// filter that hardly matches anything can't keep scanning for ever.
+//
+// A budget can also split scanning into slices of time: at the end of a slice
+// the scan yields an empty view (which is never a line), so that the consumer
+// can give the thread to other requests before going on.
+//
+// Bytes may be spent and slices checked from several threads at once (like
+// merged files read ahead on a `ScanPool`). A slice is over for the first of
+// them to see it end.
+class ScanBudget {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Zero `max_bytes` or `max_time` means no limit of that kind, zero `slice`
+  // means no pauses
+  ScanBudget(size_t max_bytes, Clock::duration max_time,
+      Clock::duration slice = {});
+
+  // Starts counting the time anew, e.g. once the request is let in after
+  // waiting in a queue
+  void start();
+
+  // Accounts for `bytes` about to be scanned. Returns false if the budget has
+  // run out, and keeps returning false from then on.
+  bool spend(size_t bytes);
+
+  bool exhausted() const { return exhausted_reason() != nullptr; }
+  // "bytes" or "time" once the budget has run out, nullptr before that
+  const char* exhausted_reason() const {
+    return reason_.load(std::memory_order_acquire);
+  }
+
+  // Whether the current slice is over. Starts the next one if so.
+  bool pause_due();
+
+  // Set by the scan that ran out of the budget: the end of the part of its
+  // file (or range) it didn't get to, i.e. where to scan on from. Meaningless
+  // if several files are scanned at once.
+  std::optional<size_t> stopped_at() const;
+  void stop_at(size_t offset) {
+    stopped_at_.store(offset, std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t NOT_STOPPED = -1;
+
+  void exhaust(const char* reason);
+
+  size_t max_bytes_;
+  Clock::duration max_time_;
+  Clock::duration slice_;
+  Clock::time_point deadline_;
+  // Clock::time_point of the end of the current slice, as a count of ticks
+  std::atomic<Clock::rep> slice_end_;
+  std::atomic<size_t> bytes_ = 0;
+  std::atomic<const char*> reason_ = nullptr;
+  std::atomic<size_t> stopped_at_ = NOT_STOPPED;
+};
@@ -0,0 +1,40 @@
+#include "scan_pool.h"
+
+ScanPool::ScanPool(size_t threads) {
+  threads_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this](std::stop_token stop_token) {
+      run(stop_token);
+    });
+  }
+}
+
+ScanPool::~ScanPool() {
+  for (auto& thread : threads_) {
+    thread.request_stop();
+  }
+  // jthreads join in their destructors
+  threads_.clear();
+}
+
+void ScanPool::post(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  wakeup_.notify_one();
+}
+
+void ScanPool::run(std::stop_token stop_token) {
+  for (;;) {
+    std::unique_lock lock(mutex_);
+    if (!wakeup_.wait(lock, stop_token, [&] { return !tasks_.empty(); })) {
+      // Stopped, and there is nothing left to do
+      return;
+    }
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+  }
+}
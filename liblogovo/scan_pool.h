@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for the CPU-heavy parts of requests, like
+// searching a large file in parallel. Kept apart from the threads serving
+// connections: those block waiting for the results, so sharing threads with
+// them could leave nobody to produce the results.
+class ScanPool {
+ public:
+  explicit ScanPool(size_t threads);
+  // Runs the tasks that are already posted, then stops the threads
+  ~ScanPool();
+
+  ScanPool(const ScanPool&) = delete;
+  ScanPool& operator=(const ScanPool&) = delete;
+
+  size_t size() const { return threads_.size(); }
+
+  // Tasks are started in the order they are posted
+  void post(std::function<void()> task);
+
+ private:
+  void run(std::stop_token stop_token);
+
+  std::mutex mutex_;
+  std::condition_variable_any wakeup_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::jthread> threads_;
+};
@@ -1,25 +1,123 @@
 #include "server.h"
 
+#include <pthread.h>
+#include <sched.h>
 #include <spdlog/spdlog.h>
 
 #include <boost/asio.hpp>
 #include <boost/asio/awaitable.hpp>
-#include <boost/asio/experimental/awaitable_operators.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+#include <chrono>
+#include <csignal>
 #include <list>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 #include "handler.h"
+#include "metrics.h"
 
 namespace asio = boost::asio;
 namespace beast = boost::beast;
 namespace http = beast::http;
 
-using namespace boost::asio::experimental::awaitable_operators;
+namespace {
 
-Server::Server(Handler& handler, std::string listen_at, ushort port)
-    : handler_(handler), listen_at_(listen_at), port_(port) {}
+using Clock = std::chrono::steady_clock;
+
+// Does what `beast::async_write` does with a message generator, and times
+// every write on the way for the metrics
+asio::awaitable<void> write_response(beast::tcp_stream& stream,
+    http::message_generator& message, Clock::time_point request_start) {
+  auto& m = metrics();
+  bool first_write = true;
+  while (!message.is_done()) {
+    beast::error_code ec;
+    auto buffers = message.prepare(ec);
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+    auto write_start = Clock::now();
+    size_t size =
+        co_await stream.async_write_some(buffers, asio::use_awaitable);
+    auto write_end = Clock::now();
+    message.consume(size);
+
+    m.bytes_sent.add(size);
+    if (write_end - write_start > WRITE_STALL_THRESHOLD) {
+      m.write_stalls.add();
+      m.write_stall_duration.observe(write_end - write_start);
+    }
+    if (first_write) {
+      m.time_to_first_byte.observe(write_end - request_start);
+      first_write = false;
+    }
+  }
+  m.request_duration.observe(Clock::now() - request_start);
+}
+
+// SO_REUSEPORT: several sockets may listen at the same address, the kernel
+// spreads incoming connections between them
+using ReusePort =
+    asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+// Pins the calling thread to the `index`-th of the CPUs the process may run
+// on (wrapping around if there are fewer)
+void pin_to_cpu(size_t index) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+      CPU_COUNT(&allowed) == 0) {
+    return;
+  }
+  index %= CPU_COUNT(&allowed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed) && index-- == 0) {
+      cpu_set_t pinned;
+      CPU_ZERO(&pinned);
+      CPU_SET(cpu, &pinned);
+      if (int error =
+              pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+          error != 0) {
+        spdlog::warn("Failed to pin a thread to CPU {}: {}", cpu,
+            std::system_category().message(error));
+      }
+      return;
+    }
+  }
+}
+
+// Counts the session as active while alive. The session is counted against
+// the limit by the acceptor already, so `sessions` only goes down here.
+struct ActiveSession {
+  explicit ActiveSession(std::atomic<size_t>& sessions) : sessions(sessions) {
+    metrics().active_sessions.add(1);
+  }
+  ~ActiveSession() {
+    metrics().active_sessions.add(-1);
+    sessions.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<size_t>& sessions;
+};
+
+// How long a rejected connection gets to send its request
+constexpr auto REJECT_READ_TIMEOUT = std::chrono::seconds(5);
+
+}  // namespace
+
+Server::Server(Handler& handler, std::string listen_at, ushort port,
+    ServerOptions options)
+    : handler_(handler),
+      listen_at_(listen_at),
+      port_(port),
+      options_(options) {}
 
 asio::awaitable<void> Server::session_(session_state s) {
+  ActiveSession active_session(sessions_);
   // This buffer is required to persist across reads
   beast::flat_buffer buffer;
 
@@ -27,14 +125,21 @@ asio::awaitable<void> Server::session_(session_state s) {
     // Read a request
     http::request<http::string_body> req;
     co_await http::async_read(*s, buffer, req);
+    auto request_start = Clock::now();
     // Handle the request
-    http::message_generator msg = handler_.handle_request(std::move(req));
-
-    // Determine if we should close the connection
-    bool keep_alive = msg.keep_alive();
+    Response response =
+        co_await handler_.async_handle_request(std::move(req));
 
-    // Send the response
-    co_await beast::async_write(*s, std::move(msg));
+    // Determine if we should close the connection, and send the response
+    bool keep_alive;
+    if (auto* msg = std::get_if<http::message_generator>(&response)) {
+      keep_alive = msg->keep_alive();
+      co_await write_response(*s, *msg, request_start);
+    } else {
+      auto& streaming = std::get<std::unique_ptr<StreamingResponse>>(response);
+      keep_alive = streaming->keep_alive();
+      co_await streaming->write(*s);
+    }
 
     if (!keep_alive) {
       // This means we should close the connection, usually because
@@ -50,68 +155,177 @@ asio::awaitable<void> Server::session_(session_state s) {
   // because the client might have dropped the connection already.
 }
 
+asio::awaitable<void> Server::reject_(session_state s) {
+  metrics().sessions_rejected.add();
+  // The request is read first, closing a socket with unread data would reset
+  // the connection before the client gets to see the response
+  beast::flat_buffer buffer;
+  http::request<http::string_body> req;
+  s->expires_after(REJECT_READ_TIMEOUT);
+  co_await http::async_read(*s, buffer, req);
+
+  http::response<http::string_body> res{
+      http::status::service_unavailable, req.version()};
+  res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  res.set(http::field::content_type, "text/html");
+  res.set(http::field::retry_after, "1");
+  res.keep_alive(false);
+  res.body() = "Too many connections, try again later";
+  res.prepare_payload();
+  co_await http::async_write(*s, res);
+  s->socket().shutdown(asio::ip::tcp::socket::shutdown_send);
+}
+
+asio::awaitable<void> Server::accept_(asio::ip::tcp::acceptor& acceptor,
+    asio::any_io_executor executor, bool strands) {
+  for (;;) {
+    auto session_executor = strands
+                                ? asio::any_io_executor(make_strand(executor))
+                                : executor;
+    session_state s = std::make_shared<beast::tcp_stream>(
+        co_await acceptor.async_accept(session_executor, asio::use_awaitable));
+    if (sessions_.fetch_add(1, std::memory_order_relaxed) >=
+            options_.max_sessions &&
+        options_.max_sessions != 0) {
+      sessions_.fetch_sub(1, std::memory_order_relaxed);
+      // Errors don't matter, the connection is to go away anyway
+      co_spawn(session_executor, reject_(std::move(s)), asio::detached);
+      continue;
+    }
+
+    {
+      std::lock_guard lock(handles_mutex_);
+      handles_.remove_if(std::mem_fn(&handle::expired));
+      handles_.emplace_back(s);
+    }
+    co_spawn(session_executor, session_(s), [](std::exception_ptr e) {
+      try {
+        if (e) {
+          std::rethrow_exception(e);
+        }
+      } catch (const std::exception& e) {
+        // Check if we got end of stream:
+        if (auto* system_error =
+                dynamic_cast<const boost::system::system_error*>(&e);
+            system_error &&
+            system_error->code() == http::error::end_of_stream) {
+          // We've got end of stream, which happens if HTTP client
+          // requested a keep alive, but then went away and closed the
+          // socket. We don't mind, but it's not worth it to spam logs
+          // with error messages, so `trace` instead of `error`.
+          spdlog::trace("Early end of stream");
+          return;
+        }
+
+        spdlog::error("Error in session: {}", e.what());
+      }
+    });
+  }
+}
+
 void Server::serve() {
-  spdlog::info("Starting HTTP server listening at {}:{}", listen_at_, port_);
+  size_t threads = options_.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  spdlog::info("Starting HTTP server listening at {}:{} on {} threads{}",
+      listen_at_, port_, threads,
+      options_.per_core ? ", one io_context per core" : "");
   const auto address = asio::ip::make_address(listen_at_);
   const auto endpoint = asio::ip::tcp::endpoint{address, port_};
 
-  asio::signal_set signals(ioc_, SIGINT, SIGTERM);
-
-  std::list<handle> handles;
-  asio::co_spawn(
-      ioc_,
-      [&]() -> asio::awaitable<void> {
-        auto executor = co_await asio::this_coro::executor;
-        for (asio::ip::tcp::acceptor acceptor(executor, endpoint);;) {
-          session_state s = std::make_shared<beast::tcp_stream>(
-              co_await acceptor.async_accept(
-                  make_strand(executor), asio::use_awaitable));
-
-          handles.remove_if(std::mem_fn(&handle::expired));
-          handles.emplace_back(s);
-          co_spawn(executor, session_(s), [](std::exception_ptr e) {
-            try {
-              if (e) {
-                std::rethrow_exception(e);
-              }
-            } catch (const std::exception& e) {
-              // Check if we got end of stream:
-              if (auto* system_error =
-                      dynamic_cast<const boost::system::system_error*>(&e);
-                  system_error &&
-                  system_error->code() == http::error::end_of_stream) {
-                // We've got end of stream, which happens if HTTP client
-                // requested a keep alive, but then went away and closed the
-                // socket. We don't mind, but it's not worth it to spam logs
-                // with error messages, so `trace` instead of `error`.
-                spdlog::trace("Early end of stream");
-                return;
-              }
-
-              spdlog::error("Error in session: {}", e.what());
-            }
-          });
+  // Either a single pool shared by all the threads, or a single-threaded
+  // io_context per thread
+  std::optional<asio::thread_pool> pool;
+  std::vector<std::unique_ptr<asio::io_context>> contexts;
+  std::vector<asio::any_io_executor> executors;
+  if (options_.per_core) {
+    for (size_t i = 0; i < threads; ++i) {
+      contexts.push_back(std::make_unique<asio::io_context>(1));
+      executors.push_back(contexts.back()->get_executor());
+    }
+  } else {
+    pool.emplace(threads);
+    executors.push_back(pool->get_executor());
+  }
+
+  // Signals are caught from here on, even before the server accepts anything
+  asio::signal_set signals(executors.front(), SIGINT, SIGTERM);
+  // Writes to sockets of clients that went away fail with EPIPE instead.
+  // Asio's own writes don't raise it, but sendfile has no way to ask for that.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  // All sockets are bound before anything runs, so that a busy port fails the
+  // whole server right away. Acceptors are used on strands of their own, to
+  // be closed from other threads safely.
+  std::list<asio::ip::tcp::acceptor> acceptors;
+  for (const auto& executor : executors) {
+    auto& acceptor = acceptors.emplace_back(make_strand(executor));
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(asio::socket_base::reuse_address(true));
+    if (options_.per_core) {
+      acceptor.set_option(ReusePort(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+  }
+
+  std::once_flag stopped;
+  auto stop = [&] {
+    std::call_once(stopped, [&] {
+      for (auto& acceptor : acceptors) {
+        post(acceptor.get_executor(), [&acceptor] { acceptor.close(); });
+      }
+      post(signals.get_executor(), [&signals] { signals.cancel(); });
+
+      std::lock_guard lock(handles_mutex_);
+      for (auto h : handles_)
+        if (auto s = h.lock()) {
+          spdlog::info("Waiting for the live session to shut down {}:{}",
+              s->socket().remote_endpoint().address().to_string(),
+              s->socket().remote_endpoint().port());
+          post(s->get_executor(), [s] { s->cancel(); });
         }
-      }() || signals.async_wait(asio::use_awaitable),
-      [&handles](std::exception_ptr e, auto result) {
-        try {
-          if (e) {
-            std::rethrow_exception(e);
-          }
-          auto signal = std::get<1>(result);
-          spdlog::info("Got signal, shutting down");
-
-          for (auto h : handles)
-            if (auto s = h.lock()) {
-              spdlog::info("Waiting for the live session to shut down {}:{}",
-                  s->socket().remote_endpoint().address().to_string(),
-                  s->socket().remote_endpoint().port());
-              post(s->get_executor(), [s] { s->cancel(); });
+    });
+  };
+
+  auto executor = executors.begin();
+  for (auto& acceptor : acceptors) {
+    co_spawn(acceptor.get_executor(),
+        accept_(acceptor, *executor++, !options_.per_core),
+        [&stop](std::exception_ptr e) {
+          try {
+            if (e) {
+              std::rethrow_exception(e);
             }
-        } catch (const std::exception& e) {
-          spdlog::error("Error trying to listen: {}", e.what());
-        }
-      });
+          } catch (const boost::system::system_error& e) {
+            if (e.code() == asio::error::operation_aborted) {
+              // Closed on shutdown
+              return;
+            }
+            spdlog::error("Error trying to listen: {}", e.what());
+          } catch (const std::exception& e) {
+            spdlog::error("Error trying to listen: {}", e.what());
+          }
+          stop();
+        });
+  }
+  signals.async_wait([&stop](beast::error_code ec, int) {
+    if (!ec) {
+      spdlog::info("Got signal, shutting down");
+      stop();
+    }
+  });
 
-  ioc_.join();
+  if (pool) {
+    pool->join();
+    return;
+  }
+  std::vector<std::jthread> context_threads;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    context_threads.emplace_back([&, i] {
+      pin_to_cpu(i);
+      contexts[i]->run();
+    });
+  }
 }
@@ -2,13 +2,31 @@
 
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
+#include <atomic>
+#include <list>
+#include <mutex>
 
 class Handler;
 
+struct ServerOptions {
+  // Threads to serve connections on, 0 means one per CPU
+  size_t threads = 0;
+  // Whether every thread runs its own io_context, pinned to a CPU of its own
+  // and accepting connections on its own SO_REUSEPORT socket (the kernel
+  // spreads connections between them), instead of all the threads sharing a
+  // single pool. Sessions never move between threads then, and don't need
+  // strands.
+  bool per_core = false;
+  // Connections served at once, 0 means no limit. Connections over the limit
+  // get a 503 to their first request and are closed.
+  size_t max_sessions = 0;
+};
+
 class Server {
  public:
   // Handler must be alive for the whole server lifetime
-  Server(Handler& handler, std::string listen_at, ushort port);
+  Server(Handler& handler, std::string listen_at, ushort port,
+      ServerOptions options = {});
 
   void serve();
 
@@ -16,9 +34,22 @@ class Server {
   using session_state = std::shared_ptr<boost::beast::tcp_stream>;
   using handle = std::weak_ptr<session_state::element_type>;
 
+  // Accepts connections until the acceptor is closed, running sessions on
+  // `executor` (on strands of it, if `strands`)
+  boost::asio::awaitable<void> accept_(boost::asio::ip::tcp::acceptor& acceptor,
+      boost::asio::any_io_executor executor, bool strands);
   boost::asio::awaitable<void> session_(session_state s);
+  // Turns the connection away, for connections over `max_sessions`
+  boost::asio::awaitable<void> reject_(session_state s);
+
   Handler& handler_;
   std::string listen_at_;
   ushort port_;
-  boost::asio::thread_pool ioc_;
+  ServerOptions options_;
+
+  // Live sessions, to cancel them on shutdown
+  std::mutex handles_mutex_;
+  std::list<handle> handles_;
+  // Sessions counted against `max_sessions`
+  std::atomic<size_t> sessions_ = 0;
 };
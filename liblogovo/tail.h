@@ -1,8 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <concepts>
 #include <cstddef>
+#include <functional>
+#include <ios>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
+#include "grep.h"
+#include "memory_pool.h"
+#include "metrics.h"
+#include "newline_scan.h"
+#include "parallel_scan.h"
+#include "scan_budget.h"
+#include "scan_pool.h"
+#include "trigram_index.h"
 #include "vendor/generator.h"
 
 // Uncomment this to get tons of output about how exactly the tail generator
@@ -20,141 +38,439 @@
 
 struct TailParameters {
   size_t BLOCK_SIZE = 64 * 1024;
+  // Filtering a contiguous source of at least two chunks of this size with a
+  // `ScanPool` at hand searches the chunks in parallel
+  size_t PARALLEL_CHUNK_SIZE = 4 * 1024 * 1024;
+};
+
+// Part of the file `tail()` works with, [begin, end) in bytes. Both ends must
+// be at line boundaries (or at the start/end of the file), `end` is clamped by
+// the file size.
+struct FileRange {
+  size_t begin = 0;
+  size_t end = std::numeric_limits<size_t>::max();
+
+  bool operator==(const FileRange&) const = default;
+};
+
+// Something `tail()` can read blocks of a file from without going through a
+// std::istream (see `MappedFile`):
+// - `size()` returns the size of the file
+// - `read(offset, size)` returns a view of the given bytes (or nullopt on
+//   failure)
+// - `CONTIGUOUS` tells that the views point into a single piece of memory
+//   holding the whole file and stay valid for the lifetime of the source, so
+//   lines can be yielded right from there regardless of their length.
+template <typename T>
+concept BlockSource = requires(T& source, size_t offset, size_t size) {
+  { source.size() } -> std::convertible_to<std::optional<size_t>>;
+  {
+    source.read(offset, size)
+  } -> std::convertible_to<std::optional<std::string_view>>;
+  { T::CONTIGUOUS } -> std::convertible_to<bool>;
+};
+
+// Adapts a std::istream-like object for `tail()` by reading blocks into a
+// buffer. Views returned by `read` are only valid until the next `read`.
+template <typename IStream>
+class StreamBlockSource {
+ public:
+  static constexpr bool CONTIGUOUS = false;
+
+  StreamBlockSource(IStream& input, size_t block_size)
+      : input_(input), block_(block_size) {}
+
+  std::optional<size_t> size() {
+    input_.seekg(0, std::ios_base::end);
+    auto result = input_.tellg();
+    if (result < 0) {
+      TAIL_TRACE("stream in a failed state");
+      return std::nullopt;
+    }
+    return static_cast<size_t>(result);
+  }
+
+  std::optional<std::string_view> read(size_t offset, size_t size) {
+    input_.seekg(offset);
+    input_.read(block_.data(), size);
+    if (!input_) {
+      TAIL_TRACE("failed to read {} bytes starting at offset {}", size, offset);
+      return std::nullopt;
+    }
+    return std::string_view(block_.data(), size);
+  }
+
+ private:
+  IStream& input_;
+  std::vector<char, PoolAllocator<char>> block_;
 };
 
 // Core of the server - a generator that reads a given amount of last lines
-// (optionally having a given substring) from a given file in line-reversed
-// order.
+// (optionally having a given substring) from a given file (or a given range of
+// it) in line-reversed order. The file is either a std::istream-like object or
+// a `BlockSource`.
 //
 // This generator works in a constant space (the buffer size in bytes is
 // provided via `TailParameters`) by reading chunks of data from the end of
-// file and extracting lines from them.
+// file and extracting lines from them. When filtering, each block is searched
+// for the pattern as a whole and only the lines around the hits are split out.
+// Sources that are `CONTIGUOUS` are read in place, without copying blocks into
+// a buffer, and lines read from them aren't limited by the block size. Large
+// contiguous sources are filtered with `parallel_grep()` if given a `pool`.
+//
+// Lines longer than a block of a buffered source are read again from their
+// start once it's found, and yielded in fragments of up to a block each, in
+// order, so memory stays within a couple of blocks however long lines are.
+// Given `fragment`, it's set before every yield to whether more of the same
+// line follows in the next view. Substrings of a filter (`all`, `any` and
+// `none` alike) are searched for in the whole of such a line, but are only
+// certain to be found if they are at most half a block long plus one symbol.
+// Regular expressions only look at the first block of it.
+//
+// Given a `skip` (of the same filter as `grep`), parts of the file it rules out
+// aren't read, only the line they start in is, from the end of the part on.
+//
+// Given a `budget`, every block is paid for before it's read, and the
+// generator stops once the budget runs out, noting where in the budget. It
+// also yields empty views when the budget asks for pauses, those aren't lines
+// and don't count towards `n`.
 //
 // Yielded string views remain valid while the generator object is alive and
 // until the next yield.
-template <typename IStream, TailParameters Parameters = TailParameters()>
-std::generator<std::string_view> tail(
-    IStream& input, size_t n, std::optional<std::string> grep = std::nullopt) {
+//
+// The coroutine frame comes from the thread's memory pool (see
+// `pool_allocate`), like the buffers it uses, so a request for a few lines
+// doesn't go to the heap.
+template <typename Input, TailParameters Parameters = TailParameters()>
+std::generator<std::string_view> tail(std::allocator_arg_t,
+    PoolAllocator<std::byte>, Input& input, size_t n, std::optional<Grep> grep,
+    FileRange range, ScanPool* pool, ScanBudget* budget, bool* fragment,
+    const TrigramSkip* skip) {
   if (n == 0) {
     co_return;
   }
+  if (grep && grep->matches_all()) {
+    grep.reset();
+  }
+  if (grep && !grep->can_match_lines()) {
+    co_return;
+  }
 
-  auto should_yield = [&](std::string_view v) -> bool {
-    if (grep) {
-      return v.contains(*grep);
+  auto&& source = [&]() -> decltype(auto) {
+    if constexpr (BlockSource<Input>) {
+      return (input);
+    } else {
+      return StreamBlockSource<Input>(input, Parameters.BLOCK_SIZE);
     }
-    return true;
-  };
+  }();
+  constexpr bool CONTIGUOUS =
+      std::remove_cvref_t<decltype(source)>::CONTIGUOUS;
 
-  std::vector<char> block(Parameters.BLOCK_SIZE);
-  input.seekg(0, std::ios_base::end);
+  // Newlines of the whole block are located at once, so walking lines
+  // backwards doesn't need to look at every byte individually.
+  NewlineBitmap newlines(Parameters.BLOCK_SIZE);
 
-  size_t block_start_file_offset;
-  size_t block_size;
-  std::vector<char>::iterator line_start;
-  std::vector<char>::iterator line_end;
-  auto read_next_block = [&]() -> bool {
-    auto current_pos = input.tellg();
-    if (current_pos < 0) {
-      TAIL_TRACE("stream in a failed state");
-      return false;
+  // All offsets below are file offsets.
+  size_t block_start;
+  size_t block_end;
+  const char* block;
+  // Start of the earliest line that is known to be complete, i.e. the one right
+  // after the first newline in the block (or the very first line of the file).
+  size_t lines_begin;
+  // Right past the end of the next line to yield. Lines in
+  // [lines_begin, line_end) are yet to be looked at. With contiguous sources
+  // the line may end past the current block.
+  size_t line_end;
+  auto view = [&](size_t begin, size_t end) {
+    return std::string_view(block + (begin - block_start), end - begin);
+  };
+  auto read_block = [&](size_t end) -> bool {
+    for (;;) {
+      size_t size = std::min(end - range.begin, Parameters.BLOCK_SIZE);
+      if (size == 0) {
+        // The file (or the range) is empty, nothing to do here
+        return false;
+      }
+      if (budget && !budget->spend(size)) {
+        // Everything past `line_end` is done with
+        budget->stop_at(line_end);
+        return false;
+      }
+      auto data = source.read(end - size, size);
+      if (!data) {
+        return false;
+      }
+      block_start = end - size;
+      block_end = end;
+      block = data->data();
+      TAIL_TRACE("read {} bytes starting at offset {}", size, block_start);
+      metrics().blocks_read.add();
+      metrics().bytes_read.add(size);
+
+      newlines.scan(*data);
+      if (block_start == range.begin) {
+        lines_begin = range.begin;
+        return true;
+      }
+      // The newline terminating the current line doesn't tell where any line
+      // starts.
+      auto first_newline = newlines.find_first_from(0);
+      if (first_newline && block_start + *first_newline + 1 < line_end) {
+        lines_begin = block_start + *first_newline + 1;
+        TAIL_TRACE("lines_begin: {}, line_end: {}", lines_begin, line_end);
+        return true;
+      }
+      // The whole block is in the middle of a line, keep looking for its start
+      end = block_start;
     }
-    block_size =
-        std::min(static_cast<size_t>(current_pos), Parameters.BLOCK_SIZE);
-    if (block_size == 0) {
-      // The file is empty, nothing to do here
-      return false;
+  };
+  // Reads forward up to a block of [offset, end), for lines longer than a
+  // block and for finding where lines start
+  auto read_fragment = [&](size_t offset, size_t end) {
+    size_t size = std::min(end - offset, Parameters.BLOCK_SIZE);
+    auto data = source.read(offset, size);
+    if (data) {
+      metrics().blocks_read.add();
+      metrics().bytes_read.add(size);
     }
-    input.seekg(-block_size, std::ios_base::cur);
-    block_start_file_offset =
-        static_cast<size_t>(static_cast<size_t>(current_pos) - block_size);
-    TAIL_TRACE("block_start_file_offset: {}", block_start_file_offset);
-    input.read(&block.front(), block_size);
-    TAIL_TRACE("read {} bytes starting at offset {}", block_size,
-        block_start_file_offset);
-
-    line_end = block.begin() + block_size;
-    line_start = block.begin() + block_size - 1;
-
-    TAIL_TRACE("starting the block: {}, line_start={}, line_end={}",
-        fmt::join(block, ","), line_start - block.begin(),
-        line_end - block.begin());
-    return true;
+    return data;
   };
 
   // Start by reading the first block (right at the current end of file)
-  if (!read_next_block()) {
+  std::optional<size_t> file_size = source.size();
+  if (!file_size || range.begin >= std::min(*file_size, range.end)) {
     co_return;
   }
-
-  for (;;) {
-    while (line_start != block.begin() &&
-           // We need to grab at least one symbol to handle \n\n sequences
-           (*line_start != '\n' || line_start + 1 == line_end)) {
-      line_start--;
+  line_end = std::min(*file_size, range.end);
+  if constexpr (CONTIGUOUS) {
+    if (grep && pool && pool->size() > 1 &&
+        line_end - range.begin >= 2 * Parameters.PARALLEL_CHUNK_SIZE) {
+      auto data = source.read(range.begin, line_end - range.begin);
+      if (!data) {
+        co_return;
+      }
+      std::function<bool(size_t, size_t)> may_have_hits;
+      if (skip) {
+        may_have_hits = [skip, offset = range.begin](size_t begin, size_t end) {
+          return skip->skippable_start(offset + begin, offset + end) !=
+                 offset + begin;
+        };
+      }
+      auto lines = parallel_grep(*data, n, std::move(*grep), *pool,
+          Parameters.PARALLEL_CHUNK_SIZE, budget, std::move(may_have_hits));
+      if (fragment) {
+        *fragment = false;
+      }
+      for (auto line : lines) {
+        co_yield line;
+      }
+      if (budget && budget->exhausted()) {
+        // Noted relative to `data`
+        budget->stop_at(range.begin + *budget->stopped_at());
+      }
+      co_return;
     }
+  }
+  if (!read_block(line_end)) {
+    co_return;
+  }
 
-    TAIL_TRACE("done moving backwards (line_start={}, line_end={})",
-        line_start - block.begin(), line_end - block.begin());
-
-    // previous line\nnext line[maybe \n]<remainder>
-    //  line start [ ^                   ^ line end )
-    while (*line_start == '\n' && line_start + 1 != line_end) {
-      // +1 is because we're standing at `\n` of the previous line
-      auto value = std::string_view(line_start + 1, line_end);
-      TAIL_TRACE("yielding {} (line_start={}, line_end={})", value,
-          line_start - block.begin() + 1, line_end - block.begin());
-
-      if (should_yield(value)) {
-        co_yield value;
-        if (--n == 0) {
+  for (;;) {
+    if (line_end == lines_begin) {
+      if (block_start == range.begin) {
+        // We've reached the start of the file, so nothing to continue
+        co_return;
+      }
+      if (budget && budget->pause_due()) {
+        co_yield std::string_view();
+      }
+      // Buffered blocks need to be read again from where the earliest complete
+      // line starts, so that the newline terminating the line before it is the
+      // last symbol of the new block. Contiguous sources still have that part
+      // of the line in place, so they simply go on with the preceding block.
+      size_t next_end = CONTIGUOUS ? block_start : lines_begin;
+      if (grep && skip) {
+        size_t skip_start = skip->skippable_start(range.begin, line_end);
+        if (skip_start == range.begin) {
+          metrics().grep_skipped_bytes.add(line_end - range.begin);
           co_return;
         }
+        // The rest of the line the skipped part starts in may still have a
+        // hit, so reading goes on from the end of that line
+        if (skip_start < line_end) {
+          auto data = read_fragment(skip_start - 1, line_end);
+          if (!data) {
+            co_return;
+          }
+          auto newline = data->find('\n');
+          if (newline != std::string_view::npos &&
+              skip_start + newline < line_end) {
+            metrics().grep_skipped_bytes.add(
+                line_end - (skip_start + newline));
+            line_end = next_end = skip_start + newline;
+          }
+        }
       }
-
-      // Now we want to end up like this (e.g. have a line with a single \n):
-      //  previous line\nnext line[maybe \n]
-      // line start [  ^ ^ line end )
-      line_end = line_start + 1;
-      if (line_start != block.begin()) {
-        line_start--;
-      } else {
-        // If we're already standing at the beginning of the block, break out of
-        // the while loop and go right to the next 'if' (that will fetch us a
-        // new block)
-        break;
+      if (!read_block(next_end)) {
+        co_return;
       }
+      continue;
     }
-    if (line_start == block.begin()) {
-      if (block_start_file_offset == 0) {
-        // We're dealing with the very first line in the file, yield it as is
-        auto value = std::string_view(line_start, line_end);
-        TAIL_TRACE("yielding first block {} (line_start={}, line_end={})",
-            value, line_start - block.begin(), line_end - block.begin());
-
-        if (should_yield(value)) {
-          co_yield value;
+
+    if constexpr (!CONTIGUOUS) {
+      if (line_end > block_end) {
+        // The line didn't fit into a block, the ones before it were read to
+        // find where it starts. Its last newline is the last one of the block.
+        auto previous_newline =
+            newlines.find_last_before(block_end - block_start);
+        size_t line_start = previous_newline
+                                ? block_start + *previous_newline + 1
+                                : lines_begin;
+        bool matches = true;
+        if (grep) {
+          if (budget && !budget->spend(line_end - line_start)) {
+            budget->stop_at(line_end);
+            co_return;
+          }
+          // Blocks overlap by the length of the longest substring, so that
+          // substrings are found across their boundaries as well. Up to half
+          // a block, to still get through the line in a few reads.
+          size_t overlap = std::min(
+              std::max<size_t>(grep->longest_substring(), 1) - 1,
+              Parameters.BLOCK_SIZE / 2);
+          Grep::Pieces pieces(*grep);
+          for (size_t offset = line_start; offset < line_end;
+              offset += Parameters.BLOCK_SIZE - overlap) {
+            auto data = read_fragment(offset, line_end);
+            if (!data) {
+              co_return;
+            }
+            metrics().grep_searches.add();
+            pieces.add(*data);
+            if (pieces.decided() || offset + data->size() == line_end) {
+              break;
+            }
+          }
+          matches = pieces.matches();
         }
-        // And we've reached the start of the file, so nothing to continue
-        co_return;
+        if (matches) {
+          if (grep) {
+            metrics().grep_hits.add();
+          }
+          if (budget && !budget->spend(line_end - line_start)) {
+            budget->stop_at(line_end);
+            co_return;
+          }
+          for (size_t offset = line_start; offset < line_end;) {
+            auto data = read_fragment(offset, line_end);
+            if (!data) {
+              co_return;
+            }
+            offset += data->size();
+            if (fragment) {
+              *fragment = offset < line_end;
+            }
+            co_yield *data;
+          }
+          if (--n == 0) {
+            co_return;
+          }
+        }
+        // The block has been read over, so it's read again for the lines
+        // before this one
+        line_end = line_start;
+        if (!read_block(line_end)) {
+          co_return;
+        }
+        continue;
       }
+    }
 
-      // We've reached the beginning of the line and need to fetch another block
-      // Our file pointer stands right after the end of the current block and we
-      // want to move it to the symbol before last yielded line's \n.
-      // The idea is that when fetching the next block, that symbol before \n
-      // will be right at the end of the block
-      TAIL_TRACE(
-          "block_size: {}, line_end: {}", block_size, line_end - block.begin());
-      std::ptrdiff_t rewind = block_size - (line_end - block.begin());
-      if (rewind == 0) {
-        throw std::runtime_error("Line is longer than the buffer size");
-      }
-      TAIL_TRACE("rewind: {}", -rewind);
-      input.seekg(-rewind, std::ios_base::cur);
-      if (!read_next_block()) {
-        co_return;
+    // previous line\nnext line[maybe \n]<remainder>
+    //               ^ previous newline ^ line end )
+    //
+    // The bitmap only covers the current block, which is fine: the part of the
+    // line past the block (if any) has no newlines, except the one at its end.
+    size_t line_start;
+    size_t yield_end = line_end;
+    if (grep) {
+      auto hit = grep->find_last(view(lines_begin, line_end));
+      metrics().grep_searches.add();
+      if (!hit) {
+        TAIL_TRACE("no matches in [{}, {})", lines_begin, line_end);
+        line_end = lines_begin;
+        continue;
+      }
+      metrics().grep_hits.add();
+      // Split out just the line that has the hit
+      auto hit_offset = lines_begin + *hit - block_start;
+      auto previous_newline = newlines.find_last_before(hit_offset);
+      line_start =
+          previous_newline ? block_start + *previous_newline + 1 : lines_begin;
+      auto next_newline = newlines.find_first_from(hit_offset);
+      if (next_newline) {
+        yield_end = std::min(block_start + *next_newline + 1, line_end);
       }
+    } else {
+      // The newline right before `line_end` terminates the line we're about to
+      // yield, so it's skipped (that is also what handles \n\n sequences).
+      auto previous_newline =
+          newlines.find_last_before(line_end - 1 - block_start);
+      line_start =
+          previous_newline ? block_start + *previous_newline + 1 : lines_begin;
+    }
+
+    auto value = view(line_start, yield_end);
+    TAIL_TRACE("yielding {} (line_start={}, line_end={})", value, line_start,
+        yield_end);
+    if (fragment) {
+      *fragment = false;
     }
+    co_yield value;
+    if (--n == 0) {
+      co_return;
+    }
+    line_end = line_start;
+  }
+}
+
+// The `tail()` everything calls (see above), only the coroutine itself takes
+// the allocator
+template <typename Input, TailParameters Parameters = TailParameters()>
+std::generator<std::string_view> tail(Input& input, size_t n,
+    std::optional<Grep> grep = std::nullopt, FileRange range = {},
+    ScanPool* pool = nullptr, ScanBudget* budget = nullptr,
+    bool* fragment = nullptr, const TrigramSkip* skip = nullptr) {
+  return tail<Input, Parameters>(std::allocator_arg,
+      PoolAllocator<std::byte>(), input, n, std::move(grep), range, pool,
+      budget, fragment, skip);
+}
+
+// Offset the last `n` lines of `range` of a contiguous `source` start at
+// (`range.begin` if it has fewer), i.e. where to read them in file order from.
+// Goes back through the lines with `tail()`, so only the blocks they are in
+// are read. Returns nullopt if the source can't be read.
+template <BlockSource Source, TailParameters Parameters = TailParameters()>
+  requires(Source::CONTIGUOUS)
+std::optional<size_t> last_lines_start(
+    Source& source, size_t n, FileRange range = {}) {
+  std::optional<size_t> file_size = source.size();
+  if (!file_size) {
+    return std::nullopt;
+  }
+  size_t end = std::min(*file_size, range.end);
+  if (range.begin >= end || n == 0) {
+    return end;
+  }
+  // Views of contiguous sources all point into the same memory, so a line's
+  // offset is its distance from the start
+  auto data = source.read(0, end);
+  if (!data) {
+    return std::nullopt;
+  }
+  size_t start = end;
+  for (auto line : tail<Source, Parameters>(source, n, std::nullopt, range)) {
+    start = line.data() - data->data();
   }
+  return start;
 }
@@ -0,0 +1,46 @@
+#include "time_range.h"
+
+#include <fstream>
+
+#include "mapped_file.h"
+
+namespace {
+
+template <BlockSource Source>
+FileRange find_time_range(Source& source, size_t size,
+    const TimestampParser& parser, std::optional<Timestamp> since,
+    std::optional<Timestamp> until) {
+  FileRange result{0, size};
+  // The end goes first, so that the start is looked for in a smaller range
+  if (until) {
+    result.end = find_first_timestamped_line(source, parser, result,
+        [&](Timestamp timestamp) { return timestamp > *until; });
+  }
+  if (since) {
+    result.begin = find_first_timestamped_line(source, parser, result,
+        [&](Timestamp timestamp) { return timestamp >= *since; });
+  }
+  return result;
+}
+
+}  // namespace
+
+std::optional<FileRange> find_time_range(const std::filesystem::path& path,
+    const TimestampParser& parser, std::optional<Timestamp> since,
+    std::optional<Timestamp> until) {
+  if (auto mapped_file = MappedFile::open(path)) {
+    return find_time_range(
+        *mapped_file, mapped_file->size(), parser, since, until);
+  }
+
+  std::ifstream input(path);
+  if (!input) {
+    return std::nullopt;
+  }
+  StreamBlockSource source(input, time_range_detail::SEARCH_BLOCK_SIZE);
+  auto size = source.size();
+  if (!size) {
+    return std::nullopt;
+  }
+  return find_time_range(source, *size, parser, since, until);
+}
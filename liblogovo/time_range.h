@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+
+#include "tail.h"
+#include "timestamp.h"
+
+// Part of a log file with lines timestamped within [since, until], found by
+// binary search over file offsets, so it takes O(log(file size)) reads.
+//
+// Lines are expected to be in the order of their timestamps. Lines without a
+// timestamp (like continuation lines of multi-line messages) go with the
+// closest line before them that has one.
+//
+// Returns nullopt if the file can't be opened.
+std::optional<FileRange> find_time_range(const std::filesystem::path& path,
+    const TimestampParser& parser, std::optional<Timestamp> since,
+    std::optional<Timestamp> until);
+
+namespace time_range_detail {
+
+constexpr size_t SEARCH_BLOCK_SIZE = 64 * 1024;
+
+template <BlockSource Source>
+std::string_view read(Source& source, size_t offset, size_t size) {
+  auto data = source.read(offset, size);
+  if (!data) {
+    throw std::runtime_error("Failed to read the file");
+  }
+  return *data;
+}
+
+// Position of the first newline in [from, to), if any
+template <BlockSource Source>
+std::optional<size_t> find_newline(
+    Source& source, size_t from, size_t to, size_t block_size) {
+  while (from < to) {
+    size_t size = std::min(to - from, block_size);
+    auto position = read(source, from, size).find('\n');
+    if (position != std::string_view::npos) {
+      return from + position;
+    }
+    from += size;
+  }
+  return std::nullopt;
+}
+
+struct TimestampedLine {
+  size_t start;
+  Timestamp timestamp;
+};
+
+// First line that starts in [from, to) and has a timestamp. `range.end` is
+// where the data ends.
+template <BlockSource Source>
+std::optional<TimestampedLine> first_timestamped_line(Source& source,
+    const TimestampParser& parser, FileRange range, size_t from, size_t to,
+    size_t block_size) {
+  size_t line_start = from;
+  if (from > range.begin) {
+    auto newline = find_newline(source, from - 1, to, block_size);
+    if (!newline) {
+      return std::nullopt;
+    }
+    line_start = *newline + 1;
+  }
+  while (line_start < to) {
+    auto prefix = read(source, line_start,
+        std::min({parser.max_length(), block_size, range.end - line_start}));
+    prefix = prefix.substr(0, prefix.find('\n'));
+    if (auto timestamp = parser.parse(prefix)) {
+      return TimestampedLine{line_start, *timestamp};
+    }
+    auto newline = find_newline(source, line_start, to, block_size);
+    if (!newline) {
+      return std::nullopt;
+    }
+    line_start = *newline + 1;
+  }
+  return std::nullopt;
+}
+
+}  // namespace time_range_detail
+
+// Start of the first line in `range` that has a timestamp satisfying
+// `predicate` (`range.end` if there are none), given that the predicate is
+// false for all timestamps before some point and true after it. `range.end`
+// must not be past the end of `source`. `source` is read in blocks of up to
+// `block_size` bytes.
+template <BlockSource Source, typename Predicate>
+size_t find_first_timestamped_line(Source& source,
+    const TimestampParser& parser, FileRange range, Predicate predicate,
+    size_t block_size = time_range_detail::SEARCH_BLOCK_SIZE) {
+  // The line we're looking for is either `result`, or starts in [low, high)
+  size_t result = range.end;
+  size_t low = range.begin;
+  size_t high = range.end;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    auto line = time_range_detail::first_timestamped_line(
+        source, parser, range, middle, high, block_size);
+    if (!line) {
+      // Nothing in [middle, high) tells anything
+      high = middle;
+    } else if (predicate(line->timestamp)) {
+      // There are no timestamped lines between `middle` and this one
+      result = line->start;
+      high = middle;
+    } else {
+      low = line->start + 1;
+    }
+  }
+  return result;
+}
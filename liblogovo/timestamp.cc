@@ -0,0 +1,151 @@
+#include "timestamp.h"
+
+#include <cstdint>
+
+namespace {
+
+constexpr size_t MAX_FRACTION_DIGITS = 9;
+
+// Width of a numeric field, 0 for non-numeric ones
+size_t field_width(char kind) {
+  switch (kind) {
+    case 'Y':
+      return 4;
+    case 'm':
+    case 'd':
+    case 'H':
+    case 'M':
+    case 'S':
+      return 2;
+    case 'f':
+      return MAX_FRACTION_DIGITS;
+    default:
+      return 0;
+  }
+}
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+}  // namespace
+
+std::optional<TimestampParser> TimestampParser::create(
+    std::string_view format) {
+  std::vector<Field> fields;
+  for (size_t i = 0; i < format.size(); ++i) {
+    if (format[i] != '%') {
+      fields.push_back({0, format[i]});
+      continue;
+    }
+    if (++i == format.size()) {
+      return std::nullopt;
+    }
+    if (format[i] == '%') {
+      fields.push_back({0, '%'});
+    } else if (field_width(format[i]) != 0) {
+      fields.push_back({format[i], 0});
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (fields.empty()) {
+    return std::nullopt;
+  }
+  return TimestampParser(std::move(fields));
+}
+
+TimestampParser::TimestampParser(std::vector<Field> fields)
+    : fields_(std::move(fields)), max_length_(0) {
+  for (const auto& field : fields_) {
+    max_length_ += field.kind == 0 ? 1 : field_width(field.kind);
+  }
+}
+
+std::optional<Timestamp> TimestampParser::parse(
+    std::string_view line, size_t* length) const {
+  int year = 1970;
+  unsigned month = 1, day = 1, hours = 0, minutes = 0, seconds = 0;
+  uint64_t nanoseconds = 0;
+
+  size_t pos = 0;
+  for (const auto& field : fields_) {
+    if (field.kind == 0) {
+      if (pos == line.size() || line[pos] != field.literal) {
+        return std::nullopt;
+      }
+      ++pos;
+      continue;
+    }
+
+    // Fractions take as many digits as there are, the rest have fixed widths
+    size_t width = field_width(field.kind);
+    uint64_t value = 0;
+    size_t digits = 0;
+    while (digits < width && pos < line.size() && is_digit(line[pos])) {
+      value = value * 10 + (line[pos] - '0');
+      ++digits;
+      ++pos;
+    }
+    if (digits == 0 || (field.kind != 'f' && digits != width)) {
+      return std::nullopt;
+    }
+    switch (field.kind) {
+      case 'Y':
+        year = value;
+        break;
+      case 'm':
+        month = value;
+        break;
+      case 'd':
+        day = value;
+        break;
+      case 'H':
+        hours = value;
+        break;
+      case 'M':
+        minutes = value;
+        break;
+      case 'S':
+        seconds = value;
+        break;
+      case 'f':
+        for (; digits < MAX_FRACTION_DIGITS; ++digits) {
+          value *= 10;
+        }
+        nanoseconds = value;
+        break;
+    }
+  }
+
+  std::chrono::year_month_day date{std::chrono::year(year),
+      std::chrono::month(month), std::chrono::day(day)};
+  // Leap seconds are let through
+  if (!date.ok() || hours > 23 || minutes > 59 || seconds > 60) {
+    return std::nullopt;
+  }
+  if (length) {
+    *length = pos;
+  }
+  return Timestamp(std::chrono::sys_days(date)) + std::chrono::hours(hours) +
+         std::chrono::minutes(minutes) + std::chrono::seconds(seconds) +
+         std::chrono::nanoseconds(nanoseconds);
+}
+
+std::optional<Timestamp> parse_request_timestamp(std::string_view value) {
+  static const auto parsers = [] {
+    std::vector<TimestampParser> result;
+    for (auto format : {"%Y-%m-%dT%H:%M:%S.%f", "%Y-%m-%dT%H:%M:%S",
+             "%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M:%S.%f", "%Y-%m-%d %H:%M:%S",
+             "%Y-%m-%d %H:%M"}) {
+      result.push_back(*TimestampParser::create(format));
+    }
+    return result;
+  }();
+  for (const auto& parser : parsers) {
+    size_t length;
+    auto result = parser.parse(value, &length);
+    if (result && length == value.size()) {
+      return result;
+    }
+  }
+  return std::nullopt;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Points in time are compared as is, without any time zones involved: log
+// timestamps and the ones in requests are expected to be in the same zone.
+using Timestamp = std::chrono::sys_time<std::chrono::nanoseconds>;
+
+// Parses timestamps at the start of log lines, according to a strftime-like
+// format. Supported fields are `%Y`, `%m`, `%d`, `%H`, `%M`, `%S` (all of them
+// with leading zeroes), `%f` (fraction of a second, 1 to 9 digits) and `%%`,
+// everything else has to match literally. Fields that aren't in the format
+// are zero (or one for the month and the day).
+//
+// E.g. "[%Y-%m-%d %H:%M:%S.%f]" for lines like "[2024-05-01 14:02:03.123] ...".
+class TimestampParser {
+ public:
+  // Returns nullopt if the format is invalid
+  static std::optional<TimestampParser> create(std::string_view format);
+
+  // Returns nullopt if the line doesn't start with a timestamp. Stores the
+  // length of the timestamp in `length` (if given).
+  std::optional<Timestamp> parse(
+      std::string_view line, size_t* length = nullptr) const;
+
+  // The most characters of a line `parse` may look at
+  size_t max_length() const { return max_length_; }
+
+ private:
+  struct Field {
+    // One of the format letters, or 0 for a literal character
+    char kind;
+    char literal;
+  };
+
+  explicit TimestampParser(std::vector<Field> fields);
+
+  std::vector<Field> fields_;
+  size_t max_length_;
+};
+
+// Parses timestamps given in requests: "YYYY-MM-DDTHH:MM[:SS[.fraction]]",
+// with either 'T' or a space between the date and the time.
+std::optional<Timestamp> parse_request_timestamp(std::string_view value);
@@ -0,0 +1,354 @@
+#include "trigram_index.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "posix_file.h"
+
+namespace {
+
+constexpr char MAGIC[8] = {'L', 'G', 'V', 'T', 'I', 'D', 'X', '2'};
+// A region is summarized along with the trigrams starting in its last bytes,
+// which end in the next region
+constexpr size_t TRIGRAM_OVERHANG = 2;
+// Every region is noted along with a hash of its last this many bytes, to
+// tell whether the file still has the same content there
+constexpr size_t SAMPLE_SIZE = 4096;
+
+using Bits = std::array<uint16_t, 2>;
+
+Bits trigram_bits(uint32_t trigram) {
+  return {static_cast<uint16_t>((trigram * 0x9e3779b1u) >> 16),
+      static_cast<uint16_t>((trigram * 0x85ebca77u) >> 16)};
+}
+
+bool has_bits(const TrigramIndex::Region& region, Bits bits) {
+  for (auto bit : bits) {
+    if (!(region[bit / 64] >> (bit % 64) & 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Bloom filter of the trigrams starting in the first `REGION_SIZE` bytes of
+// `data`
+TrigramIndex::Region summarize(std::string_view data) {
+  TrigramIndex::Region region{};
+  uint32_t trigram = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
+    trigram = (trigram << 8 | static_cast<unsigned char>(data[i])) & 0xffffff;
+    if (i >= 2) {
+      for (auto bit : trigram_bits(trigram)) {
+        region[bit / 64] |= uint64_t(1) << (bit % 64);
+      }
+    }
+  }
+  return region;
+}
+
+// FNV-1a, which is stable across builds, unlike `std::hash`
+uint64_t sample_hash(std::string_view data) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 0x100000001b3;
+  }
+  return hash;
+}
+
+// Hash of the last bytes of the region of the file at `index`
+std::optional<uint64_t> read_sample(int fd, size_t index) {
+  char data[SAMPLE_SIZE];
+  size_t end = (index + 1) * TrigramIndex::REGION_SIZE;
+  if (!pread_exactly(fd, data, SAMPLE_SIZE, end - SAMPLE_SIZE)) {
+    return std::nullopt;
+  }
+  return sample_hash(std::string_view(data, SAMPLE_SIZE));
+}
+
+}  // namespace
+
+// On-disk layout of the index is this header followed by the regions, each
+// followed by its sample, all in native byte order (the index is a cache local
+// to the machine anyway).
+struct TrigramIndex::Header {
+  char magic[8];
+  uint64_t device;
+  uint64_t inode;
+  uint64_t region_size;
+  uint64_t region_count;
+  uint64_t file_size;
+};
+
+size_t TrigramIndex::record_offset(size_t index) {
+  return sizeof(Header) + index * (sizeof(Region) + sizeof(uint64_t));
+}
+
+TrigramIndex::TrigramIndex(std::filesystem::path index_path)
+    : index_path_(std::move(index_path)),
+      regions_(std::make_shared<Regions>()) {}
+
+void TrigramIndex::load() {
+  loaded_ = true;
+  reset({});
+
+  FileDescriptor fd(::open(index_path_.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd) {
+    return;
+  }
+  Header header;
+  if (!pread_exactly(fd.get(), &header, sizeof(header), 0) ||
+      std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.region_size != REGION_SIZE) {
+    spdlog::info(
+        "Ignoring incompatible trigram index at {}", index_path_.string());
+    return;
+  }
+  auto regions = std::make_shared<Regions>();
+  regions->reserve(header.region_count);
+  std::vector<uint64_t> samples(header.region_count);
+  for (size_t i = 0; i < header.region_count; ++i) {
+    auto region = std::make_shared<Region>();
+    if (!pread_exactly(
+            fd.get(), region->data(), sizeof(Region), record_offset(i)) ||
+        !pread_exactly(fd.get(), &samples[i], sizeof(uint64_t),
+            record_offset(i) + sizeof(Region))) {
+      spdlog::warn("Trigram index at {} is truncated", index_path_.string());
+      return;
+    }
+    regions->push_back(std::move(region));
+  }
+  file_ = {header.device, header.inode};
+  file_size_ = header.file_size;
+  regions_ = std::move(regions);
+  samples_ = std::move(samples);
+  // The file may have changed in any way while nobody was watching
+  verify_all_ = true;
+}
+
+void TrigramIndex::reset(const FileIdentity& file) {
+  file_ = file;
+  file_size_ = 0;
+  regions_ = std::make_shared<Regions>();
+  samples_.clear();
+}
+
+bool TrigramIndex::save(size_t first_new_region) const {
+  std::filesystem::create_directories(index_path_.parent_path());
+  // A new index is written elsewhere and renamed over the old one. Regions
+  // are only appended to an existing index otherwise, and the header is
+  // written last, so that an interrupted save leaves the index consistent
+  // with its previous state either way.
+  bool rewrite = first_new_region == 0;
+  auto path = index_path_;
+  if (rewrite) {
+    path += ".tmp";
+  }
+  FileDescriptor fd(::open(path.c_str(),
+      O_WRONLY | O_CREAT | O_CLOEXEC | (rewrite ? O_TRUNC : 0), 0644));
+  if (!fd) {
+    return false;
+  }
+  for (size_t i = first_new_region; i < regions_->size(); ++i) {
+    if (!pwrite_exactly(fd.get(), (*regions_)[i]->data(), sizeof(Region),
+            record_offset(i)) ||
+        !pwrite_exactly(fd.get(), &samples_[i], sizeof(uint64_t),
+            record_offset(i) + sizeof(Region))) {
+      return false;
+    }
+  }
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.device = file_.device;
+  header.inode = file_.inode;
+  header.region_size = REGION_SIZE;
+  header.region_count = regions_->size();
+  header.file_size = file_size_;
+  if (!pwrite_exactly(fd.get(), &header, sizeof(header), 0)) {
+    return false;
+  }
+  return !rewrite || ::rename(path.c_str(), index_path_.c_str()) == 0;
+}
+
+bool TrigramIndex::same_content(int fd, size_t size) const {
+  if (size < file_size_) {
+    // Truncated, maybe grown again since
+    return false;
+  }
+  if (regions_->empty()) {
+    return true;
+  }
+  // Rewriting a file in place (copytruncate) starts from its beginning, and
+  // appending doesn't touch any of the summarized regions. So the first and
+  // the last ones tell, unless the index was just loaded.
+  auto matches = [&](size_t i) { return read_sample(fd, i) == samples_[i]; };
+  if (verify_all_) {
+    for (size_t i = 0; i < regions_->size(); ++i) {
+      if (!matches(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return matches(0) && matches(regions_->size() - 1);
+}
+
+bool TrigramIndex::update(const std::filesystem::path& log_path,
+    size_t max_regions, ScanBudget* budget) {
+  std::lock_guard lock(mutex_);
+  if (!loaded_) {
+    load();
+  }
+
+  FileDescriptor fd(::open(log_path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (!fd || fstat(fd.get(), &st) != 0) {
+    return false;
+  }
+  size_t size = st.st_size;
+  FileIdentity file{st.st_dev, st.st_ino};
+
+  // Inodes get reused, and files get truncated and written anew, so the
+  // summarized part is double checked to be still the same
+  bool same_file = file == file_ && same_content(fd.get(), size);
+  verify_all_ = false;
+  if (!same_file) {
+    if (!regions_->empty()) {
+      spdlog::info(
+          "{} was truncated or replaced, rebuilding its trigram index",
+          log_path.string());
+    }
+    reset(file);
+  }
+  // Only ever grows as long as the index is of the same file
+  file_size_ = size;
+
+  size_t region_count =
+      size < TRIGRAM_OVERHANG ? 0 : (size - TRIGRAM_OVERHANG) / REGION_SIZE;
+  size_t first_new_region = regions_->size();
+  if (region_count <= first_new_region) {
+    return true;
+  }
+  region_count = first_new_region +
+                 std::min(region_count - first_new_region, max_regions);
+
+  auto regions = std::make_shared<Regions>(*regions_);
+  std::vector<char> block(REGION_SIZE + TRIGRAM_OVERHANG);
+  bool ok = true;
+  for (size_t i = first_new_region; i < region_count; ++i) {
+    if (budget && !budget->spend(block.size())) {
+      break;
+    }
+    if (!pread_exactly(fd.get(), block.data(), block.size(), i * REGION_SIZE)) {
+      // The regions summarized so far are still good
+      ok = false;
+      break;
+    }
+    regions->push_back(std::make_shared<Region>(
+        summarize(std::string_view(block.data(), block.size()))));
+    samples_.push_back(sample_hash(std::string_view(
+        block.data() + REGION_SIZE - SAMPLE_SIZE, SAMPLE_SIZE)));
+  }
+  if (regions->size() == first_new_region) {
+    return ok;
+  }
+  regions_ = std::move(regions);
+
+  if (!save(first_new_region)) {
+    // The index is still usable in memory, it just won't survive a restart
+    spdlog::warn("Failed to save trigram index at {}: {}",
+        index_path_.string(), strerror(errno));
+  }
+  return ok;
+}
+
+std::shared_ptr<const TrigramIndex::Regions> TrigramIndex::regions(
+    const FileIdentity& file) const {
+  std::lock_guard lock(mutex_);
+  if (file != file_) {
+    return nullptr;
+  }
+  return regions_;
+}
+
+TrigramSkip::TrigramSkip(std::shared_ptr<const TrigramIndex::Regions> regions,
+    size_t length, std::vector<Bits> bits)
+    : regions_(std::move(regions)), length_(length), bits_(std::move(bits)) {}
+
+std::optional<TrigramSkip> TrigramSkip::create(
+    std::shared_ptr<const TrigramIndex::Regions> regions, const Grep& grep) {
+  const auto& query = grep.query();
+  if (!regions || query.ignore_case) {
+    return std::nullopt;
+  }
+  // Every matching line has all of `all`, the longest one rules out the most
+  const std::string* substring = nullptr;
+  for (const auto& value : query.all) {
+    if (!substring || value.size() > substring->size()) {
+      substring = &value;
+    }
+  }
+  if (!substring || substring->size() < 3) {
+    return std::nullopt;
+  }
+  std::vector<Bits> bits;
+  uint32_t trigram = 0;
+  for (size_t i = 0; i < substring->size(); ++i) {
+    trigram = (trigram << 8 | static_cast<unsigned char>((*substring)[i])) &
+              0xffffff;
+    if (i >= 2) {
+      bits.push_back(trigram_bits(trigram));
+    }
+  }
+  return TrigramSkip(std::move(regions), substring->size(), std::move(bits));
+}
+
+size_t TrigramSkip::skippable_start(size_t begin, size_t end) const {
+  constexpr size_t REGION_SIZE = TrigramIndex::REGION_SIZE;
+  const auto& regions = *regions_;
+  if (end <= begin) {
+    return end;
+  }
+  // A hit in [start, end) has its trigrams in the regions that overlap
+  // [start - length_, end + length_)
+  size_t last = (end + length_ - 1) / REGION_SIZE;
+  if (last >= regions.size()) {
+    return end;
+  }
+
+  // Which trigrams the regions [next, last] may have
+  std::vector<bool> seen(bits_.size());
+  size_t seen_count = 0;
+  size_t next = last + 1;
+  // Looks at the regions down to `first`, returns whether they may have all
+  // the trigrams, i.e. a hit
+  auto may_have_hit = [&](size_t first) {
+    while (next > first && seen_count < bits_.size()) {
+      const auto& region = *regions[--next];
+      for (size_t i = 0; i < bits_.size(); ++i) {
+        if (!seen[i] && has_bits(region, bits_[i])) {
+          seen[i] = true;
+          ++seen_count;
+        }
+      }
+    }
+    return seen_count == bits_.size();
+  };
+
+  size_t start = end;
+  while (start > begin) {
+    size_t candidate = std::max(begin, (start - 1) / REGION_SIZE * REGION_SIZE);
+    size_t first =
+        candidate >= length_ ? (candidate - length_) / REGION_SIZE : 0;
+    if (may_have_hit(first)) {
+      break;
+    }
+    start = candidate;
+  }
+  return start;
+}
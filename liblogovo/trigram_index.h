@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "grep.h"
+#include "mapped_file.h"
+#include "scan_budget.h"
+
+// Persistent summary of the trigrams (substrings of 3 bytes) of a log file,
+// kept in a sidecar file next to the line indexes: a bloom filter per region
+// of `REGION_SIZE` bytes, which tells the trigrams the region surely doesn't
+// have. Filtered scans skip the regions that can't have a substring of the
+// filter (see `TrigramSkip`), so looking for a rare term in a large file only
+// reads a small part of it.
+//
+// Only whole regions are summarized (the part of the file that is still being
+// written to is always scanned), and the index is brought up to date
+// incrementally as the file grows, like `LineIndex`.
+//
+// All methods are thread-safe.
+class TrigramIndex {
+ public:
+  static constexpr size_t REGION_SIZE = 1024 * 1024;
+  // Bloom filter of the trigrams starting in a region, 64 Kbit (0.8% of the
+  // region) with 2 bits per trigram
+  using Region = std::array<uint64_t, 1024>;
+  using Regions = std::vector<std::shared_ptr<const Region>>;
+
+  explicit TrigramIndex(std::filesystem::path index_path);
+
+  // Summarizes the regions of the file at `log_path` completed since the last
+  // update, up to `max_regions` of them, the ones after that are left for the
+  // next updates. Reading them is spent from the `budget` (if given), and
+  // stops once it runs out. Returns false if the file can't be read.
+  bool update(const std::filesystem::path& log_path,
+      size_t max_regions = std::numeric_limits<size_t>::max(),
+      ScanBudget* budget = nullptr);
+
+  // Summaries of the regions as of the last update, the i-th one is of
+  // [i * REGION_SIZE, (i + 1) * REGION_SIZE). Returns nullptr if the index is
+  // of another file than `file` (e.g. it has been rotated meanwhile).
+  std::shared_ptr<const Regions> regions(const FileIdentity& file) const;
+
+ private:
+  struct Header;
+
+  // Where the i-th region (and its sample) is in the index file
+  static size_t record_offset(size_t index);
+
+  void load();
+  void reset(const FileIdentity& file);
+  bool save(size_t first_new_region) const;
+  // Whether the file (open as `fd`, `size` bytes now) still has the content
+  // the regions were summarized from
+  bool same_content(int fd, size_t size) const;
+
+  mutable std::mutex mutex_;
+  std::filesystem::path index_path_;
+  bool loaded_ = false;
+
+  FileIdentity file_;
+  // Size of the file as of the last update, it's truncated if it's smaller
+  size_t file_size_ = 0;
+  // Replaced rather than modified on updates, so that scans can go on with
+  // the summaries they got
+  std::shared_ptr<const Regions> regions_;
+  // Hash of the last bytes of every region, to tell the file from another one
+  // that reused its inode, or from itself written anew
+  std::vector<uint64_t> samples_;
+  // Set once the index is loaded, so that all the samples are checked at the
+  // next update rather than only the first and the last one
+  bool verify_all_ = false;
+};
+
+// Rules out parts of a file a filter can't match in, by the `TrigramIndex` of
+// the file and the trigrams of a substring every matching line has.
+class TrigramSkip {
+ public:
+  // Returns nullopt if the filter has no substring of at least 3 bytes that
+  // every matching line has (with the same case)
+  static std::optional<TrigramSkip> create(
+      std::shared_ptr<const TrigramIndex::Regions> regions, const Grep& grep);
+
+  // Start of the longest part [start, end) of the file (from `begin` on) that
+  // can't have a hit, `end` if nothing can be ruled out. Goes in whole
+  // regions, down to `begin`.
+  size_t skippable_start(size_t begin, size_t end) const;
+
+ private:
+  using Bits = std::array<uint16_t, 2>;
+
+  TrigramSkip(std::shared_ptr<const TrigramIndex::Regions> regions,
+      size_t length, std::vector<Bits> bits);
+
+  std::shared_ptr<const TrigramIndex::Regions> regions_;
+  // Length of the substring: a hit is at most this far from its trigrams
+  size_t length_;
+  // Bits of every trigram of the substring in the bloom filters
+  std::vector<Bits> bits_;
+};
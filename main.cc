@@ -1,9 +1,11 @@
 #include <liblogovo/handler.h>
 #include <liblogovo/server.h>
 #include <spdlog/spdlog.h>
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <thread>
 
 namespace po = boost::program_options;
 
@@ -12,6 +14,11 @@ int main(int argc, char* argv[]) {
   std::string log_root;
   std::string listen_at;
   ushort port;
+  HandlerOptions handler_options;
+  ServerOptions server_options;
+  std::string index_dir;
+  bool skip_rotated;
+  std::string decompress_dir;
 
   po::options_description desc("Allowed options");
   // clang-format off
@@ -21,10 +28,112 @@ int main(int argc, char* argv[]) {
       "enable trace logs")
     ("log-root", po::value<std::string>(&log_root)->default_value("."),
       "log root directory to serve logs from")
-    ("listen-at", po::value<std::string>(&listen_at)->default_value("127.0.0.1"),
+    ("listen-at",
+      po::value<std::string>(&listen_at)->default_value("127.0.0.1"),
       "network address to listen at")
     ("port", po::value<ushort>(&port)->default_value(8080),
-      "network port to listen at");
+      "network port to listen at")
+    ("threads",
+      po::value<size_t>(&server_options.threads)
+        ->default_value(server_options.threads),
+      "threads to serve connections on, 0 means one per CPU")
+    ("per-core",
+      po::bool_switch(&server_options.per_core)->default_value(false),
+      "run an io_context with its own listening socket on every thread, "
+      "pinned to a CPU")
+    ("max-sessions",
+      po::value<size_t>(&server_options.max_sessions)
+        ->default_value(server_options.max_sessions),
+      "connections to serve at once, 0 means no limit")
+    ("write-buffer-size",
+      po::value<size_t>(&handler_options.write_buffer_size)
+        ->default_value(handler_options.write_buffer_size),
+      "size of batches log lines are sent in, 0 sends lines one by one")
+    ("index-dir", po::value<std::string>(&index_dir),
+      "directory to keep line indexes in, enables line range requests")
+    ("index-every",
+      po::value<size_t>(&handler_options.index_sample_every)
+        ->default_value(handler_options.index_sample_every),
+      "line indexes keep the offset of every this many lines")
+    ("grep-index",
+      po::bool_switch(&handler_options.grep_index)->default_value(false),
+      "keep trigram indexes of filtered files in the index directory, to "
+      "skip the parts of files filters can't match in")
+    ("read-threads",
+      po::value<size_t>(&handler_options.read_threads)
+        ->default_value(handler_options.read_threads),
+      "threads to read log files on, 0 reads them on the serving threads")
+    ("scan-threads",
+      po::value<size_t>(&handler_options.scan_threads)
+        ->default_value(std::thread::hardware_concurrency()),
+      "threads to search large files on in parallel, 0 or 1 disables that")
+    ("skip-rotated", po::bool_switch(&skip_rotated)->default_value(false),
+      "don't go on with rotated generations of files (app.log.1, ...)")
+    ("decompress-dir",
+      po::value<std::string>(&decompress_dir)->default_value(
+        (std::filesystem::temp_directory_path() /
+            ("logovo-" + std::to_string(geteuid()))).string()),
+      "directory to keep decompressed copies of rotated generations in")
+    ("decompress-dir-size",
+      po::value<size_t>(&handler_options.decompress_dir_size)
+        ->default_value(handler_options.decompress_dir_size),
+      "the most decompressed copies may take, in bytes")
+    ("timestamp-format",
+      po::value<std::string>(&handler_options.timestamp_format)
+        ->default_value(handler_options.timestamp_format),
+      "format of timestamps at the start of log lines, for time ranges")
+    ("metrics-path",
+      po::value<std::string>(&handler_options.metrics_path)
+        ->default_value(handler_options.metrics_path),
+      "path to serve Prometheus metrics at, empty disables them")
+    ("merge-path",
+      po::value<std::string>(&handler_options.merge_path)
+        ->default_value(handler_options.merge_path),
+      "path to serve merged tails of several files at, empty disables them")
+    ("log-requests-every",
+      po::value<size_t>(&handler_options.log_requests_every)
+        ->default_value(handler_options.log_requests_every),
+      "log every this many requests, 0 disables request logging")
+    ("gzip-level",
+      po::value<int>(&handler_options.gzip_level)
+        ->default_value(handler_options.gzip_level),
+      "gzip compression level of responses, 1 to 9")
+    ("zstd-level",
+      po::value<int>(&handler_options.zstd_level)
+        ->default_value(handler_options.zstd_level),
+      "zstd compression level of responses")
+    ("compression-cpu-budget",
+      po::value<double>(&handler_options.compression_cpu_budget)
+        ->default_value(handler_options.compression_cpu_budget),
+      "CPU seconds per second compression may take, 0 disables compression")
+    ("result-cache-size",
+      po::value<size_t>(&handler_options.result_cache_size)
+        ->default_value(handler_options.result_cache_size),
+      "memory for results of recent requests, in bytes, 0 disables caching")
+    ("file-cache-size",
+      po::value<size_t>(&handler_options.file_cache_size)
+        ->default_value(handler_options.file_cache_size),
+      "log files to keep open and mapped between requests, 0 disables it")
+    ("max-scans",
+      po::value<size_t>(&handler_options.max_scans)
+        ->default_value(handler_options.max_scans),
+      "requests scanning log files to serve at once, 0 means no limit")
+    ("max-queued-scans",
+      po::value<size_t>(&handler_options.max_queued_scans)
+        ->default_value(handler_options.max_queued_scans),
+      "requests to keep waiting for a scan slot, more get a 429")
+    ("scan-queue-timeout",
+      po::value<double>(&handler_options.scan_queue_timeout)
+        ->default_value(handler_options.scan_queue_timeout),
+      "seconds a request may wait for a scan slot before getting a 503")
+    ("scan-byte-budget",
+      po::value<size_t>(&handler_options.scan_byte_budget)
+        ->default_value(handler_options.scan_byte_budget),
+      "the most a request may scan, in bytes, 0 means no limit")
+    ("scan-time-budget",
+      po::value<double>(&handler_options.scan_time_budget)
+        ->default_value(handler_options.scan_time_budget),
+      "the most a request may scan for, in seconds, 0 means no limit");
   // clang-format on
   po::positional_options_description p;
   p.add("log-root", 1);
@@ -46,8 +155,17 @@ int main(int argc, char* argv[]) {
       spdlog::set_level(spdlog::level::info);
     }
 
-    Handler handler(std::filesystem::canonical(log_root));
-    Server server(handler, listen_at, port);
+    if (!index_dir.empty()) {
+      handler_options.index_dir = std::filesystem::absolute(index_dir);
+    }
+    handler_options.read_rotated = !skip_rotated;
+    if (!decompress_dir.empty()) {
+      handler_options.decompress_dir =
+          std::filesystem::absolute(decompress_dir);
+    }
+
+    Handler handler(std::filesystem::canonical(log_root), handler_options);
+    Server server(handler, listen_at, port, server_options);
     server.serve();
   } catch (const std::exception& e) {
     spdlog::error(e.what());
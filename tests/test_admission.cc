@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <liblogovo/admission.h>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+
+namespace asio = boost::asio;
+
+namespace {
+
+// Outcome of a single `acquire`, the ticket is kept until `release`d
+struct Attempt {
+  std::optional<Admission::Ticket> ticket;
+  std::optional<Admission::Rejection> rejection;
+  bool done = false;
+
+  void release() { ticket.reset(); }
+};
+
+void attempt(asio::io_context& io, Admission& admission, Attempt& result) {
+  asio::co_spawn(
+      io,
+      [&]() -> asio::awaitable<void> {
+        Admission::Rejection rejection;
+        result.ticket = co_await admission.acquire(&rejection);
+        if (!result.ticket) {
+          result.rejection = rejection;
+        }
+        result.done = true;
+      },
+      asio::detached);
+}
+
+}  // namespace
+
+TEST(Admission, Queue) {
+  asio::io_context io;
+  Admission admission(1, 1, std::chrono::seconds(10));
+  Attempt first, second, third;
+  attempt(io, admission, first);
+  attempt(io, admission, second);
+  attempt(io, admission, third);
+  io.run_for(std::chrono::milliseconds(10));
+
+  EXPECT_TRUE(first.done);
+  EXPECT_TRUE(first.ticket);
+  // Waits for the first one
+  EXPECT_FALSE(second.done);
+  // Nowhere to wait
+  EXPECT_TRUE(third.done);
+  EXPECT_EQ(third.rejection, Admission::Rejection::QUEUE_FULL);
+
+  first.release();
+  io.restart();
+  io.run_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(second.done);
+  EXPECT_TRUE(second.ticket);
+
+  // The slot is still taken by the second one
+  Attempt fourth;
+  attempt(io, admission, fourth);
+  io.restart();
+  io.run_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(fourth.done);
+  second.release();
+  io.restart();
+  io.run_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(fourth.ticket);
+}
+
+TEST(Admission, TimesOut) {
+  asio::io_context io;
+  Admission admission(1, 10, std::chrono::milliseconds(1));
+  Attempt first, second;
+  attempt(io, admission, first);
+  attempt(io, admission, second);
+  io.run_for(std::chrono::milliseconds(100));
+
+  EXPECT_TRUE(first.ticket);
+  EXPECT_TRUE(second.done);
+  EXPECT_EQ(second.rejection, Admission::Rejection::TIMED_OUT);
+
+  // The timed out scan left the queue, so the slot is free again afterwards
+  first.release();
+  Attempt third;
+  attempt(io, admission, third);
+  io.restart();
+  io.run_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(third.ticket);
+}
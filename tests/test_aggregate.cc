@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <liblogovo/aggregate.h>
+
+#include <initializer_list>
+
+namespace {
+
+std::string aggregate(const AggregationQuery& query,
+    std::initializer_list<std::string_view> lines) {
+  auto parser = *TimestampParser::create("%Y-%m-%d %H:%M:%S");
+  Aggregator aggregator(query, &parser);
+  for (auto line : lines) {
+    aggregator.add(line);
+  }
+  return aggregator.json();
+}
+
+}  // namespace
+
+TEST(Aggregate, ParseBucket) {
+  GTEST_ASSERT_EQ(parse_bucket("30"), std::chrono::seconds(30));
+  GTEST_ASSERT_EQ(parse_bucket("30s"), std::chrono::seconds(30));
+  GTEST_ASSERT_EQ(parse_bucket("5m"), std::chrono::minutes(5));
+  GTEST_ASSERT_EQ(parse_bucket("1h"), std::chrono::hours(1));
+  GTEST_ASSERT_EQ(parse_bucket("2d"), std::chrono::days(2));
+  GTEST_ASSERT_FALSE(parse_bucket(""));
+  GTEST_ASSERT_FALSE(parse_bucket("0m"));
+  GTEST_ASSERT_FALSE(parse_bucket("-1m"));
+  GTEST_ASSERT_FALSE(parse_bucket("1w"));
+  GTEST_ASSERT_FALSE(parse_bucket("1mm"));
+  GTEST_ASSERT_FALSE(parse_bucket("99999999999999d"));
+}
+
+TEST(Aggregate, FieldValue) {
+  std::string_view line = "10:00:01 GET /index status=200 took=5ms\n";
+  GTEST_ASSERT_EQ(field_value(line, "1"), "10:00:01");
+  GTEST_ASSERT_EQ(field_value(line, "2"), "GET");
+  GTEST_ASSERT_EQ(field_value(line, "5"), "took=5ms");
+  GTEST_ASSERT_FALSE(field_value(line, "6"));
+  GTEST_ASSERT_EQ(field_value(line, "status"), "200");
+  GTEST_ASSERT_EQ(field_value(line, "took"), "5ms");
+  GTEST_ASSERT_FALSE(field_value(line, "tatus"));
+  GTEST_ASSERT_FALSE(field_value(line, "user"));
+  GTEST_ASSERT_FALSE(field_value("", "1"));
+}
+
+TEST(Aggregate, Count) {
+  GTEST_ASSERT_EQ(aggregate({}, {}), R"({"count": 0})");
+  GTEST_ASSERT_EQ(aggregate({}, {"a\n", "b\n"}), R"({"count": 2})");
+}
+
+TEST(Aggregate, Histogram) {
+  AggregationQuery query;
+  query.histogram_bucket = std::chrono::minutes(1);
+  // Newest first, continuation lines go with the line before them in the file
+  GTEST_ASSERT_EQ(aggregate(query,
+                      {
+                          "2024-05-01 14:03:10 c\n",
+                          "  more\n",
+                          "2024-05-01 14:01:59 b\n",
+                          "2024-05-01 14:01:00 a\n",
+                          "header\n",
+                      }),
+      R"({"count": 5, "bucket_seconds": 60, "histogram": [)"
+      R"({"start": "2024-05-01T14:01:00", "count": 3}, )"
+      R"({"start": "2024-05-01T14:03:00", "count": 1}], "untimestamped": 1})");
+}
+
+TEST(Aggregate, TopK) {
+  AggregationQuery query;
+  query.topk_field = "user";
+  query.k = 2;
+  GTEST_ASSERT_EQ(aggregate(query,
+                      {
+                          "user=bob x\n",
+                          "user=alice\n",
+                          "nobody\n",
+                          "user=carol\n",
+                          "user=\"q\"\n",
+                          "user=bob\n",
+                      }),
+      R"({"count": 6, "field": "user", "top": [)"
+      R"({"value": "bob", "count": 2}, {"value": "\"q\"", "count": 1}], )"
+      R"("missing": 1})");
+}
+
+TEST(Aggregate, Truncated) {
+  Aggregator aggregator({}, nullptr);
+  aggregator.add("a\n");
+  aggregator.set_truncated("bytes");
+  GTEST_ASSERT_EQ(aggregator.json(), R"({"count": 1, "truncated": "bytes"})");
+}
+
+TEST(Aggregate, TopKOfManyValues) {
+  AggregationQuery query;
+  query.topk_field = "1";
+  query.k = 1;
+  Aggregator aggregator(query, nullptr);
+  // Far more distinct values than there are counters, with one of them in
+  // every other line
+  for (int i = 0; i < 10000; ++i) {
+    aggregator.add(i % 2 == 0 ? "common\n" : "id" + std::to_string(i) + "\n");
+  }
+  auto json = aggregator.json();
+  EXPECT_TRUE(json.starts_with(
+      R"({"count": 10000, "field": "1", "top": [{"value": "common", )"))
+      << json;
+  EXPECT_TRUE(json.ends_with(R"("missing": 0, "approximate": true})")) << json;
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <liblogovo/aho_corasick.h>
+
+TEST(AhoCorasick, FindsLastOccurrence) {
+  AhoCorasick search({"error", "warn", "fatal"}, false);
+  GTEST_ASSERT_EQ(search.find_last("warn: x, error: y"), 9);
+  GTEST_ASSERT_EQ(search.find_last("fatal"), 0);
+  GTEST_ASSERT_FALSE(search.find_last("info: erro"));
+  GTEST_ASSERT_FALSE(search.find_last(""));
+}
+
+TEST(AhoCorasick, OverlappingPatterns) {
+  // Patterns that are suffixes and prefixes of each other
+  AhoCorasick search({"abc", "bc", "bcd", "c"}, false);
+  GTEST_ASSERT_EQ(search.find_last("xabcx"), 3);
+  GTEST_ASSERT_EQ(search.find_last("xbcdx"), 2);
+  GTEST_ASSERT_EQ(search.find_last("ab"), std::nullopt);
+}
+
+TEST(AhoCorasick, IgnoreCase) {
+  AhoCorasick search({"Error"}, true);
+  GTEST_ASSERT_EQ(search.find_last("ERROR error"), 6);
+  GTEST_ASSERT_EQ(search.find_last("eRrOr"), 0);
+  GTEST_ASSERT_FALSE(AhoCorasick({"Error"}, false).find_last("error"));
+}
+
+TEST(AhoCorasick, EmptyPattern) {
+  AhoCorasick search({"x", ""}, false);
+  GTEST_ASSERT_EQ(search.find_last("abc"), 3);
+}
+
+TEST(AhoCorasick, MatchesNaiveSearch) {
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += static_cast<char>('a' + (i * i + 7 * i) % 3);
+  }
+  std::vector<std::string> patterns{"cab", "bbb", "acbac", "aa"};
+  AhoCorasick search(patterns, false);
+  for (size_t end = 0; end <= text.size(); end += 37) {
+    auto haystack = std::string_view(text).substr(0, end);
+    std::optional<size_t> expected;
+    for (const auto& pattern : patterns) {
+      auto found = haystack.rfind(pattern);
+      if (found != std::string_view::npos && (!expected || found > *expected)) {
+        expected = found;
+      }
+    }
+    GTEST_ASSERT_EQ(search.find_last(haystack), expected) << "in first " << end;
+  }
+}
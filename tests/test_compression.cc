@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <liblogovo/compression.h>
+#include <zlib.h>
+
+#include <thread>
+
+namespace {
+
+// Inflates a gzip stream, returns nullopt if it's not complete
+std::optional<std::string> gunzip(const std::string& compressed) {
+  z_stream stream{};
+  inflateInit2(&stream, 15 + 16);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = compressed.size();
+  std::string result;
+  int status;
+  do {
+    char buffer[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    result.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (status == Z_OK && stream.avail_out == 0);
+  inflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(Compression, ChooseEncoding) {
+  EXPECT_EQ(choose_content_encoding(""), ContentEncoding::IDENTITY);
+  EXPECT_EQ(choose_content_encoding("br, deflate"), ContentEncoding::IDENTITY);
+  EXPECT_EQ(choose_content_encoding("gzip"), ContentEncoding::GZIP);
+  EXPECT_EQ(choose_content_encoding("GZip;q=0.5"), ContentEncoding::GZIP);
+  EXPECT_EQ(choose_content_encoding("gzip;q=0"), ContentEncoding::IDENTITY);
+#if defined(LOGOVO_HAVE_ZSTD)
+  EXPECT_EQ(choose_content_encoding("gzip, zstd"), ContentEncoding::ZSTD);
+  EXPECT_EQ(
+      choose_content_encoding("gzip, zstd;q=0.9"), ContentEncoding::GZIP);
+  EXPECT_EQ(choose_content_encoding("*"), ContentEncoding::ZSTD);
+#else
+  EXPECT_EQ(choose_content_encoding("gzip, zstd"), ContentEncoding::GZIP);
+  EXPECT_EQ(choose_content_encoding("zstd"), ContentEncoding::IDENTITY);
+  EXPECT_EQ(choose_content_encoding("*"), ContentEncoding::GZIP);
+#endif
+}
+
+TEST(Compression, GzipStreams) {
+  auto compressor = Compressor::create(ContentEncoding::GZIP, 6);
+  GTEST_ASSERT_TRUE(compressor);
+
+  std::string original;
+  std::string compressed;
+  for (int i = 0; i < 100; ++i) {
+    std::string batch;
+    for (int j = 0; j < 1000; ++j) {
+      batch += "line " + std::to_string(i * 1000 + j) + "\n";
+    }
+    original += batch;
+    auto output = compressor->compress(batch, false);
+    // Every batch is flushed, so it could be sent right away
+    EXPECT_FALSE(output.empty());
+    compressed += output;
+  }
+  EXPECT_LT(compressed.size(), original.size() / 3);
+  // Not finished yet
+  EXPECT_FALSE(gunzip(compressed));
+
+  compressed += compressor->compress("", true);
+  EXPECT_EQ(gunzip(compressed), original);
+}
+
+TEST(Compression, GzipSingleBatch) {
+  auto compressor = Compressor::create(ContentEncoding::GZIP, 1);
+  std::string compressed(compressor->compress("hello\n", true));
+  EXPECT_EQ(gunzip(compressed), "hello\n");
+}
+
+TEST(Compression, IdentityHasNoCompressor) {
+  EXPECT_FALSE(Compressor::create(ContentEncoding::IDENTITY, 6));
+}
+
+TEST(Compression, Budget) {
+  CompressionBudget budget(0.01);
+  EXPECT_TRUE(budget.available());
+  budget.spend(std::chrono::milliseconds(5));
+  EXPECT_TRUE(budget.available());
+  budget.spend(std::chrono::milliseconds(5));
+  EXPECT_FALSE(budget.available());
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <liblogovo/cursor.h>
+
+#include "test_utils.h"
+
+namespace {
+
+class CursorTest : public TempDirTest {
+ protected:
+  // Lines of a page, and the cursor to the next one
+  std::pair<std::vector<std::string>, std::optional<Cursor>> page(
+      const std::filesystem::path& path, size_t n,
+      std::optional<Cursor> before = std::nullopt,
+      std::optional<std::string> grep = std::nullopt) {
+    std::optional<Grep> maybe_grep;
+    if (grep) {
+      maybe_grep.emplace(*grep);
+    }
+    std::optional<Cursor> next;
+    std::vector<std::string> lines;
+    for (auto line : tail_page(paged_files(path, before, true),
+             before ? before->offset : std::numeric_limits<size_t>::max(), n,
+             maybe_grep, nullptr, nullptr, &next)) {
+      lines.emplace_back(line);
+    }
+    return {lines, next};
+  }
+};
+
+}  // namespace
+
+TEST(Cursor, RoundTrip) {
+  Cursor cursor{{0x803, 0x1234567890}, 42};
+  EXPECT_EQ(Cursor::parse(cursor.to_string()), cursor);
+}
+
+TEST(Cursor, Invalid) {
+  EXPECT_FALSE(Cursor::parse(""));
+  EXPECT_FALSE(Cursor::parse("1-2"));
+  EXPECT_FALSE(Cursor::parse("1-2-3-4"));
+  EXPECT_FALSE(Cursor::parse("1-2-x"));
+  EXPECT_FALSE(Cursor::parse("1--2-3"));
+}
+
+TEST_F(CursorTest, Pages) {
+  auto path = write("app.log", "1\n2\n3\n4\n5\n");
+
+  auto [first, first_next] = page(path, 2);
+  EXPECT_EQ(first, (std::vector<std::string>{"5\n", "4\n"}));
+  ASSERT_TRUE(first_next);
+  EXPECT_EQ(first_next->offset, 6);
+
+  auto [second, second_next] = page(path, 2, first_next);
+  EXPECT_EQ(second, (std::vector<std::string>{"3\n", "2\n"}));
+
+  // The history runs out, so there is no cursor to another page
+  auto [third, third_next] = page(path, 2, second_next);
+  EXPECT_EQ(third, (std::vector<std::string>{"1\n"}));
+  EXPECT_FALSE(third_next);
+}
+
+TEST_F(CursorTest, EndsOnOldestLine) {
+  auto path = write("app.log", "3\n4\n");
+  write("app.log.1", "1\n2\n");
+
+  auto [first, first_next] = page(path, 2);
+  ASSERT_TRUE(first_next);
+  auto [second, second_next] = page(path, 2, first_next);
+  EXPECT_EQ(second, (std::vector<std::string>{"2\n", "1\n"}));
+  EXPECT_FALSE(second_next);
+}
+
+TEST_F(CursorTest, Grep) {
+  auto path = write("app.log", "a1\nb2\na3\nb4\na5\n");
+
+  auto [first, first_next] = page(path, 2, std::nullopt, "a");
+  EXPECT_EQ(first, (std::vector<std::string>{"a5\n", "a3\n"}));
+  auto [second, second_next] = page(path, 2, first_next, "a");
+  EXPECT_EQ(second, (std::vector<std::string>{"a1\n"}));
+}
+
+TEST_F(CursorTest, Generations) {
+  auto path = write("app.log", "3\n4\n");
+  write("app.log.1", "1\n2\n");
+
+  auto [first, first_next] = page(path, 3);
+  EXPECT_EQ(first, (std::vector<std::string>{"4\n", "3\n", "2\n"}));
+  ASSERT_TRUE(first_next);
+  EXPECT_EQ(first_next->identity, file_identity(dir_ / "app.log.1"));
+
+  auto [second, second_next] = page(path, 3, first_next);
+  EXPECT_EQ(second, (std::vector<std::string>{"1\n"}));
+  EXPECT_FALSE(second_next);
+}
+
+TEST_F(CursorTest, Rotated) {
+  auto path = write("app.log", "1\n2\n3\n");
+  auto [first, first_next] = page(path, 1);
+  EXPECT_EQ(first, (std::vector<std::string>{"3\n"}));
+
+  // The cursor still leads to the same file once it's rotated
+  std::filesystem::rename(path, dir_ / "app.log.1");
+  write("app.log", "4\n");
+  auto [second, second_next] = page(path, 2, first_next);
+  EXPECT_EQ(second, (std::vector<std::string>{"2\n", "1\n"}));
+}
+
+TEST_F(CursorTest, Gone) {
+  auto path = write("app.log", "1\n2\n");
+  auto [first, first_next] = page(path, 1);
+  ASSERT_TRUE(first_next);
+
+  std::filesystem::remove(path);
+  EXPECT_TRUE(paged_files(path, first_next, true).empty());
+  EXPECT_TRUE(paged_files(dir_ / "missing.log", std::nullopt, true).empty());
+}
+
+TEST_F(CursorTest, BudgetRunsOut) {
+  std::string content;
+  for (int i = 0; i < 100000; ++i) {
+    content += "line " + std::to_string(i) + "\n";
+  }
+  auto path = write("app.log", content);
+
+  // Nothing matches, so the page ends where the budget runs out, and the next
+  // one goes on from there instead of scanning the same part again
+  ScanBudget budget(64 * 1024, {});
+  std::optional<Cursor> next;
+  std::vector<std::string> lines;
+  for (auto line : tail_page(paged_files(path, std::nullopt, true),
+           std::numeric_limits<size_t>::max(), 10, Grep("missing"), nullptr,
+           nullptr, &next, &budget)) {
+    lines.emplace_back(line);
+  }
+  EXPECT_TRUE(lines.empty());
+  EXPECT_TRUE(budget.exhausted());
+  ASSERT_TRUE(next);
+  // At the start of the first line the scan didn't get to the end of
+  size_t block_start = content.size() - 64 * 1024;
+  EXPECT_GE(next->offset, block_start);
+  EXPECT_EQ(content[next->offset - 1], '\n');
+  EXPECT_EQ(content.rfind('\n', next->offset - 2) < block_start, true);
+
+  auto [rest, rest_next] = page(path, 1, next);
+  auto previous_line_start = content.rfind('\n', next->offset - 2) + 1;
+  auto previous_line = content.substr(
+      previous_line_start, next->offset - previous_line_start);
+  EXPECT_EQ(rest, (std::vector<std::string>{previous_line}));
+}
+
+TEST_F(CursorTest, MapsWithMapFile) {
+  auto path = write("app.log", "3\n4\n");
+  write("app.log.1", "1\n2\n");
+
+  std::vector<std::filesystem::path> mapped;
+  std::optional<Cursor> next;
+  std::vector<std::string> lines;
+  for (auto line : tail_page(paged_files(path, std::nullopt, true),
+           std::numeric_limits<size_t>::max(), 4, std::nullopt, nullptr,
+           nullptr, &next, nullptr,
+           [&](const std::filesystem::path& file) {
+             mapped.push_back(file);
+             return MappedFile::open(file);
+           })) {
+    lines.emplace_back(line);
+  }
+  EXPECT_EQ(lines, (std::vector<std::string>{"4\n", "3\n", "2\n", "1\n"}));
+  EXPECT_EQ(mapped, (std::vector<std::filesystem::path>{
+                        path, dir_ / "app.log.1"}));
+}
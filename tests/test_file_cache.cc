@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <liblogovo/file_cache.h>
+#include <liblogovo/tail.h>
+
+#include "test_utils.h"
+
+namespace {
+
+class FileCacheTest : public TempDirTest {
+ protected:
+  std::filesystem::path path(const std::string& name) const {
+    return dir_ / name;
+  }
+};
+
+}  // namespace
+
+TEST_F(FileCacheTest, SharesTheMapping) {
+  append("log.txt", "one\ntwo\n");
+  FileCache cache(10);
+  auto first = cache.open(path("log.txt"));
+  ASSERT_TRUE(first);
+  auto second = cache.open(path("log.txt"));
+  ASSERT_TRUE(second);
+  EXPECT_EQ(first->data(), second->data());
+  EXPECT_EQ(collect(tail(*second, 10)),
+      (std::vector<std::string>{"two\n", "one\n"}));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(FileCacheTest, Grows) {
+  append("log.txt", "one\n");
+  FileCache cache(10, 100);
+  auto first = cache.open(path("log.txt"));
+  ASSERT_TRUE(first);
+
+  // Within the headroom
+  append("log.txt", "two\n");
+  auto second = cache.open(path("log.txt"));
+  ASSERT_TRUE(second);
+  EXPECT_EQ(first->data(), second->data());
+  EXPECT_EQ(first->size(), 4);
+  EXPECT_EQ(second->size(), 8);
+  EXPECT_EQ(collect(tail(*second, 10)),
+      (std::vector<std::string>{"two\n", "one\n"}));
+
+  // Past it
+  append("log.txt", std::string(200, 'x') + "\n");
+  auto third = cache.open(path("log.txt"));
+  ASSERT_TRUE(third);
+  EXPECT_NE(third->data(), first->data());
+  EXPECT_EQ(third->size(), 209);
+  // The earlier ones still work
+  EXPECT_EQ(collect(tail(*first, 10)), std::vector<std::string>{"one\n"});
+}
+
+TEST_F(FileCacheTest, Rotated) {
+  append("log.txt", "old\n");
+  FileCache cache(10);
+  auto old_file = cache.open(path("log.txt"));
+  ASSERT_TRUE(old_file);
+  std::filesystem::rename(path("log.txt"), path("log.txt.1"));
+  append("log.txt", "new\n");
+  auto new_file = cache.open(path("log.txt"));
+  ASSERT_TRUE(new_file);
+  EXPECT_NE(new_file->identity(), old_file->identity());
+  EXPECT_EQ(collect(tail(*new_file, 10)), std::vector<std::string>{"new\n"});
+  EXPECT_EQ(collect(tail(*old_file, 10)), std::vector<std::string>{"old\n"});
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(FileCacheTest, Deleted) {
+  append("log.txt", "one\n");
+  FileCache cache(10);
+  ASSERT_TRUE(cache.open(path("log.txt")));
+  std::filesystem::remove(path("log.txt"));
+  EXPECT_FALSE(cache.open(path("log.txt")));
+  EXPECT_EQ(cache.size(), 0);
+  std::filesystem::create_directory(path("dir"));
+  EXPECT_FALSE(cache.open(path("dir")));
+}
+
+TEST_F(FileCacheTest, EvictsLeastRecentlyUsed) {
+  for (auto name : {"a", "b", "c"}) {
+    append(name, "line\n");
+  }
+  FileCache cache(2);
+  auto a = cache.open(path("a"));
+  auto b = cache.open(path("b"));
+  // "a" is more recent than "b" now
+  ASSERT_EQ(cache.open(path("a"))->data(), a->data());
+  cache.open(path("c"));
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.open(path("a"))->data(), a->data());
+  EXPECT_NE(cache.open(path("b"))->data(), b->data());
+}
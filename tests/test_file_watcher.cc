@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <liblogovo/file_watcher.h>
+#include <unistd.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <chrono>
+#include <fstream>
+
+namespace {
+
+class FileWatcherTest : public testing::Test {
+ protected:
+  FileWatcherTest()
+      : path_(std::filesystem::temp_directory_path() /
+              ("logovo_test_watch_" + std::to_string(getpid()))),
+        watcher_(FileWatcher::create(io_.get_executor())) {}
+  ~FileWatcherTest() override { std::filesystem::remove(path_); }
+
+  void write(const std::string& content) { std::ofstream(path_) << content; }
+  void append(const std::string& content) {
+    std::ofstream(path_, std::ios::app) << content;
+  }
+
+  // Receives the next chunk of the subscription, or an error if the
+  // subscription has been dropped
+  std::variant<std::string, boost::system::error_code> receive(
+      FileWatcher::Subscription& subscription) {
+    std::optional<std::variant<std::string, boost::system::error_code>> result;
+    subscription.chunks().async_receive(
+        [&](boost::system::error_code ec, LogChunk chunk) {
+          if (ec) {
+            result = ec;
+          } else {
+            result = *chunk;
+          }
+        });
+    while (!result && io_.run_one_for(std::chrono::seconds(5))) {
+    }
+    if (!result) {
+      return boost::asio::error::timed_out;
+    }
+    return *result;
+  }
+
+  std::filesystem::path path_;
+  boost::asio::io_context io_;
+  std::shared_ptr<FileWatcher> watcher_;
+};
+
+}  // namespace
+
+TEST_F(FileWatcherTest, MissingFile) {
+  EXPECT_EQ(watcher_->subscribe(path_), nullptr);
+}
+
+TEST_F(FileWatcherTest, StartsAfterLastCompleteLine) {
+  write("first\nsecond\npartial");
+  auto subscription = watcher_->subscribe(path_);
+  GTEST_ASSERT_TRUE(subscription);
+  EXPECT_EQ(subscription->offset(), 13);
+}
+
+TEST_F(FileWatcherTest, DeliversCompleteAppendedLines) {
+  write("first\npartial");
+  auto subscription = watcher_->subscribe(path_);
+  GTEST_ASSERT_TRUE(subscription);
+  EXPECT_EQ(subscription->offset(), 6);
+
+  append(" line\nsecond\nthird");
+  EXPECT_EQ(receive(*subscription),
+      (std::variant<std::string, boost::system::error_code>(
+          "partial line\nsecond\n")));
+  append("\n");
+  EXPECT_EQ(receive(*subscription),
+      (std::variant<std::string, boost::system::error_code>("third\n")));
+}
+
+TEST_F(FileWatcherTest, ReadsOnReadPool) {
+  boost::asio::thread_pool read_pool(1);
+  watcher_ = FileWatcher::create(io_.get_executor(), &read_pool);
+  write("first\n");
+  auto subscription = watcher_->subscribe(path_);
+  GTEST_ASSERT_TRUE(subscription);
+
+  append("second\nthird\n");
+  EXPECT_EQ(receive(*subscription),
+      (std::variant<std::string, boost::system::error_code>(
+          "second\nthird\n")));
+  append("fourth\n");
+  EXPECT_EQ(receive(*subscription),
+      (std::variant<std::string, boost::system::error_code>("fourth\n")));
+}
+
+TEST_F(FileWatcherTest, SharesChunksBetweenSubscribers) {
+  write("");
+  auto first = watcher_->subscribe(path_);
+  auto second = watcher_->subscribe(path_);
+  GTEST_ASSERT_TRUE(first && second);
+
+  append("line\n");
+  EXPECT_EQ(receive(*first),
+      (std::variant<std::string, boost::system::error_code>("line\n")));
+  EXPECT_EQ(receive(*second),
+      (std::variant<std::string, boost::system::error_code>("line\n")));
+}
+
+TEST_F(FileWatcherTest, DropsSubscribersOnDelete) {
+  write("line\n");
+  auto subscription = watcher_->subscribe(path_);
+  GTEST_ASSERT_TRUE(subscription);
+
+  std::filesystem::remove(path_);
+  auto result = receive(*subscription);
+  GTEST_ASSERT_TRUE(
+      std::holds_alternative<boost::system::error_code>(result));
+  EXPECT_NE(std::get<boost::system::error_code>(result),
+      boost::asio::error::timed_out);
+}
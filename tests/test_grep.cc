@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <liblogovo/grep.h>
+
+TEST(Grep, FindsLastOccurrence) {
+  Grep grep("abc");
+  GTEST_ASSERT_EQ(grep.find_last("abc xabc abx"), 5);
+  GTEST_ASSERT_EQ(grep.find_last("abc"), 0);
+  GTEST_ASSERT_FALSE(grep.find_last("ab"));
+  GTEST_ASSERT_FALSE(grep.find_last("acb bca cab"));
+}
+
+TEST(Grep, SingleSymbol) {
+  Grep grep("3");
+  GTEST_ASSERT_EQ(grep.find_last("13 of 23\n"), 7);
+  GTEST_ASSERT_FALSE(grep.find_last("line\n"));
+}
+
+TEST(Grep, OverlappingOccurrences) {
+  Grep grep("aa");
+  GTEST_ASSERT_EQ(grep.find_last("baaab"), 2);
+}
+
+TEST(Grep, MatchesNaiveSearch) {
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += static_cast<char>('a' + (i * i + 7 * i) % 3);
+  }
+  for (std::string pattern : {"a", "ab", "abc", "cab", "bbb", "acbac"}) {
+    Grep grep(pattern);
+    for (size_t end = 0; end <= text.size(); end += 37) {
+      auto haystack = std::string_view(text).substr(0, end);
+      auto expected = haystack.rfind(pattern);
+      auto found = grep.find_last(haystack);
+      if (expected == std::string_view::npos) {
+        GTEST_ASSERT_FALSE(found) << pattern << " in first " << end;
+      } else {
+        GTEST_ASSERT_EQ(found, expected) << pattern << " in first " << end;
+      }
+    }
+  }
+}
+
+TEST(Grep, LineMatching) {
+  GTEST_ASSERT_TRUE(Grep("error").can_match_lines());
+  GTEST_ASSERT_TRUE(Grep("error\n").can_match_lines());
+  GTEST_ASSERT_FALSE(Grep("error\nwarning").can_match_lines());
+}
+
+namespace {
+
+// Lines of `text` passing `grep`, newest first, found like `tail()` finds them
+std::vector<std::string> matching_lines(
+    const Grep& grep, std::string_view text) {
+  std::vector<std::string> result;
+  while (auto hit = grep.find_last(text)) {
+    auto line_start = text.rfind('\n', *hit == 0 ? 0 : *hit - 1);
+    line_start = *hit == 0 || line_start == std::string_view::npos
+                     ? 0
+                     : line_start + 1;
+    auto line_end = std::min(text.find('\n', *hit), text.size());
+    result.emplace_back(text.substr(line_start, line_end - line_start));
+    text = text.substr(0, line_start);
+  }
+  return result;
+}
+
+constexpr std::string_view LOG = "INFO started\n"
+                                 "WARN disk 91% full\n"
+                                 "ERROR request 17 failed\n"
+                                 "info request 18 done\n"
+                                 "ERROR request 19 timed out\n";
+
+}  // namespace
+
+TEST(Grep, AllAnyNone) {
+  auto grep = Grep::create({.all = {"request"},
+      .any = {"failed", "done"},
+      .none = {"18"}});
+  ASSERT_TRUE(grep);
+  std::vector<std::string> expected{"ERROR request 17 failed"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+}
+
+TEST(Grep, NoneOnly) {
+  auto grep = Grep::create({.none = {"request"}});
+  ASSERT_TRUE(grep);
+  std::vector<std::string> expected{"WARN disk 91% full", "INFO started"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+}
+
+TEST(Grep, IgnoreCase) {
+  auto grep = Grep::create({.all = {"info"}, .ignore_case = true});
+  ASSERT_TRUE(grep);
+  std::vector<std::string> expected{"info request 18 done", "INFO started"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+}
+
+TEST(Grep, Regex) {
+  // Has literals to look for first
+  auto grep = Grep::create({.regexes = {R"(request \d+ (failed|timed))"}});
+  ASSERT_TRUE(grep);
+  std::vector<std::string> expected{
+      "ERROR request 19 timed out", "ERROR request 17 failed"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+
+  // Has to be checked line by line
+  grep = Grep::create({.regexes = {R"(^\w+ \w+ \d+%)"}});
+  ASSERT_TRUE(grep);
+  expected = {"WARN disk 91% full"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+
+  grep = Grep::create({.regexes = {"ERROR.*OUT$"}, .ignore_case = true});
+  ASSERT_TRUE(grep);
+  expected = {"ERROR request 19 timed out"};
+  GTEST_ASSERT_EQ(matching_lines(*grep, LOG), expected);
+}
+
+TEST(Grep, InvalidRegex) {
+  GTEST_ASSERT_FALSE(Grep::create({.regexes = {"("}}));
+}
+
+TEST(Grep, SingleSubstring) {
+  auto grep = Grep::create({.all = {"abc"}});
+  ASSERT_TRUE(grep);
+  GTEST_ASSERT_EQ(grep->find_last("abc xabc abx"), 5);
+  GTEST_ASSERT_TRUE(Grep("").matches_all());
+  GTEST_ASSERT_FALSE(Grep("a").matches_all());
+  GTEST_ASSERT_FALSE(Grep::create({.all = {"a\n"}, .ignore_case = true})
+          ->can_match_lines());
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+#include <liblogovo/handler.h>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <list>
+
+#include "test_utils.h"
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = asio::ip::tcp;
+
+namespace {
+
+// A request served over a loopback connection of its own, the way a session
+// of the server would send the response
+struct Exchange {
+  explicit Exchange(asio::io_context& io) : server(io), client(io) {}
+
+  beast::tcp_stream server;
+  beast::tcp_stream client;
+  http::response<http::string_body> res;
+  bool done = false;
+};
+
+class HandlerTest : public TempDirTest {
+ protected:
+  HandlerTest() {
+    std::string text;
+    for (int i = 0; i < 20000; ++i) {
+      text += "line " + std::to_string(i) + " of the log\n";
+    }
+    write("log.txt", text);
+  }
+
+  ~HandlerTest() override {
+    // Ends the responses left unread while the handler they came from is
+    // still there
+    for (auto& exchange : exchanges_) {
+      beast::error_code ec;
+      exchange.client.socket().close(ec);
+    }
+    io_.run_for(std::chrono::milliseconds(100));
+  }
+
+  Handler& handler(HandlerOptions options) {
+    handler_ = std::make_unique<Handler>(dir_, options);
+    return *handler_;
+  }
+
+  // Starts serving `target` to a client of its own, which reads the response
+  // once the loop runs, unless `read` is false. The response to a client that
+  // doesn't read stays in the middle of being sent (the connection has small
+  // buffers), holding on to whatever it took.
+  Exchange& request(
+      std::string target, unsigned version = 11, bool read = true) {
+    auto& exchange = exchanges_.emplace_back(io_);
+    tcp::acceptor acceptor(io_);
+    acceptor.open(tcp::v4());
+    acceptor.set_option(asio::socket_base::receive_buffer_size(4096));
+    acceptor.bind({asio::ip::make_address("127.0.0.1"), 0});
+    acceptor.listen();
+    exchange.client.socket().open(tcp::v4());
+    exchange.client.socket().set_option(
+        asio::socket_base::receive_buffer_size(4096));
+    exchange.client.socket().connect(acceptor.local_endpoint());
+    exchange.server.socket() = acceptor.accept();
+    exchange.server.socket().set_option(
+        asio::socket_base::send_buffer_size(4096));
+
+    asio::co_spawn(
+        io_,
+        [this, &exchange, target, version]() -> asio::awaitable<void> {
+          http::request<http::string_body> req{
+              http::verb::get, target, version};
+          auto response = handler_->handle_request(std::move(req));
+          if (auto* msg = std::get_if<http::message_generator>(&response)) {
+            co_await beast::async_write(exchange.server, std::move(*msg));
+          } else {
+            co_await std::get<std::unique_ptr<StreamingResponse>>(response)
+                ->write(exchange.server);
+          }
+          exchange.server.socket().shutdown(tcp::socket::shutdown_send);
+        },
+        asio::detached);
+    if (read) {
+      asio::co_spawn(
+          io_,
+          [&exchange]() -> asio::awaitable<void> {
+            beast::flat_buffer buffer;
+            http::response_parser<http::string_body> parser;
+            parser.body_limit(boost::none);
+            co_await http::async_read(exchange.client, buffer, parser);
+            exchange.res = parser.release();
+            exchange.done = true;
+          },
+          asio::detached);
+    }
+    return exchange;
+  }
+
+  // Runs the loop until `exchange` has its response
+  void run(Exchange& exchange) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!exchange.done && std::chrono::steady_clock::now() < deadline) {
+      io_.run_for(std::chrono::milliseconds(10));
+      io_.restart();
+    }
+    ASSERT_TRUE(exchange.done);
+  }
+
+  // Goes after the loop, which may still have parts of its responses
+  std::unique_ptr<Handler> handler_;
+  asio::io_context io_;
+  std::list<Exchange> exchanges_;
+};
+
+}  // namespace
+
+TEST_F(HandlerTest, ScanByteBudget) {
+  HandlerOptions options;
+  options.scan_byte_budget = 1000;
+  handler(options);
+  auto& exchange = request("/log.txt?n=10&grep=nowhere");
+  run(exchange);
+  EXPECT_EQ(exchange.res.result(), http::status::ok);
+  EXPECT_EQ(exchange.res["Trailer"], "X-Truncated");
+  EXPECT_EQ(exchange.res["X-Truncated"], "bytes");
+  EXPECT_TRUE(exchange.res.body().empty());
+}
+
+TEST_F(HandlerTest, WithinScanBudget) {
+  HandlerOptions options;
+  options.scan_byte_budget = 10 * 1024 * 1024;
+  handler(options);
+  auto& exchange = request("/log.txt?n=2");
+  run(exchange);
+  EXPECT_EQ(exchange.res.result(), http::status::ok);
+  EXPECT_EQ(exchange.res.body(),
+      "line 19999 of the log\nline 19998 of the log\n");
+  EXPECT_EQ(exchange.res.count("X-Truncated"), 0);
+}
+
+TEST_F(HandlerTest, ScanBudgetNeedsHttp11) {
+  HandlerOptions options;
+  options.scan_byte_budget = 1000;
+  handler(options);
+  auto& exchange = request("/log.txt?n=10", 10);
+  run(exchange);
+  EXPECT_EQ(exchange.res.result(), http::status::bad_request);
+}
+
+TEST_F(HandlerTest, QueueFull) {
+  HandlerOptions options;
+  options.max_scans = 1;
+  options.max_queued_scans = 0;
+  handler(options);
+  // Takes the only slot until its response is read
+  request("/log.txt?n=20000", 11, false);
+  io_.run_for(std::chrono::milliseconds(50));
+  io_.restart();
+
+  auto& rejected = request("/log.txt?n=10");
+  run(rejected);
+  EXPECT_EQ(rejected.res.result(), http::status::too_many_requests);
+  EXPECT_EQ(rejected.res[http::field::retry_after], "1");
+}
+
+TEST_F(HandlerTest, QueueTimeout) {
+  HandlerOptions options;
+  options.max_scans = 1;
+  options.max_queued_scans = 1;
+  options.scan_queue_timeout = 0.05;
+  handler(options);
+  request("/log.txt?n=20000", 11, false);
+  io_.run_for(std::chrono::milliseconds(50));
+  io_.restart();
+
+  auto& rejected = request("/log.txt?n=10");
+  run(rejected);
+  EXPECT_EQ(rejected.res.result(), http::status::service_unavailable);
+  EXPECT_EQ(rejected.res[http::field::retry_after], "1");
+}
+
+TEST_F(HandlerTest, Admitted) {
+  HandlerOptions options;
+  options.max_scans = 1;
+  handler(options);
+  auto& first = request("/log.txt?n=1");
+  auto& second = request("/log.txt?n=1");
+  run(first);
+  run(second);
+  EXPECT_EQ(first.res.result(), http::status::ok);
+  EXPECT_EQ(second.res.result(), http::status::ok);
+  EXPECT_EQ(second.res.body(), "line 19999 of the log\n");
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <liblogovo/line_index.h>
+
+#include "test_utils.h"
+
+namespace {
+
+class LineIndexTest : public TempDirTest {
+ protected:
+  std::filesystem::path log_path() const { return dir_ / "log.txt"; }
+  std::filesystem::path index_path() const { return dir_ / "index/log.lidx"; }
+
+  void append(const std::string& text) {
+    TempDirTest::append("log.txt", text);
+  }
+
+  // Offsets of each line, computed the slow way
+  std::vector<size_t> expected_offsets() const {
+    std::ifstream input(log_path());
+    std::string text(std::istreambuf_iterator<char>(input), {});
+    std::vector<size_t> result{0};
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (text[i] == '\n') {
+        result.push_back(i + 1);
+      }
+    }
+    return result;
+  }
+
+  void check(const LineIndex& index) {
+    auto expected = expected_offsets();
+    for (size_t line = 0; line < expected.size(); ++line) {
+      GTEST_ASSERT_EQ(index.line_offset(log_path(), line), expected[line])
+          << "line " << line;
+    }
+  }
+};
+
+std::string lines(int from, int to) {
+  std::string result;
+  for (int i = from; i < to; ++i) {
+    result += "line " + std::to_string(i) + "\n";
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_F(LineIndexTest, Empty) {
+  append("");
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 0);
+  GTEST_ASSERT_EQ(index.line_offset(log_path(), 0), 0);
+}
+
+TEST_F(LineIndexTest, Missing) {
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_FALSE(index.update(log_path()));
+}
+
+TEST_F(LineIndexTest, Offsets) {
+  append(lines(0, 100) + "partial");
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 101);
+  check(index);
+}
+
+TEST_F(LineIndexTest, Appends) {
+  LineIndex index(index_path(), 4);
+  append(lines(0, 10) + "part");
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 11);
+
+  append("ial\n" + lines(11, 50));
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 50);
+  check(index);
+}
+
+TEST_F(LineIndexTest, Persists) {
+  append(lines(0, 30));
+  {
+    LineIndex index(index_path(), 4);
+    GTEST_ASSERT_TRUE(index.update(log_path()));
+  }
+  append(lines(30, 40));
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 40);
+  check(index);
+}
+
+TEST_F(LineIndexTest, Truncation) {
+  append(lines(0, 30));
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+
+  std::filesystem::resize_file(log_path(), 0);
+  append(lines(100, 105));
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 5);
+  check(index);
+}
+
+TEST_F(LineIndexTest, RebuildReplacesIndex) {
+  append(lines(0, 30));
+  {
+    LineIndex index(index_path(), 4);
+    GTEST_ASSERT_TRUE(index.update(log_path()));
+  }
+  auto indexed_size = std::filesystem::file_size(index_path());
+
+  // The rebuilt index is written anew rather than over the longer old one
+  std::filesystem::resize_file(log_path(), 0);
+  append(lines(100, 105));
+  {
+    LineIndex index(index_path(), 4);
+    GTEST_ASSERT_TRUE(index.update(log_path()));
+  }
+  EXPECT_LT(std::filesystem::file_size(index_path()), indexed_size);
+  EXPECT_FALSE(std::filesystem::exists(index_path().string() + ".tmp"));
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 5);
+  check(index);
+}
+
+TEST_F(LineIndexTest, Rotation) {
+  append(lines(0, 30));
+  LineIndex index(index_path(), 4);
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+
+  std::filesystem::rename(log_path(), log_path().string() + ".1");
+  append(lines(0, 35));
+  GTEST_ASSERT_TRUE(index.update(log_path()));
+  GTEST_ASSERT_EQ(index.line_count(), 35);
+  check(index);
+}
+
+TEST_F(LineIndexTest, Lines) {
+  append(lines(0, 30));
+  LineIndex index(index_path(), 4);
+  auto expected = expected_offsets();
+  auto range = index.lines(log_path(), 5, 11);
+  GTEST_ASSERT_TRUE(range);
+  GTEST_ASSERT_EQ(range->begin, expected[5]);
+  GTEST_ASSERT_EQ(range->end, expected[11]);
+  GTEST_ASSERT_EQ(range->line_count, 30);
+
+  // Brought up to date along with the lookup
+  append(lines(30, 40));
+  range = index.lines(log_path(), 30, 50);
+  GTEST_ASSERT_TRUE(range);
+  GTEST_ASSERT_EQ(range->begin, expected_offsets()[30]);
+  GTEST_ASSERT_EQ(range->end, std::filesystem::file_size(log_path()));
+  GTEST_ASSERT_EQ(range->line_count, 40);
+
+  std::filesystem::remove(log_path());
+  GTEST_ASSERT_FALSE(index.lines(log_path(), 0, 1));
+}
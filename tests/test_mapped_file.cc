@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <liblogovo/mapped_file.h>
+#include <liblogovo/tail.h>
+
+#include <fstream>
+
+#include "test_utils.h"
+
+namespace {
+
+// Temporary file that is removed once the test is done with it
+class TempFile {
+ public:
+  explicit TempFile(const std::string& content)
+      : path_(std::filesystem::temp_directory_path() /
+              ("logovo_test_" + std::to_string(getpid()) + "_" +
+                  std::to_string(counter_++))) {
+    std::ofstream(path_) << content;
+  }
+  ~TempFile() { std::filesystem::remove(path_); }
+
+  const std::filesystem::path& path() const { return path_; }
+
+ private:
+  static inline int counter_ = 0;
+  std::filesystem::path path_;
+};
+
+}  // namespace
+
+TEST(MappedFile, Empty) {
+  TempFile file("");
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+  GTEST_ASSERT_TRUE(collect(tail(*mapped, 5)).empty());
+}
+
+TEST(MappedFile, Missing) {
+  GTEST_ASSERT_FALSE(MappedFile::open("/nonexistent/logovo/file"));
+}
+
+TEST(MappedFile, SameAsStream) {
+  std::string text;
+  for (int i = 0; i < 500; ++i) {
+    text += std::string(i * 7 % 23, 'a' + i % 26) + "\n";
+  }
+  TempFile file(text);
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+
+  std::stringstream input(text);
+  auto expected = collect(tail<std::stringstream, TailParameters{100}>(
+      input, 1000));
+  auto result = collect(tail<MappedFile, TailParameters{100}>(*mapped, 1000));
+  GTEST_ASSERT_EQ(result, expected);
+}
+
+TEST(MappedFile, LinesLongerThanBlock) {
+  auto long_line = std::string(100, 'x') + "\n";
+  TempFile file("first\n" + long_line + "short\n" + long_line);
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+
+  auto result = collect(tail<MappedFile, TailParameters{16}>(*mapped, 5));
+  std::vector<std::string> expected{long_line, "short\n", long_line, "first\n"};
+  GTEST_ASSERT_EQ(result, expected);
+}
+
+TEST(MappedFile, GrepLinesLongerThanBlock) {
+  auto long_line = std::string(40, 'x') + "match" + std::string(40, 'y') + "\n";
+  TempFile file("match first\n" + long_line + "short\n" + long_line + "end");
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+
+  auto result = collect(
+      tail<MappedFile, TailParameters{16}>(*mapped, 5, Grep("match")));
+  std::vector<std::string> expected{long_line, long_line, "match first\n"};
+  GTEST_ASSERT_EQ(result, expected);
+}
+
+TEST(MappedFile, LastLinesStart) {
+  // Lines start at 0, 6, 107 and 113
+  auto long_line = std::string(100, 'x') + "\n";
+  TempFile file("first\n" + long_line + "short\n" + long_line);
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+
+  auto start = [&](size_t n, FileRange range = {}) {
+    return last_lines_start<MappedFile, TailParameters{16}>(*mapped, n, range);
+  };
+  EXPECT_EQ(start(0), 214);
+  EXPECT_EQ(start(1), 113);
+  EXPECT_EQ(start(3), 6);
+  EXPECT_EQ(start(10), 0);
+  EXPECT_EQ(start(1, {0, 113}), 107);
+  EXPECT_EQ(start(10, {6, 113}), 6);
+  EXPECT_EQ(start(10, {300, 400}), 214);
+
+  TempFile empty("");
+  auto mapped_empty = MappedFile::open(empty.path());
+  GTEST_ASSERT_TRUE(mapped_empty);
+  EXPECT_EQ(last_lines_start(*mapped_empty, 10), 0);
+}
+
+TEST(MappedFile, TruncatedWhileRead) {
+  constexpr size_t WINDOW_SIZE = MappedFile::WINDOW_SIZE;
+  std::string content(2 * WINDOW_SIZE, 'x');
+  TempFile file(content);
+  auto mapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(mapped);
+  GTEST_ASSERT_TRUE(mapped->read(content.size() - 100, 100));
+  // Within the window that was checked
+  GTEST_ASSERT_TRUE(mapped->read(WINDOW_SIZE, 100));
+  std::filesystem::resize_file(file.path(), 100);
+
+  // The next window is checked before it's touched, instead of raising SIGBUS
+  EXPECT_FALSE(mapped->read(WINDOW_SIZE - 100, 100));
+  EXPECT_FALSE(mapped->read(0, 100));
+
+  auto remapped = MappedFile::open(file.path());
+  GTEST_ASSERT_TRUE(remapped);
+  EXPECT_EQ(remapped->read(0, 100), content.substr(0, 100));
+}
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <liblogovo/memory_pool.h>
+
+#include <thread>
+
+TEST(MemoryPool, RecyclesBlocks) {
+  void* block = pool_allocate(100);
+  pool_deallocate(block, 100);
+  // Same size class
+  void* again = pool_allocate(120);
+  EXPECT_EQ(again, block);
+  void* other = pool_allocate(120);
+  EXPECT_NE(other, block);
+  pool_deallocate(other, 120);
+  pool_deallocate(again, 120);
+}
+
+TEST(MemoryPool, LargeBlocks) {
+  size_t size = 4 * 1024 * 1024;
+  auto* block = static_cast<char*>(pool_allocate(size));
+  block[0] = block[size - 1] = 'x';
+  pool_deallocate(block, size);
+}
+
+TEST(MemoryPool, FreedOnAnotherThread) {
+  void* block = pool_allocate(1000);
+  std::thread([&] {
+    pool_deallocate(block, 1000);
+    // Goes to the list of this thread
+    void* again = pool_allocate(1000);
+    EXPECT_EQ(again, block);
+    pool_deallocate(again, 1000);
+  }).join();
+}
+
+TEST(MemoryPool, String) {
+  PooledString string(1000, 'x');
+  string += "y";
+  EXPECT_EQ(string.size(), 1001);
+  EXPECT_EQ(string.back(), 'y');
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <fmt/format.h>
+#include <liblogovo/merge.h>
+
+#include "test_utils.h"
+
+namespace {
+
+class MergeTest : public TempDirTest {
+ protected:
+  MergeTest() : parser_(*TimestampParser::create("%H:%M:%S")) {}
+
+  std::vector<std::string> merge(const std::vector<std::string>& names,
+      size_t n, std::optional<std::string> grep = std::nullopt,
+      ScanPool* pool = nullptr) {
+    std::vector<MappedFile> files;
+    for (const auto& name : names) {
+      files.push_back(*MappedFile::open(dir_ / name));
+    }
+    std::optional<Grep> maybe_grep;
+    if (grep) {
+      maybe_grep.emplace(*grep);
+    }
+    std::vector<std::string> result;
+    for (auto line :
+         merged_tail(std::move(files), n, maybe_grep, parser_, pool)) {
+      result.emplace_back(line);
+    }
+    return result;
+  }
+
+  TimestampParser parser_;
+};
+
+}  // namespace
+
+TEST_F(MergeTest, Glob) {
+  write("worker-1.log", "");
+  write("worker-2.log", "");
+  write("worker-2.log.1", "");
+  write("other.log", "");
+  std::filesystem::create_directories(dir_ / "worker-3.log");
+
+  std::vector<std::filesystem::path> expected{
+      dir_ / "worker-1.log", dir_ / "worker-2.log"};
+  EXPECT_EQ(glob_files(dir_, "worker-*.log"), expected);
+  EXPECT_TRUE(glob_files(dir_ / "missing", "*").empty());
+}
+
+TEST_F(MergeTest, Merge) {
+  write("a.log", "10:00:01 a1\n10:00:04 a2\n10:00:05 a3\n");
+  write("b.log", "10:00:02 b1\n10:00:03 b2\n10:00:06 b3\n");
+
+  std::vector<std::string> expected{"10:00:06 b3\n", "10:00:05 a3\n",
+      "10:00:04 a2\n", "10:00:03 b2\n", "10:00:02 b1\n", "10:00:01 a1\n"};
+  EXPECT_EQ(merge({"a.log", "b.log"}, 10), expected);
+  expected.resize(4);
+  EXPECT_EQ(merge({"a.log", "b.log"}, 4), expected);
+}
+
+TEST_F(MergeTest, ContinuationLines) {
+  write("a.log", "header\n10:00:01 a1\n  more\n10:00:04 a2\n");
+  write("b.log", "10:00:02 b1\n10:00:03 b2\n  more\n");
+
+  std::vector<std::string> expected{"10:00:04 a2\n", "  more\n",
+      "10:00:03 b2\n", "10:00:02 b1\n", "  more\n", "10:00:01 a1\n",
+      "header\n"};
+  EXPECT_EQ(merge({"a.log", "b.log"}, 10), expected);
+}
+
+TEST_F(MergeTest, Grep) {
+  write("a.log", "10:00:01 x\n10:00:03 y\n");
+  write("b.log", "10:00:02 y\n10:00:04 x\n");
+
+  std::vector<std::string> expected{"10:00:04 x\n", "10:00:01 x\n"};
+  EXPECT_EQ(merge({"a.log", "b.log"}, 10, "x"), expected);
+}
+
+TEST_F(MergeTest, ManyBatches) {
+  // Every file has lines at its own times, so that the merge keeps switching
+  // between them across batch boundaries
+  constexpr size_t FILES = 4;
+  constexpr size_t LINES = 3 * merge_detail::BATCH_LINES;
+  std::vector<std::string> names;
+  for (size_t file = 0; file < FILES; ++file) {
+    std::string content;
+    for (size_t line = 0; line < LINES; ++line) {
+      auto seconds = line * FILES + file;
+      content += fmt::format("{:02}:{:02}:{:02} {}\n", seconds / 3600,
+          seconds / 60 % 60, seconds % 60, file);
+    }
+    names.push_back(fmt::format("{}.log", file));
+    write(names.back(), content);
+  }
+
+  ScanPool pool(4);
+  auto lines = merge(names, FILES * LINES, std::nullopt, &pool);
+  ASSERT_EQ(lines.size(), FILES * LINES);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    auto seconds = FILES * LINES - 1 - i;
+    EXPECT_EQ(lines[i], fmt::format("{:02}:{:02}:{:02} {}\n", seconds / 3600,
+                            seconds / 60 % 60, seconds % 60, seconds % FILES));
+  }
+  EXPECT_EQ(merge(names, 10, std::nullopt, &pool).size(), 10);
+}
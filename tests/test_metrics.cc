@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include <liblogovo/metrics.h>
+
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(Metrics, CounterSumsThreads) {
+  Counter counter;
+  {
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < 8; ++i) {
+      threads.emplace_back([&] {
+        for (int j = 0; j < 10000; ++j) {
+          counter.add();
+        }
+      });
+    }
+  }
+  EXPECT_EQ(counter.value(), 80000);
+  counter.add(5);
+  EXPECT_EQ(counter.value(), 80005);
+}
+
+TEST(Metrics, HistogramBuckets) {
+  Histogram histogram;
+  histogram.observe(50us);
+  histogram.observe(100us);
+  histogram.observe(2ms);
+  histogram.observe(1min);
+
+  auto snapshot = histogram.snapshot();
+  EXPECT_EQ(snapshot.count, 4);
+  EXPECT_EQ(snapshot.sum, 50us + 100us + 2ms + 1min);
+  // 100 us is still in the first bucket, bounds are inclusive
+  EXPECT_EQ(snapshot.counts[0], 2);
+  // (0.001, 0.0025]
+  EXPECT_EQ(snapshot.counts[4], 1);
+  EXPECT_EQ(snapshot.counts.back(), 1);
+}
+
+TEST(Metrics, Render) {
+  Metrics metrics;
+  metrics.requests.add(3);
+  metrics.active_sessions.add(2);
+  metrics.request_duration.observe(3ms);
+
+  auto text = metrics.render();
+  EXPECT_TRUE(text.contains("# TYPE logovo_requests_total counter\n"
+                            "logovo_requests_total 3\n"));
+  EXPECT_TRUE(text.contains("logovo_active_sessions 2\n"));
+  EXPECT_TRUE(text.contains(
+      "logovo_request_duration_seconds_bucket{le=\"0.0025\"} 0\n"
+      "logovo_request_duration_seconds_bucket{le=\"0.005\"} 1\n"));
+  EXPECT_TRUE(text.contains(
+      "logovo_request_duration_seconds_bucket{le=\"+Inf\"} 1\n"
+      "logovo_request_duration_seconds_sum 0.003\n"
+      "logovo_request_duration_seconds_count 1\n"));
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <liblogovo/newline_scan.h>
+
+#include <random>
+
+namespace {
+
+std::string random_text(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> symbol(0, 9);
+  std::string result(size, 'x');
+  for (auto& c : result) {
+    // Roughly every tenth symbol is a newline
+    c = symbol(rng) == 0 ? '\n' : 'a' + symbol(rng);
+  }
+  return result;
+}
+
+std::vector<size_t> newline_positions(const std::string& text) {
+  std::vector<size_t> result;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\n') {
+      result.push_back(i);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(NewlineScan, ImplementationsAgree) {
+  for (size_t size : {0, 1, 15, 16, 63, 64, 65, 127, 200, 4096, 4099}) {
+    auto text = random_text(size, size);
+    auto words = (size + 63) / 64;
+    std::vector<uint64_t> expected(words);
+    find_newlines_scalar(text.data(), size, expected.data());
+
+    std::vector<uint64_t> dispatched(words);
+    find_newlines(text.data(), size, dispatched.data());
+    GTEST_ASSERT_EQ(dispatched, expected) << "size " << size;
+
+#if defined(NEWLINE_SCAN_HAS_X86)
+    std::vector<uint64_t> sse2(words);
+    find_newlines_sse2(text.data(), size, sse2.data());
+    GTEST_ASSERT_EQ(sse2, expected) << "size " << size;
+
+    if (cpu_supports_avx2()) {
+      std::vector<uint64_t> avx2(words);
+      find_newlines_avx2(text.data(), size, avx2.data());
+      GTEST_ASSERT_EQ(avx2, expected) << "size " << size;
+    }
+#endif
+  }
+}
+
+TEST(NewlineScan, BitmapWalksBackwards) {
+  auto text = random_text(1000, 42);
+  NewlineBitmap bitmap(1024);
+  bitmap.scan(text);
+
+  auto expected = newline_positions(text);
+  std::vector<size_t> found;
+  for (auto pos = bitmap.find_last_before(text.size()); pos;
+       pos = bitmap.find_last_before(*pos)) {
+    found.push_back(*pos);
+  }
+  std::reverse(found.begin(), found.end());
+  GTEST_ASSERT_EQ(found, expected);
+}
+
+TEST(NewlineScan, BitmapWalksForward) {
+  auto text = random_text(1000, 43);
+  NewlineBitmap bitmap(1000);
+  bitmap.scan(text);
+
+  auto expected = newline_positions(text);
+  std::vector<size_t> found;
+  for (auto pos = bitmap.find_first_from(0); pos;
+       pos = bitmap.find_first_from(*pos + 1)) {
+    found.push_back(*pos);
+  }
+  GTEST_ASSERT_EQ(found, expected);
+}
+
+TEST(NewlineScan, NoNewlines) {
+  std::string text(300, 'a');
+  NewlineBitmap bitmap(text.size());
+  bitmap.scan(text);
+  GTEST_ASSERT_FALSE(bitmap.find_last_before(text.size()));
+  GTEST_ASSERT_FALSE(bitmap.find_first_from(0));
+}
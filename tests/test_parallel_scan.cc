@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <liblogovo/parallel_scan.h>
+#include <liblogovo/tail.h>
+
+#include <future>
+
+#include "test_utils.h"
+
+namespace {
+
+// Lines of various lengths, some of them longer than the chunks in the tests
+std::string make_text() {
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += std::to_string(i) + std::string(i * 13 % 97, '.') + "\n";
+  }
+  text += "1999 unterminated";
+  return text;
+}
+
+}  // namespace
+
+TEST(ScanPool, RunsTasks) {
+  ScanPool pool(4);
+  EXPECT_EQ(pool.size(), 4);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    auto task = std::make_shared<std::packaged_task<int()>>([i] { return i; });
+    results.push_back(task->get_future());
+    pool.post([task] { (*task)(); });
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(results[i].get(), i);
+  }
+}
+
+TEST(ParallelScan, GrepChunkOwnsLinesStartingInIt) {
+  std::string_view data = "one\ntwo\nthree\n";
+  std::atomic<bool> cancelled = false;
+  Grep grep("e");
+  // [2, 9) has the starts of "two" and "three"; "three" is searched in full
+  auto lines = grep_chunk(data, 2, 9, grep, 10, cancelled);
+  std::vector<std::pair<size_t, size_t>> expected{{8, 14}};
+  EXPECT_EQ(lines, expected);
+  // "one" starts in [0, 2), and continues past it
+  lines = grep_chunk(data, 0, 2, grep, 10, cancelled);
+  expected = {{0, 4}};
+  EXPECT_EQ(lines, expected);
+}
+
+TEST(ParallelScan, MatchesSequentialTail) {
+  auto text = make_text();
+  ScanPool pool(3);
+  for (std::string pattern : {"1", "99", "unterminated", "no such line"}) {
+    for (size_t n : {1, 7, 100, 10000}) {
+      std::stringstream input(text);
+      auto expected = collect(tail(input, n, Grep(pattern)));
+      auto lines = collect(parallel_grep(text, n, Grep(pattern), pool, 1000));
+      EXPECT_EQ(lines, expected) << pattern << " " << n;
+    }
+  }
+}
+
+TEST(ParallelScan, UsedByTailForContiguousSources) {
+  auto text = make_text();
+  std::stringstream input(text);
+  auto expected = collect(tail(input, 50, Grep("7")));
+
+  StringSource source(text);
+  ScanPool pool(2);
+  auto lines = collect(tail<StringSource, TailParameters{64, 1024}>(
+      source, 50, Grep("7"), {}, &pool));
+  EXPECT_EQ(lines, expected);
+}
+
+TEST(ParallelScan, StopsEarly) {
+  auto text = make_text();
+  ScanPool pool(2);
+  {
+    auto lines = parallel_grep(text, 1000, Grep("1"), pool, 100);
+    auto it = lines.begin();
+    EXPECT_EQ(*it, "1999 unterminated");
+    // Destroying the generator here waits for the chunks in flight
+  }
+}
+
+TEST(ParallelScan, SearchesAheadGradually) {
+  std::string text;
+  for (int i = 0; i < 1000; ++i) {
+    text += "line " + std::to_string(i % 10) + "\n";
+  }
+  ScanPool pool(4);
+  auto bytes_read = metrics().bytes_read.value();
+  // The last line has a hit, so the first chunk is all it takes
+  ScanBudget budget(1000, {});
+  auto lines = collect(parallel_grep(text, 1, Grep("9"), pool, 1000, &budget));
+  EXPECT_EQ(lines, std::vector<std::string>{"line 9\n"});
+  EXPECT_FALSE(budget.exhausted());
+  // A couple of chunks are searched ahead, not one per thread
+  EXPECT_LE(metrics().bytes_read.value() - bytes_read, 2 * 1000 + 7);
+}
+
+TEST(ParallelScan, PaysForChunksItYields) {
+  auto text = make_text();
+  ScanPool pool(4);
+  ScanBudget budget(3 * 1000, {});
+  auto lines = collect(parallel_grep(text, 10000, Grep("1"), pool, 1000,
+      &budget));
+  EXPECT_TRUE(budget.exhausted());
+  // Three chunks from the end were paid for and yielded
+  auto stopped_at = budget.stopped_at();
+  GTEST_ASSERT_TRUE(stopped_at);
+  std::stringstream input(text.substr(*stopped_at));
+  EXPECT_EQ(lines, collect(tail(input, 10000, Grep("1"))));
+  EXPECT_LE(text.size() - *stopped_at, 3 * 1000);
+}
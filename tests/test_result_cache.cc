@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include <liblogovo/metrics.h>
+#include <liblogovo/result_cache.h>
+#include <liblogovo/tail.h>
+
+#include "test_utils.h"
+
+namespace {
+
+class ResultCacheTest : public TempDirTest {
+ protected:
+  std::filesystem::path rotated_path() const { return dir_ / "log.txt.1"; }
+
+  void write(const std::string& content) {
+    TempDirTest::write("log.txt", content);
+  }
+  void append(const std::string& content) {
+    TempDirTest::append("log.txt", content);
+  }
+
+  // Result of a request going through the cache, checked against what `tail`
+  // gives for the same request
+  std::vector<std::string> request(size_t n,
+      std::optional<std::string> grep = std::nullopt,
+      ResultCache* cache = nullptr) {
+    if (!cache) {
+      cache = &cache_;
+    }
+    std::optional<Grep> maybe_grep;
+    if (grep) {
+      maybe_grep.emplace(*grep);
+    }
+    auto file = MappedFile::open(path_);
+    EXPECT_TRUE(file);
+    auto expected = collect(tail(*file, n, maybe_grep));
+    auto result = collect(cached_tail(*file, n, maybe_grep, *cache,
+        result_cache_key(path_.string(), n, maybe_grep)));
+    EXPECT_EQ(result, expected);
+    return result;
+  }
+
+  // Hits and misses since the test started
+  uint64_t hits() const {
+    return metrics().result_cache_hits.value() - initial_hits_;
+  }
+  uint64_t misses() const {
+    return metrics().result_cache_misses.value() - initial_misses_;
+  }
+
+  std::filesystem::path path_ = dir_ / "log.txt";
+  ResultCache cache_{1024 * 1024};
+
+ private:
+  uint64_t initial_hits_ = metrics().result_cache_hits.value();
+  uint64_t initial_misses_ = metrics().result_cache_misses.value();
+};
+
+std::string numbered_lines(int first, int last) {
+  std::string result;
+  for (int i = first; i <= last; ++i) {
+    result += "line " + std::to_string(i) + "\n";
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_F(ResultCacheTest, RepeatedRequest) {
+  write(numbered_lines(1, 100));
+  request(10);
+  EXPECT_EQ(request(10).front(), "line 100\n");
+  EXPECT_EQ(misses(), 1);
+  EXPECT_EQ(hits(), 1);
+}
+
+TEST_F(ResultCacheTest, Appended) {
+  write(numbered_lines(1, 100));
+  request(10);
+  append(numbered_lines(101, 103));
+  auto result = request(10);
+  EXPECT_EQ(result.front(), "line 103\n");
+  EXPECT_EQ(result.back(), "line 94\n");
+  // More lines than were requested appended
+  append(numbered_lines(104, 200));
+  EXPECT_EQ(request(10).back(), "line 191\n");
+  EXPECT_EQ(misses(), 1);
+  EXPECT_EQ(hits(), 2);
+}
+
+TEST_F(ResultCacheTest, Grep) {
+  write(numbered_lines(1, 100));
+  EXPECT_EQ(request(5, "7").size(), 5);
+  append(numbered_lines(101, 110));
+  EXPECT_EQ(request(5, "7").front(), "line 107\n");
+  append("nothing here\n");
+  EXPECT_EQ(request(5, "7").front(), "line 107\n");
+  // Other requests have results of their own
+  request(5, "8");
+  request(6, "7");
+  EXPECT_EQ(misses(), 3);
+  EXPECT_EQ(hits(), 2);
+}
+
+TEST_F(ResultCacheTest, FewerLinesThanRequested) {
+  write(numbered_lines(1, 3));
+  request(10);
+  append(numbered_lines(4, 5));
+  EXPECT_EQ(request(10).size(), 5);
+  EXPECT_EQ(hits(), 1);
+}
+
+TEST_F(ResultCacheTest, AppendedTooMuchToCache) {
+  ResultCache cache(800);
+  write(numbered_lines(1, 10));
+  request(100, std::nullopt, &cache);
+  // More than `max_entry_size()`, but fewer lines than requested, so the rest
+  // still comes from the cached result
+  append(numbered_lines(11, 30));
+  auto result = request(100, std::nullopt, &cache);
+  EXPECT_EQ(result.size(), 30);
+  EXPECT_EQ(result.back(), "line 1\n");
+  EXPECT_EQ(hits(), 1);
+}
+
+TEST_F(ResultCacheTest, IncompleteLastLine) {
+  write(numbered_lines(1, 10) + "line 1");
+  EXPECT_EQ(request(3).front(), "line 1");
+  append("1\nline 12");
+  auto result = request(3);
+  EXPECT_EQ(result[0], "line 12");
+  EXPECT_EQ(result[1], "line 11\n");
+  EXPECT_EQ(hits(), 1);
+}
+
+TEST_F(ResultCacheTest, Truncated) {
+  write(numbered_lines(1, 100));
+  request(10);
+  write(numbered_lines(1, 5));
+  EXPECT_EQ(request(10).size(), 5);
+  // Grown past the size it had, but with other data
+  write(numbered_lines(1000, 1200));
+  EXPECT_EQ(request(10).front(), "line 1200\n");
+  EXPECT_EQ(misses(), 3);
+  EXPECT_EQ(hits(), 0);
+}
+
+TEST_F(ResultCacheTest, Rotated) {
+  write(numbered_lines(1, 100));
+  request(10);
+  std::filesystem::rename(path_, rotated_path());
+  write(numbered_lines(1, 100) + numbered_lines(1, 5));
+  EXPECT_EQ(request(10).front(), "line 5\n");
+  EXPECT_EQ(misses(), 2);
+  EXPECT_EQ(hits(), 0);
+}
+
+TEST(ResultCache, Eviction) {
+  ResultCache cache(1000);
+  auto entry = [](size_t size) {
+    auto result = std::make_shared<ResultCache::Entry>();
+    result->lines = std::string(size - 1, 'x') + "\n";
+    result->line_count = 1;
+    return result;
+  };
+  cache.insert("a", entry(100));
+  cache.insert("b", entry(100));
+  EXPECT_EQ(cache.size(), 200);
+  // Too large to be cached
+  cache.insert("c", entry(500));
+  EXPECT_FALSE(cache.find("c"));
+  EXPECT_EQ(cache.size(), 200);
+
+  for (int i = 0; i < 9; ++i) {
+    // Keep "a" recently used
+    EXPECT_TRUE(cache.find("a"));
+    cache.insert(std::to_string(i), entry(100));
+  }
+  EXPECT_LE(cache.size(), 1000);
+  EXPECT_TRUE(cache.find("a"));
+  EXPECT_FALSE(cache.find("b"));
+
+  // Replacing an entry
+  cache.insert("a", entry(50));
+  EXPECT_EQ(cache.find("a")->lines.size(), 50);
+}
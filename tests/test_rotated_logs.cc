@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <liblogovo/rotated_logs.h>
+#include <liblogovo/scan_budget.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <thread>
+
+#include "test_utils.h"
+
+namespace {
+
+class RotatedLogsTest : public TempDirTest {
+ protected:
+  RotatedLogsTest() { std::filesystem::create_directories(dir_ / "logs"); }
+
+  std::filesystem::path write(
+      const std::string& name, const std::string& content) const {
+    return TempDirTest::write("logs/" + name, content);
+  }
+
+  std::filesystem::path write_gzip(
+      const std::string& name, const std::string& content) {
+    auto path = dir_ / "logs" / name;
+    gzFile file = gzopen(path.c_str(), "wb");
+    gzwrite(file, content.data(), content.size());
+    gzclose(file);
+    return path;
+  }
+
+  static std::string read(const std::filesystem::path& path) {
+    std::ifstream input(path);
+    return std::string(std::istreambuf_iterator<char>(input), {});
+  }
+};
+
+}  // namespace
+
+TEST_F(RotatedLogsTest, Generations) {
+  auto log = write("app.log", "");
+  write("app.log.10", "");
+  write("app.log.2.gz", "");
+  write("app.log.1", "");
+  write("app.log.1.gz", "");
+  write("app.log.3.zst", "");
+  write("app.log.old", "");
+  write("app.logger.1", "");
+  write("other.log.1", "");
+
+  std::vector<std::filesystem::path> expected{dir_ / "logs" / "app.log.1",
+      dir_ / "logs" / "app.log.2.gz", dir_ / "logs" / "app.log.3.zst",
+      dir_ / "logs" / "app.log.10"};
+  EXPECT_EQ(rotated_generations(log), expected);
+}
+
+TEST_F(RotatedLogsTest, NoGenerations) {
+  auto log = write("app.log", "");
+  EXPECT_TRUE(rotated_generations(log).empty());
+}
+
+TEST_F(RotatedLogsTest, DecompressesOnce) {
+  std::string content;
+  for (int i = 0; i < 10000; ++i) {
+    content += "line " + std::to_string(i) + "\n";
+  }
+  auto compressed = write_gzip("app.log.1.gz", content);
+  DecompressedCache cache(dir_ / "cache", 1024 * 1024);
+
+  auto path = cache.get(compressed);
+  GTEST_ASSERT_TRUE(path);
+  EXPECT_EQ(read(*path), content);
+  EXPECT_EQ(cache.get(compressed), path);
+}
+
+TEST_F(RotatedLogsTest, TruncatedArchive) {
+  auto compressed = write_gzip("app.log.1.gz", std::string(100000, 'x'));
+  std::filesystem::resize_file(compressed, 100);
+  DecompressedCache cache(dir_ / "cache", 1024 * 1024);
+  EXPECT_FALSE(cache.get(compressed));
+  // Nothing is left behind
+  EXPECT_TRUE(std::filesystem::is_empty(dir_ / "cache"));
+}
+
+TEST_F(RotatedLogsTest, EvictsLeastRecentlyUsed) {
+  auto first = write_gzip("app.log.1.gz", std::string(600, 'a'));
+  auto second = write_gzip("app.log.2.gz", std::string(600, 'b'));
+  DecompressedCache cache(dir_ / "cache", 1000);
+
+  auto first_copy = cache.get(first);
+  GTEST_ASSERT_TRUE(first_copy);
+  auto second_copy = cache.get(second);
+  GTEST_ASSERT_TRUE(second_copy);
+  EXPECT_FALSE(std::filesystem::exists(*first_copy));
+  EXPECT_TRUE(std::filesystem::exists(*second_copy));
+}
+
+TEST_F(RotatedLogsTest, PrivateDirectory) {
+  auto compressed = write_gzip("app.log.1.gz", "line\n");
+  DecompressedCache cache(dir_ / "cache", 1024 * 1024);
+  auto path = cache.get(compressed);
+  GTEST_ASSERT_TRUE(path);
+  struct stat st;
+  ASSERT_EQ(stat((dir_ / "cache").c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0777, 0700);
+  ASSERT_EQ(stat(path->c_str(), &st), 0);
+  EXPECT_EQ(st.st_mode & 0077, 0);
+
+  // Someone else could replace the copies
+  std::filesystem::permissions(dir_ / "cache", std::filesystem::perms::all);
+  EXPECT_FALSE(cache.get(compressed));
+}
+
+TEST_F(RotatedLogsTest, PlantedCopy) {
+  auto compressed = write_gzip("app.log.1.gz", "line\n");
+  DecompressedCache cache(dir_ / "cache", 1024 * 1024);
+  auto path = cache.get(compressed);
+  GTEST_ASSERT_TRUE(path);
+
+  // A symlink where the copy should be isn't followed, it's decompressed anew
+  auto planted = write("planted", "fake\n");
+  std::filesystem::remove(*path);
+  std::filesystem::create_symlink(planted, *path);
+  EXPECT_EQ(cache.get(compressed), path);
+  EXPECT_EQ(read(*path), "line\n");
+  EXPECT_FALSE(std::filesystem::is_symlink(*path));
+  EXPECT_EQ(read(planted), "fake\n");
+}
+
+TEST_F(RotatedLogsTest, ChargesTheBudget) {
+  auto compressed = write_gzip("app.log.1.gz", std::string(1024 * 1024, 'x'));
+  DecompressedCache cache(dir_ / "cache", 4 * 1024 * 1024);
+  ScanBudget budget(64 * 1024, {});
+  EXPECT_FALSE(cache.get(compressed, &budget));
+  EXPECT_TRUE(budget.exhausted());
+  EXPECT_TRUE(std::filesystem::is_empty(dir_ / "cache"));
+
+  ScanBudget enough(2 * 1024 * 1024, {});
+  EXPECT_TRUE(cache.get(compressed, &enough));
+}
+
+TEST_F(RotatedLogsTest, ConcurrentRequests) {
+  std::vector<std::filesystem::path> compressed;
+  for (int i = 1; i <= 4; ++i) {
+    compressed.push_back(write_gzip(
+        "app.log." + std::to_string(i) + ".gz", std::string(100000, 'a' + i)));
+  }
+  DecompressedCache cache(dir_ / "cache", 4 * 1024 * 1024);
+  std::vector<std::optional<std::filesystem::path>> paths(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    threads.emplace_back(
+        [&, i] { paths[i] = cache.get(compressed[i % compressed.size()]); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < paths.size(); ++i) {
+    GTEST_ASSERT_TRUE(paths[i]);
+    EXPECT_EQ(paths[i], paths[i % compressed.size()]);
+    EXPECT_EQ(read(*paths[i]), std::string(100000, 'a' + 1 + i % 4));
+  }
+}
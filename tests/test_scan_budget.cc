@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <liblogovo/scan_budget.h>
+#include <liblogovo/tail.h>
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "test_utils.h"
+
+namespace {
+
+// 100 lines of 10 bytes: "line 0000\n" to "line 0099\n"
+std::string make_text() {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    char line[11];
+    std::snprintf(line, sizeof(line), "line %04d\n", i);
+    text += line;
+  }
+  return text;
+}
+
+}  // namespace
+
+TEST(ScanBudget, Bytes) {
+  ScanBudget budget(100, {});
+  EXPECT_TRUE(budget.spend(60));
+  EXPECT_TRUE(budget.spend(40));
+  EXPECT_FALSE(budget.exhausted());
+  EXPECT_FALSE(budget.spend(1));
+  EXPECT_STREQ(budget.exhausted_reason(), "bytes");
+  // Once out, always out
+  EXPECT_FALSE(budget.spend(0));
+}
+
+TEST(ScanBudget, Time) {
+  ScanBudget budget(0, std::chrono::milliseconds(1));
+  EXPECT_TRUE(budget.spend(1000000));
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_FALSE(budget.spend(1));
+  EXPECT_STREQ(budget.exhausted_reason(), "time");
+}
+
+TEST(ScanBudget, Unlimited) {
+  ScanBudget budget(0, {});
+  EXPECT_TRUE(budget.spend(1ull << 60));
+  EXPECT_FALSE(budget.pause_due());
+}
+
+TEST(ScanBudget, TailStops) {
+  std::stringstream input(make_text());
+  // Three blocks of 100 bytes, i.e. 30 lines
+  ScanBudget budget(300, {});
+  std::vector<std::string> lines;
+  for (auto line :
+      tail<std::stringstream, TailParameters{100}>(input, 1000, std::nullopt,
+          {}, nullptr, &budget)) {
+    lines.emplace_back(line);
+  }
+  ASSERT_FALSE(lines.empty());
+  EXPECT_LT(lines.size(), 31);
+  EXPECT_EQ(lines.front(), "line 0099\n");
+  EXPECT_TRUE(budget.exhausted());
+  // Everything from where the scan stopped has been yielded
+  ASSERT_TRUE(budget.stopped_at());
+  EXPECT_EQ(*budget.stopped_at(), (100 - lines.size()) * 10);
+}
+
+TEST(ScanBudget, ParallelGrepStops) {
+  StringSource source(make_text());
+  ScanPool pool(2);
+  ScanBudget budget(400, {});
+  std::vector<std::string> lines;
+  for (auto line : tail<StringSource, TailParameters{64, 100}>(
+           source, 1000, Grep("line"), {}, &pool, &budget)) {
+    lines.emplace_back(line);
+  }
+  EXPECT_TRUE(budget.exhausted());
+  // Four chunks of 100 bytes fit into the budget
+  EXPECT_EQ(lines.size(), 40);
+  ASSERT_TRUE(budget.stopped_at());
+  EXPECT_EQ(*budget.stopped_at(), 600);
+}
+
+TEST(ScanBudget, Pauses) {
+  StringSource source(make_text());
+  // Every block ends a slice
+  ScanBudget budget(0, {}, std::chrono::nanoseconds(1));
+  size_t lines = 0;
+  size_t pauses = 0;
+  for (auto line : tail<StringSource, TailParameters{100}>(
+           source, 1000, std::nullopt, {}, nullptr, &budget)) {
+    ++(line.empty() ? pauses : lines);
+  }
+  EXPECT_EQ(lines, 100);
+  EXPECT_GT(pauses, 0);
+  EXPECT_FALSE(budget.exhausted());
+}
+
+TEST(ScanBudget, PausesFromSeveralThreads) {
+  auto slice = std::chrono::milliseconds(2);
+  ScanBudget budget(0, {}, slice);
+  auto start = ScanBudget::Clock::now();
+  std::atomic<size_t> pauses = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      while (ScanBudget::Clock::now() - start < 10 * slice) {
+        if (budget.pause_due()) {
+          ++pauses;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // Each slice ends once, however many threads see it ending
+  auto elapsed = ScanBudget::Clock::now() - start;
+  EXPECT_GT(pauses, 0);
+  EXPECT_LE(pauses, elapsed / slice + 1);
+}
@@ -113,3 +113,217 @@ dog
 
   GTEST_ASSERT_EQ(last_lines, expected);
 }
+
+TEST(Tail, MatchesNaiveSplitAcrossBlocks) {
+  std::string text;
+  for (int i = 0; i < 500; ++i) {
+    // Vary line lengths so that lines straddle blocks and bitmap words in all
+    // sorts of ways, including empty lines
+    text += std::string(i * 7 % 23, 'a' + i % 26) + "\n";
+  }
+  text += "unterminated";
+
+  std::vector<std::string> expected;
+  size_t line_start = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\n') {
+      expected.push_back(text.substr(line_start, i + 1 - line_start));
+      line_start = i + 1;
+    }
+  }
+  expected.push_back(text.substr(line_start));
+  std::reverse(expected.begin(), expected.end());
+
+  std::stringstream input(text);
+  auto result = tail<std::stringstream, TailParameters{100}>(input, 1000);
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
+
+// Stitches fragments of long lines back into lines
+std::vector<std::string> stitched_lines(
+    std::generator<std::string_view> result, const bool& fragment) {
+  std::vector<std::string> lines;
+  bool continued = false;
+  for (auto item : result) {
+    if (continued) {
+      lines.back() += item;
+    } else {
+      lines.emplace_back(item);
+    }
+    continued = fragment;
+  }
+  return lines;
+}
+
+TEST(Tail, LineLongerThanBlock) {
+  auto long_line = std::string(50, 'x') + "\n";
+  std::stringstream input("short\n" + long_line + "last\n");
+  bool fragment = false;
+  auto lines = stitched_lines(
+      tail<std::stringstream, TailParameters{16}>(
+          input, 5, std::nullopt, {}, nullptr, nullptr, &fragment),
+      fragment);
+  std::vector<std::string> expected{"last\n", long_line, "short\n"};
+  GTEST_ASSERT_EQ(lines, expected);
+}
+
+TEST(Tail, LongLinesOnly) {
+  auto first = std::string(40, 'a') + "\n";
+  auto second = std::string(33, 'b');
+  std::stringstream input(first + second);
+  bool fragment = false;
+  std::vector<size_t> sizes;
+  for (auto item : tail<std::stringstream, TailParameters{16}>(
+           input, 1, std::nullopt, {}, nullptr, nullptr, &fragment)) {
+    // No fragment is larger than a block
+    sizes.push_back(item.size());
+  }
+  std::vector<size_t> expected{16, 16, 1};
+  GTEST_ASSERT_EQ(sizes, expected);
+
+  std::stringstream again(first + second);
+  auto lines = stitched_lines(
+      tail<std::stringstream, TailParameters{16}>(
+          again, 5, std::nullopt, {}, nullptr, nullptr, &fragment),
+      fragment);
+  GTEST_ASSERT_EQ(lines, (std::vector<std::string>{second, first}));
+}
+
+TEST(Tail, GrepLongLine) {
+  // The substring straddles two blocks of the long line
+  auto long_line =
+      std::string(14, 'x') + "needle" + std::string(30, 'y') + "\n";
+  std::stringstream input(long_line + "needle\n" + std::string(40, 'z') + "\n");
+  bool fragment = false;
+  auto lines = stitched_lines(
+      tail<std::stringstream, TailParameters{16}>(
+          input, 5, Grep("needle"), {}, nullptr, nullptr, &fragment),
+      fragment);
+  std::vector<std::string> expected{"needle\n", long_line};
+  GTEST_ASSERT_EQ(lines, expected);
+}
+
+TEST(Tail, FiltersOfLongLine) {
+  // The substrings are past the first block of the long lines
+  auto with_term = std::string(30, 'x') + "term" + std::string(10, 'x') + "\n";
+  auto without_term = std::string(50, 'y') + "\n";
+  auto text = with_term + without_term + "term\n";
+  auto filtered = [&](const GrepQuery& query) {
+    std::stringstream input(text);
+    bool fragment = false;
+    return stitched_lines(
+        tail<std::stringstream, TailParameters{16}>(input, 5,
+            *Grep::create(query), {}, nullptr, nullptr, &fragment),
+        fragment);
+  };
+  GTEST_ASSERT_EQ(filtered({.any = {"term", "other"}}),
+      (std::vector<std::string>{"term\n", with_term}));
+  GTEST_ASSERT_EQ(filtered({.none = {"term"}}),
+      (std::vector<std::string>{without_term}));
+  GTEST_ASSERT_EQ(filtered({.all = {"TERM"}, .ignore_case = true}),
+      (std::vector<std::string>{"term\n", with_term}));
+  // Regular expressions only look at the first block
+  GTEST_ASSERT_EQ(filtered({.regexes = {"term"}}),
+      (std::vector<std::string>{"term\n"}));
+}
+
+TEST(Tail, LongSubstringInLongLine) {
+  // Substrings of up to half a block plus one symbol are found anywhere in a
+  // long line, longer ones only within one of the blocks it's read in
+  auto found = std::string(20, 'x') + "abcdefghi" + std::string(20, 'x') + "\n";
+  auto missed = std::string(10, 'x') + std::string(20, 'n') + "\n";
+  auto filtered = [&](std::string pattern) {
+    std::stringstream input(found + missed);
+    bool fragment = false;
+    return stitched_lines(
+        tail<std::stringstream, TailParameters{16}>(input, 5,
+            Grep(std::move(pattern)), {}, nullptr, nullptr, &fragment),
+        fragment);
+  };
+  GTEST_ASSERT_EQ(filtered("abcdefghi"), (std::vector<std::string>{found}));
+  GTEST_ASSERT_TRUE(filtered(std::string(20, 'n')).empty());
+}
+
+TEST(Tail, Grep) {
+  std::stringstream input(R"(
+The
+quick
+brown
+fox
+jumps
+over
+the
+lazy
+dog
+)");
+  auto result = tail(input, 3, Grep("o"));
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  std::vector<std::string> expected{"dog\n", "over\n", "fox\n"};
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
+
+TEST(Tail, GrepAcrossBlocks) {
+  std::string text;
+  for (int i = 0; i < 500; ++i) {
+    text += "line " + std::to_string(i) + "\n";
+  }
+  std::vector<std::string> expected;
+  for (int i = 499; i >= 0; --i) {
+    auto line = "line " + std::to_string(i) + "\n";
+    if (line.contains("13")) {
+      expected.push_back(line);
+    }
+  }
+
+  std::stringstream input(text);
+  auto result = tail<std::stringstream, TailParameters{64}>(
+      input, 1000, Grep("13"));
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
+
+TEST(Tail, GrepTrailingNewline) {
+  std::stringstream input("a\nb\na\nab");
+  auto result = tail(input, 5, Grep("a\n"));
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  std::vector<std::string> expected{"a\n", "a\n"};
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
+
+TEST(Tail, GrepFirstLine) {
+  std::stringstream input("match\nother\n");
+  auto result = tail<std::stringstream, TailParameters{8}>(
+      input, 5, Grep("match"));
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  std::vector<std::string> expected{"match\n"};
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
+
+TEST(Tail, Range) {
+  std::stringstream input("zero\none\ntwo\nthree\nfour\n");
+  // Lines "one" and "two" only
+  auto result = tail<std::stringstream, TailParameters{8}>(
+      input, 5, std::nullopt, FileRange{5, 13});
+  std::vector<std::string> last_lines;
+  for (auto item : result) {
+    last_lines.push_back(std::string(item));
+  }
+  std::vector<std::string> expected{"two\n", "one\n"};
+  GTEST_ASSERT_EQ(last_lines, expected);
+}
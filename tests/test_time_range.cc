@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <fmt/format.h>
+#include <liblogovo/time_range.h>
+
+#include <sstream>
+
+namespace {
+
+// One line per second from 10:00:00, every third one followed by a line
+// without a timestamp
+std::string make_log(int lines) {
+  std::string text;
+  for (int i = 0; i < lines; ++i) {
+    text += fmt::format(
+        "2024-05-01 10:{:02}:{:02} line {}\n", i / 60, i % 60, i);
+    if (i % 3 == 0) {
+      text += "    continuation\n";
+    }
+  }
+  return text;
+}
+
+Timestamp at(int second) {
+  return *parse_request_timestamp("2024-05-01 10:00") +
+         std::chrono::seconds(second);
+}
+
+std::vector<std::string> lines_in(const std::string& text, FileRange range) {
+  std::stringstream input(text.substr(range.begin, range.end - range.begin));
+  std::vector<std::string> result;
+  for (std::string line; std::getline(input, line);) {
+    result.push_back(line);
+  }
+  return result;
+}
+
+class TimeRangeTest : public testing::Test {
+ protected:
+  FileRange find(const std::string& text, std::optional<Timestamp> since,
+      std::optional<Timestamp> until) {
+    std::stringstream input(text);
+    StreamBlockSource source(input, 64);
+    FileRange result{0, text.size()};
+    if (until) {
+      result.end = find_first_timestamped_line(source, parser_, result,
+          [&](Timestamp timestamp) { return timestamp > *until; }, 64);
+    }
+    if (since) {
+      result.begin = find_first_timestamped_line(source, parser_, result,
+          [&](Timestamp timestamp) { return timestamp >= *since; }, 64);
+    }
+    return result;
+  }
+
+  TimestampParser parser_ = *TimestampParser::create("%Y-%m-%d %H:%M:%S");
+};
+
+}  // namespace
+
+TEST_F(TimeRangeTest, Empty) {
+  auto range = find("", at(1), at(2));
+  EXPECT_EQ(range.begin, 0);
+  EXPECT_EQ(range.end, 0);
+}
+
+TEST_F(TimeRangeTest, Bounds) {
+  auto text = make_log(1000);
+  auto lines = lines_in(text, find(text, at(300), at(302)));
+  std::vector<std::string> expected{"2024-05-01 10:05:00 line 300",
+      "    continuation", "2024-05-01 10:05:01 line 301",
+      "2024-05-01 10:05:02 line 302"};
+  EXPECT_EQ(lines, expected);
+}
+
+TEST_F(TimeRangeTest, MatchesLinearScan) {
+  auto text = make_log(500);
+  for (int since = -1; since <= 501; since += 7) {
+    for (int until = since; until <= 502; until += 13) {
+      auto lines = lines_in(text, find(text, at(since), at(until)));
+      std::vector<std::string> expected;
+      bool in_range = false;
+      for (const auto& line : lines_in(text, {0, text.size()})) {
+        if (auto timestamp = parser_.parse(line)) {
+          in_range = *timestamp >= at(since) && *timestamp <= at(until);
+        }
+        if (in_range) {
+          expected.push_back(line);
+        }
+      }
+      EXPECT_EQ(lines, expected) << since << " " << until;
+    }
+  }
+}
+
+TEST_F(TimeRangeTest, OpenEnded) {
+  auto text = make_log(10);
+  auto range = find(text, at(8), std::nullopt);
+  EXPECT_EQ(lines_in(text, range),
+      std::vector<std::string>(
+          {"2024-05-01 10:00:08 line 8", "2024-05-01 10:00:09 line 9",
+              "    continuation"}));
+  range = find(text, std::nullopt, at(0));
+  EXPECT_EQ(lines_in(text, range),
+      std::vector<std::string>(
+          {"2024-05-01 10:00:00 line 0", "    continuation"}));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <liblogovo/timestamp.h>
+
+using namespace std::chrono;
+
+namespace {
+
+Timestamp make_timestamp(int y, unsigned m, unsigned d, unsigned hh,
+    unsigned mm, unsigned ss, uint64_t ns = 0) {
+  return Timestamp(sys_days(year(y) / month(m) / day(d))) + hours(hh) +
+         minutes(mm) + seconds(ss) + nanoseconds(ns);
+}
+
+}  // namespace
+
+TEST(Timestamp, InvalidFormats) {
+  EXPECT_FALSE(TimestampParser::create(""));
+  EXPECT_FALSE(TimestampParser::create("%Y-%q"));
+  EXPECT_FALSE(TimestampParser::create("%Y %"));
+  EXPECT_TRUE(TimestampParser::create("100%% %Y"));
+}
+
+TEST(Timestamp, Parse) {
+  auto parser = TimestampParser::create("[%Y-%m-%d %H:%M:%S.%f]");
+  GTEST_ASSERT_TRUE(parser);
+  size_t length = 0;
+  EXPECT_EQ(parser->parse("[2024-05-01 14:02:03.5] hello", &length),
+      make_timestamp(2024, 5, 1, 14, 2, 3, 500000000));
+  EXPECT_EQ(length, 23);
+  EXPECT_EQ(parser->parse("[2024-05-01 14:02:03.123456789]"),
+      make_timestamp(2024, 5, 1, 14, 2, 3, 123456789));
+  EXPECT_EQ(parser->max_length(), 31);
+
+  EXPECT_FALSE(parser->parse(""));
+  EXPECT_FALSE(parser->parse("[2024-05-01 14:02:03]"));
+  EXPECT_FALSE(parser->parse("[2024-5-01 14:02:03.5]"));
+  EXPECT_FALSE(parser->parse("[2024-02-30 14:02:03.5]"));
+  EXPECT_FALSE(parser->parse("[2024-05-01 24:02:03.5]"));
+  EXPECT_FALSE(parser->parse("  at some.java.Frame"));
+}
+
+TEST(Timestamp, PartialFormat) {
+  auto parser = TimestampParser::create("%Y-%m-%d");
+  GTEST_ASSERT_TRUE(parser);
+  EXPECT_EQ(parser->parse("2024-05-01T14:02:03"),
+      make_timestamp(2024, 5, 1, 0, 0, 0));
+}
+
+TEST(Timestamp, RequestTimestamps) {
+  EXPECT_EQ(parse_request_timestamp("2024-05-01T14:02"),
+      make_timestamp(2024, 5, 1, 14, 2, 0));
+  EXPECT_EQ(parse_request_timestamp("2024-05-01 14:02:03"),
+      make_timestamp(2024, 5, 1, 14, 2, 3));
+  EXPECT_EQ(parse_request_timestamp("2024-05-01T14:02:03.25"),
+      make_timestamp(2024, 5, 1, 14, 2, 3, 250000000));
+  EXPECT_FALSE(parse_request_timestamp("2024-05-01"));
+  EXPECT_FALSE(parse_request_timestamp("2024-05-01T14:02:03Z"));
+  EXPECT_FALSE(parse_request_timestamp("14:02"));
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+#include <liblogovo/tail.h>
+#include <liblogovo/trigram_index.h>
+
+#include "test_utils.h"
+
+namespace {
+
+constexpr size_t REGION_SIZE = TrigramIndex::REGION_SIZE;
+
+class TrigramIndexTest : public TempDirTest {
+ protected:
+  std::filesystem::path log_path() const { return dir_ / "log.txt"; }
+  std::filesystem::path index_path() const { return dir_ / "index/log.tidx"; }
+
+  // Appends lines up to `size` bytes of the file, with `rare` in a single
+  // line at `rare_at` (if it falls into the appended part)
+  void fill(size_t size, size_t rare_at = -1, std::string rare = "") {
+    size_t offset = std::filesystem::exists(log_path())
+                        ? std::filesystem::file_size(log_path())
+                        : 0;
+    std::ofstream output(log_path(), std::ios_base::app);
+    for (size_t i = offset; offset < size; ++i) {
+      std::string line = "line " + std::to_string(i % 1000) + " ok\n";
+      if (offset <= rare_at && rare_at < offset + line.size()) {
+        line = "line " + rare + "\n";
+      }
+      output << line;
+      offset += line.size();
+    }
+  }
+
+  std::vector<std::string> lines(
+      MappedFile& file, const Grep& grep, const TrigramSkip* skip) {
+    std::vector<std::string> result;
+    for (auto line : tail(file, 100, grep, {}, nullptr, nullptr, nullptr,
+             skip)) {
+      result.emplace_back(line);
+    }
+    return result;
+  }
+};
+
+}  // namespace
+
+TEST_F(TrigramIndexTest, SkipsRegionsWithoutTheSubstring) {
+  fill(4 * REGION_SIZE + 100, REGION_SIZE + 500, "needle");
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto file = MappedFile::open(log_path());
+  ASSERT_TRUE(file);
+  auto regions = index.regions(file->identity());
+  ASSERT_TRUE(regions);
+  EXPECT_EQ(regions->size(), 4);
+
+  auto skip = TrigramSkip::create(regions, Grep("needle"));
+  ASSERT_TRUE(skip);
+  // Regions 2 and 3 have no needle, but a hit in region 2 could start in
+  // region 1, which has it
+  size_t end = 4 * REGION_SIZE - 100;
+  EXPECT_EQ(skip->skippable_start(0, end), 3 * REGION_SIZE);
+  // A hit may go on into the last part, which isn't indexed
+  EXPECT_EQ(skip->skippable_start(0, 4 * REGION_SIZE), 4 * REGION_SIZE);
+  EXPECT_EQ(skip->skippable_start(0, file->size()), file->size());
+  // Down to where it's asked to
+  EXPECT_EQ(skip->skippable_start(3 * REGION_SIZE - 7, end),
+      3 * REGION_SIZE - 7);
+  // Trigrams of every line are there
+  auto common = TrigramSkip::create(regions, Grep("line 1"));
+  ASSERT_TRUE(common);
+  EXPECT_EQ(common->skippable_start(0, end), end);
+
+  auto skipped_before = metrics().grep_skipped_bytes.value();
+  auto expected = lines(*file, Grep("needle"), nullptr);
+  ASSERT_EQ(expected, std::vector<std::string>{"line needle\n"});
+  EXPECT_EQ(lines(*file, Grep("needle"), &*skip), expected);
+  // Most of regions 0 and 3
+  EXPECT_GT(metrics().grep_skipped_bytes.value() - skipped_before,
+      3 * REGION_SIZE / 2);
+  EXPECT_TRUE(lines(*file, Grep("nothing"), &*skip).empty());
+}
+
+TEST_F(TrigramIndexTest, HitAcrossRegions) {
+  // The substring starts in one region and ends in the next one
+  std::string rare = "0123456789abcdefghijklmnopqrstuvwxyzABCD";
+  fill(3 * REGION_SIZE + 100, 2 * REGION_SIZE - 8, rare);
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto file = MappedFile::open(log_path());
+  auto skip = TrigramSkip::create(index.regions(file->identity()), Grep(rare));
+  ASSERT_TRUE(skip);
+  EXPECT_EQ(lines(*file, Grep(rare), &*skip),
+      std::vector<std::string>{"line " + rare + "\n"});
+}
+
+TEST_F(TrigramIndexTest, ParallelGrep) {
+  fill(6 * REGION_SIZE, 5 * REGION_SIZE / 2, "needle");
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto file = MappedFile::open(log_path());
+  auto skip =
+      TrigramSkip::create(index.regions(file->identity()), Grep("needle"));
+  ASSERT_TRUE(skip);
+  ScanPool pool(2);
+  std::vector<std::string> result;
+  for (auto line : tail<MappedFile, TailParameters{64 * 1024, REGION_SIZE}>(
+           *file, 100, Grep("needle"), {}, &pool, nullptr, nullptr,
+           &*skip)) {
+    result.emplace_back(line);
+  }
+  EXPECT_EQ(result, std::vector<std::string>{"line needle\n"});
+}
+
+TEST_F(TrigramIndexTest, Incremental) {
+  fill(REGION_SIZE + 100);
+  {
+    TrigramIndex index(index_path());
+    ASSERT_TRUE(index.update(log_path()));
+    EXPECT_EQ(index.regions(*file_identity(log_path()))->size(), 1);
+  }
+  fill(3 * REGION_SIZE + 100, 2 * REGION_SIZE + 10, "needle");
+  // Loaded from the disk, and brought up to date
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto regions = index.regions(*file_identity(log_path()));
+  EXPECT_EQ(regions->size(), 3);
+  auto skip = TrigramSkip::create(regions, Grep("needle"));
+  EXPECT_EQ(skip->skippable_start(0, 3 * REGION_SIZE), 3 * REGION_SIZE);
+  EXPECT_EQ(skip->skippable_start(0, 2 * REGION_SIZE - 100), 0);
+
+  // A new file at the same path is indexed anew
+  std::filesystem::remove(log_path());
+  fill(REGION_SIZE + 100);
+  ASSERT_TRUE(index.update(log_path()));
+  regions = index.regions(*file_identity(log_path()));
+  EXPECT_EQ(regions->size(), 1);
+  EXPECT_EQ(TrigramSkip::create(regions, Grep("needle"))
+                ->skippable_start(0, REGION_SIZE - 100),
+      0);
+}
+
+TEST_F(TrigramIndexTest, RewrittenInPlace) {
+  fill(3 * REGION_SIZE + 100);
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto identity = *file_identity(log_path());
+
+  // Truncated and written anew up to a larger size (logrotate's
+  // copytruncate, and a busy writer), with lines much like before
+  std::filesystem::resize_file(log_path(), 0);
+  std::ofstream(log_path()) << "rotated\n";
+  fill(4 * REGION_SIZE + 100, 2 * REGION_SIZE + 10, "needle");
+  ASSERT_EQ(*file_identity(log_path()), identity);
+  ASSERT_TRUE(index.update(log_path()));
+  auto skip = TrigramSkip::create(index.regions(identity), Grep("needle"));
+  ASSERT_TRUE(skip);
+  EXPECT_EQ(skip->skippable_start(0, 3 * REGION_SIZE), 3 * REGION_SIZE);
+  // The region with the hit now isn't ruled out
+  EXPECT_EQ(skip->skippable_start(0, 2 * REGION_SIZE + 100),
+      2 * REGION_SIZE + 100);
+
+  // Truncated while nobody was watching: a loaded index checks every region
+  std::filesystem::resize_file(log_path(), 0);
+  std::ofstream(log_path()) << "rotated again\n";
+  fill(4 * REGION_SIZE + 100, REGION_SIZE + 10, "needle");
+  TrigramIndex loaded(index_path());
+  ASSERT_TRUE(loaded.update(log_path()));
+  skip = TrigramSkip::create(loaded.regions(identity), Grep("needle"));
+  EXPECT_EQ(skip->skippable_start(0, REGION_SIZE + 100), REGION_SIZE + 100);
+}
+
+TEST_F(TrigramIndexTest, Unsupported) {
+  fill(REGION_SIZE + 100);
+  TrigramIndex index(index_path());
+  ASSERT_TRUE(index.update(log_path()));
+  auto regions = index.regions(*file_identity(log_path()));
+  EXPECT_FALSE(TrigramSkip::create(regions, Grep("ab")));
+  EXPECT_FALSE(TrigramSkip::create(
+      regions, *Grep::create({.all = {"needle"}, .ignore_case = true})));
+  EXPECT_FALSE(
+      TrigramSkip::create(regions, *Grep::create({.any = {"abc", "def"}})));
+  // Of another file
+  EXPECT_FALSE(index.regions({}));
+}
+
+TEST_F(TrigramIndexTest, RegionsPerUpdate) {
+  fill(4 * REGION_SIZE + 100);
+  TrigramIndex index(index_path());
+  auto identity = *file_identity(log_path());
+  ASSERT_TRUE(index.update(log_path(), 3));
+  EXPECT_EQ(index.regions(identity)->size(), 3);
+  ASSERT_TRUE(index.update(log_path(), 3));
+  EXPECT_EQ(index.regions(identity)->size(), 4);
+
+  // Reading the regions is spent from the budget, and stops once it's out
+  TrigramIndex budgeted(dir_ / "index/budgeted.tidx");
+  ScanBudget budget(2 * REGION_SIZE, {});
+  ASSERT_TRUE(budgeted.update(log_path(), 3, &budget));
+  EXPECT_EQ(budgeted.regions(identity)->size(), 1);
+  EXPECT_TRUE(budget.exhausted());
+}
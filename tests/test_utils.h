@@ -0,0 +1,71 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <liblogovo/vendor/generator.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fixture for tests that work with files. Each test gets a directory of its
+// own, removed along with everything in it once the test is done.
+class TempDirTest : public testing::Test {
+ protected:
+  TempDirTest()
+      : dir_(std::filesystem::temp_directory_path() /
+             ("logovo_test_" + std::to_string(getpid()) + "_" +
+                 testing::UnitTest::GetInstance()
+                     ->current_test_info()
+                     ->test_suite_name())) {
+    std::filesystem::create_directories(dir_);
+  }
+  ~TempDirTest() override { std::filesystem::remove_all(dir_); }
+
+  // Replaces the contents of the file `name` in the directory
+  std::filesystem::path write(
+      const std::string& name, const std::string& content) const {
+    auto path = dir_ / name;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path) << content;
+    return path;
+  }
+
+  std::filesystem::path append(
+      const std::string& name, const std::string& content) const {
+    auto path = dir_ / name;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path, std::ios_base::app) << content;
+    return path;
+  }
+
+  std::filesystem::path dir_;
+};
+
+// In-memory contiguous `BlockSource`
+class StringSource {
+ public:
+  static constexpr bool CONTIGUOUS = true;
+
+  explicit StringSource(std::string data) : data_(std::move(data)) {}
+
+  size_t size() const { return data_.size(); }
+  std::optional<std::string_view> read(size_t offset, size_t size) const {
+    return std::string_view(data_).substr(offset, size);
+  }
+
+ private:
+  std::string data_;
+};
+
+inline std::vector<std::string> collect(
+    std::generator<std::string_view> lines) {
+  std::vector<std::string> result;
+  for (auto line : lines) {
+    result.push_back(std::string(line));
+  }
+  return result;
+}